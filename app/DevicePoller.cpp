@@ -0,0 +1,197 @@
+/*****************************************************************************/
+/**
+* \file	DevicePoller.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "DevicePoller.hpp"
+#include <algorithm>
+
+
+DevicePoller::DevicePoller(const Settings& settings) :
+	settings_(settings),
+	responses_(),
+	port_(settings_.delim.c_str(), &responses_, settings_.device, settings_.baudrate),
+	client_(port_, responses_, settings_.delim, settings_.window),
+	pending_(),
+	stopSending_(false),
+	stopCollecting_(false),
+	sent_(0),
+	answered_(0),
+	timedOut_(0),
+	failed_(0),
+	started_(),
+	stopped_(),
+	running_(false)
+{
+	if (settings_.match)
+	{
+		client_.setMatcher([](const std::string& command, const std::string& response)
+		{
+			return response.compare(0, command.size(), command) == 0;
+		});
+	}
+}
+
+DevicePoller::~DevicePoller()
+{
+	stop();
+
+	std::string *response = nullptr;
+	while (responses_.tryPop(response))
+	{
+		delete response;
+	}
+}
+
+bool DevicePoller::start()
+{
+	if (settings_.commands.empty() || !port_.open())
+	{
+		return false;
+	}
+
+	// a burn-in outlasts a replugged cable
+	port_.setReconnect(true, TimeoutSerialThread::RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY);
+	port_.setWriteQueueDepth(std::max<std::size_t>(settings_.window, TimeoutSerialThread::WRITE_QUEUE_DEPTH));
+
+	started_ = Clock::now();
+	running_ = true;
+	ioThread_ = std::thread(std::ref(port_));
+	clientThread_ = std::thread(std::ref(client_));
+	collector_ = std::thread(&DevicePoller::collect, this);
+	sender_ = std::thread(&DevicePoller::send, this);
+	return true;
+}
+
+void DevicePoller::requestStop()
+{
+	stopSending_ = true;
+	if (running_)
+	{
+		stopped_ = Clock::now();
+		running_ = false;
+	}
+}
+
+void DevicePoller::stop()
+{
+	// the commands in flight are answered or time out before the client stops
+	requestStop();
+	if (sender_.joinable())
+	{
+		sender_.join();
+	}
+	stopCollecting_ = true;
+	if (collector_.joinable())
+	{
+		collector_.join();
+	}
+	if (clientThread_.joinable())
+	{
+		client_.requestStop();
+		clientThread_.join();
+	}
+	if (ioThread_.joinable())
+	{
+		port_.requestStop();
+		ioThread_.join();
+	}
+}
+
+const std::string& DevicePoller::device() const
+{
+	return settings_.device;
+}
+
+DevicePoller::Statistics DevicePoller::statistics()
+{
+	const SciClient::Statistics client = client_.statistics();
+	Statistics s;
+	s.sent = sent_;
+	s.answered = answered_;
+	s.timedOut = timedOut_;
+	s.failed = failed_;
+	s.late = client.late;
+	s.unsolicited = client.unsolicited;
+	s.disconnects = port_.linkStatistics().disconnects;
+	s.seconds = std::chrono::duration<double>((running_ ? Clock::now() : stopped_) - started_).count();
+	return s;
+}
+
+const LatencyHistogram& DevicePoller::latency() const
+{
+	return client_.latency();
+}
+
+void DevicePoller::send()
+{
+	const Clock::duration period = settings_.rate > 0 ?
+		std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / settings_.rate)) : Clock::duration::zero();
+	Clock::time_point next = Clock::now();
+	std::size_t index = 0;
+	std::uint64_t failed = client_.statistics().failed;
+	while (!stopSending_)
+	{
+		// while the port is lost or writes fail every send fails at once, back off instead of spinning
+		const std::uint64_t failedNow = client_.statistics().failed;
+		if (!port_.isConnected() || failedNow != failed)
+		{
+			failed = failedNow;
+			std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT));
+			continue;
+		}
+
+		if (settings_.rate > 0)
+		{
+			const Clock::time_point now = Clock::now();
+			if (now < next)
+			{
+				std::this_thread::sleep_until(std::min(next, now + std::chrono::milliseconds(POLL_TIMEOUT)));
+				continue;
+			}
+			// after a stall, e.g. a full window, the missed sends are skipped instead of sent back to back
+			next = now - next > period ? now + period : next + period;
+		}
+
+		Pending pending;
+		pending.response = client_.send(settings_.commands[index], settings_.timeout);
+		pending_.push(std::move(pending));
+		++sent_;
+		index = (index + 1) % settings_.commands.size();
+	}
+}
+
+void DevicePoller::collect()
+{
+	for (;;)
+	{
+		Pending pending;
+		if (!pending_.waitPop(pending, POLL_TIMEOUT))
+		{
+			if (stopCollecting_ && pending_.empty())
+			{
+				break;
+			}
+			continue;
+		}
+
+		try
+		{
+			pending.response.get();
+			++answered_;
+		}
+		catch (const timeout_exception&)
+		{
+			++timedOut_;
+		}
+		catch (const std::exception&)
+		{
+			++failed_;
+		}
+	}
+}
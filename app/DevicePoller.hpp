@@ -0,0 +1,205 @@
+/*****************************************************************************/
+/**
+* \file	DevicePoller.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "TimeoutSerialThread.hpp"
+#include "SciClient.hpp"
+#include "ThreadSafeQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Polls one ventilator with a list of SCI commands at a target rate.
+*
+* Opens the device, sends the commands round robin through a pipelined
+* SciClient, which records the time from each send to its response. Several
+* pollers run side by side for burn-in of many ventilators at once.
+*
+* Each poller runs four threads: the Serial thread of the port, the response
+* dispatch of the client, the sender and the collector, which waits for the
+* responses in the order sent and counts them.
+*
+******************************************************************************/
+class DevicePoller : private boost::noncopyable
+{
+public:
+
+	/**
+	* Poll settings.
+	*/
+	struct Settings
+	{
+		std::string device;					///< Serial device.
+		std::uint32_t baudrate;				///< Baudrate.
+		std::string delim;					///< Response delimiter, also appended to each command.
+		std::vector<std::string> commands;	///< Commands sent round robin.
+		double rate;						///< Commands per second, 0 for as fast as the window allows.
+		std::size_t window;					///< Max nr of commands in flight.
+		std::uint32_t timeout;				///< Command timeout in milliseconds.
+		bool match;							///< Match responses to commands by prefix, skipping others.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param settings Poll settings.
+	*
+	******************************************************************************/
+	explicit DevicePoller(const Settings& settings);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Stops the poller.
+	*
+	*****************************************************************************/
+	~DevicePoller();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Open the device and start the threads.
+	*
+	* \return false if the device could not be opened.
+	*
+	* \throws boost::system::system_error if the line settings cannot be applied
+	*
+	******************************************************************************/
+	bool start();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Stop sending. Returns at once, so many pollers stop at the same time.
+	*
+	******************************************************************************/
+	void requestStop();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Stop sending, wait for the commands in flight, then stop all threads.
+	*
+	******************************************************************************/
+	void stop();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the device name.
+	*
+	******************************************************************************/
+	const std::string& device() const;
+
+
+	/**
+	* Poller counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t sent;			///< Commands handed to the client.
+		std::uint64_t answered;		///< Commands answered in time.
+		std::uint64_t timedOut;		///< Commands not answered in time.
+		std::uint64_t failed;		///< Commands that could not be written.
+		std::uint64_t late;			///< Responses discarded because their command timed out.
+		std::uint64_t unsolicited;	///< Responses with no matching command in flight.
+		std::uint64_t disconnects;	///< Times the device was lost.
+		double seconds;				///< Time sending, from start to now or to the stop request.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the poller counters.
+	*
+	******************************************************************************/
+	Statistics statistics();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the send to response latency of the answered commands.
+	*
+	* Recorded by the client when it matches the response, see SciClient::latency().
+	*
+	*
+	******************************************************************************/
+	const LatencyHistogram& latency() const;
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	* A command sent, waiting for the collector.
+	*/
+	struct Pending
+	{
+		std::future<std::string> response;	///< Completed by the client.
+	};
+
+	/**
+	* Poller limits
+	*/
+	enum Limits
+	{
+		POLL_TIMEOUT = 100,			///< Max time in milliseconds between stop checks.
+		RECONNECT_MAX_DELAY = 2000,	///< Max delay in milliseconds between reopen attempts.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send the commands round robin at the target rate.
+	*
+	* Pauses for POLL_TIMEOUT while the port is lost or after a command
+	* could not be written.
+	*
+	******************************************************************************/
+	void send();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait for the responses in the order sent and count them.
+	*
+	******************************************************************************/
+	void collect();
+
+
+	Settings settings_;						///< Poll settings.
+	ThreadSafeQueue<std::string *> responses_;	///< Received responses.
+	TimeoutSerialThread port_;				///< The device.
+	SciClient client_;						///< Pipelined commands on port_.
+	ThreadSafeQueue<Pending> pending_;		///< Sent commands, oldest first.
+	std::thread ioThread_;					///< Runs port_.
+	std::thread clientThread_;				///< Runs client_.
+	std::thread sender_;					///< Runs send().
+	std::thread collector_;					///< Runs collect().
+	std::atomic<bool> stopSending_;			///< Request to terminate the sender.
+	std::atomic<bool> stopCollecting_;		///< Request to terminate the collector once pending_ is empty.
+	std::atomic<std::uint64_t> sent_;		///< Commands handed to the client.
+	std::atomic<std::uint64_t> answered_;	///< Commands answered in time.
+	std::atomic<std::uint64_t> timedOut_;	///< Commands not answered in time.
+	std::atomic<std::uint64_t> failed_;		///< Commands that could not be written.
+	Clock::time_point started_;				///< Set by start().
+	Clock::time_point stopped_;				///< Set by requestStop().
+	std::atomic<bool> running_;				///< Between start() and requestStop().
+};
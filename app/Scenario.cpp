@@ -0,0 +1,238 @@
+/*****************************************************************************/
+/**
+* \file	Scenario.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "Scenario.hpp"
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+
+
+/**
+* Split a line into tokens. Double quotes group blanks, # outside quotes ends the line.
+*
+* \param[out] end Length of the line without comment.
+*
+* \return false on an unterminated quote.
+*/
+static bool tokenize(const std::string& line, std::vector<std::string>& tokens, std::string::size_type& end)
+{
+	std::string token;
+	bool quoted = false;
+	bool inToken = false;
+	for (end = 0; end < line.size(); ++end)
+	{
+		const char c = line[end];
+		if (quoted)
+		{
+			if (c == '"')
+			{
+				quoted = false;
+			}
+			else
+			{
+				token += c;
+			}
+		}
+		else if (c == '"')
+		{
+			quoted = true;
+			inToken = true;
+		}
+		else if (c == '#')
+		{
+			break;
+		}
+		else if (std::isspace(static_cast<unsigned char>(c)))
+		{
+			if (inToken)
+			{
+				tokens.push_back(token);
+				token.clear();
+				inToken = false;
+			}
+		}
+		else
+		{
+			token += c;
+			inToken = true;
+		}
+	}
+	if (inToken)
+	{
+		tokens.push_back(token);
+	}
+	return !quoted;
+}
+
+static std::string trim(const std::string& line)
+{
+	const std::string::size_type first = line.find_first_not_of(" \t\r");
+	if (first == std::string::npos)
+	{
+		return std::string();
+	}
+	return line.substr(first, line.find_last_not_of(" \t\r") - first + 1);
+}
+
+bool Scenario::load(const std::string& path, std::string& error)
+{
+	std::ifstream file(path.c_str());
+	if (!file)
+	{
+		error = "cannot read " + path;
+		return false;
+	}
+	return parse(file, error);
+}
+
+bool Scenario::parse(std::istream& in, std::string& error)
+{
+	steps_.clear();
+	std::vector<std::size_t> open;	// every steps without end
+	std::string line;
+	std::size_t number = 0;
+	while (std::getline(in, line))
+	{
+		++number;
+		const std::string where = "line " + std::to_string(number) + ": ";
+		std::vector<std::string> tokens;
+		std::string::size_type end = 0;
+		if (!tokenize(line, tokens, end))
+		{
+			error = where + "unterminated quote";
+			return false;
+		}
+		if (tokens.empty())
+		{
+			continue;
+		}
+
+		Step step = Step();
+		step.timeout = DEFAULT_TIMEOUT;
+		step.line = number;
+		step.text = trim(line.substr(0, end));
+		const std::string& keyword = tokens[0];
+		std::size_t next = 2;	// first option token
+		if (keyword == "send" && tokens.size() == 2)
+		{
+			step.kind = stepSend;
+			step.command = tokens[1];
+		}
+		else if ((keyword == "expect" || keyword == "request") && tokens.size() >= 2)
+		{
+			step.kind = keyword == "expect" ? stepExpect : stepRequest;
+			step.command = keyword == "request" ? tokens[1] : std::string();
+			step.prefix = tokens[1];
+			while (next + 1 < tokens.size())
+			{
+				std::uint64_t timeout = 0;
+				if (tokens[next] == "expect" && step.kind == stepRequest)
+				{
+					step.prefix = tokens[next + 1];
+				}
+				else if (tokens[next] == "within" && parseDuration(tokens[next + 1], timeout) && timeout >= 1000)
+				{
+					step.timeout = static_cast<std::uint32_t>(timeout / 1000);
+				}
+				else
+				{
+					break;
+				}
+				next += 2;
+			}
+			if (next != tokens.size())
+			{
+				error = where + "expected [expect <prefix>] [within <duration>]";
+				return false;
+			}
+		}
+		else if (keyword == "sleep" && tokens.size() == 2 && parseDuration(tokens[1], step.period))
+		{
+			step.kind = stepSleep;
+		}
+		else if (keyword == "every" && (tokens.size() == 2 || (tokens.size() == 4 && tokens[2] == "for"))
+			&& parseDuration(tokens[1], step.period) && step.period > 0
+			&& (tokens.size() == 2 || parseDuration(tokens[3], step.duration)))
+		{
+			step.kind = stepEvery;
+			open.push_back(steps_.size());
+		}
+		else if (keyword == "end" && tokens.size() == 1)
+		{
+			if (open.empty())
+			{
+				error = where + "end without every";
+				return false;
+			}
+			step.kind = stepEnd;
+			step.jump = open.back();
+			steps_[open.back()].jump = steps_.size();
+			open.pop_back();
+		}
+		else
+		{
+			error = where + "cannot parse '" + step.text + "'";
+			return false;
+		}
+		steps_.push_back(step);
+	}
+
+	if (!open.empty())
+	{
+		error = "line " + std::to_string(steps_[open.back()].line) + ": every without end";
+		return false;
+	}
+	if (steps_.empty())
+	{
+		error = "no steps";
+		return false;
+	}
+	return true;
+}
+
+const std::vector<Scenario::Step>& Scenario::steps() const
+{
+	return steps_;
+}
+
+bool Scenario::parseDuration(const std::string& token, std::uint64_t& microSeconds)
+{
+	char *end = nullptr;
+	const double value = std::strtod(token.c_str(), &end);
+	if (end == token.c_str() || value < 0)
+	{
+		return false;
+	}
+
+	const std::string unit(end);
+	double scale = 0;
+	if (unit.empty() || unit == "ms")
+	{
+		scale = 1e3;
+	}
+	else if (unit == "s")
+	{
+		scale = 1e6;
+	}
+	else if (unit == "m")
+	{
+		scale = 60e6;
+	}
+	else if (unit == "h")
+	{
+		scale = 3600e6;
+	}
+	else
+	{
+		return false;
+	}
+	microSeconds = static_cast<std::uint64_t>(value * scale + 0.5);
+	return true;
+}
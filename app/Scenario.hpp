@@ -0,0 +1,136 @@
+/*****************************************************************************/
+/**
+* \file	Scenario.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief A timed sequence of SCI commands, run against each device by a
+* ScenarioRunner.
+*
+* A scenario file holds one step per line. Tokens are separated by blanks,
+* a token in double quotes may hold blanks, and # starts a comment. Durations
+* are a number followed by ms, s, m or h; a plain number is milliseconds.
+*
+*   send <command>                              write the command.
+*   expect <prefix> [within <duration>]         wait for a message starting with prefix.
+*   request <command> [expect <prefix>] [within <duration>]
+*                                               send, then expect. Default prefix: the command.
+*   sleep <duration>                            wait.
+*   every <period> [for <duration>]             run the steps up to the matching end once
+*   ...                                         per period, on a fixed schedule, for the
+*   end                                         duration or until the run stops.
+*
+* The default timeout of expect and request is DEFAULT_TIMEOUT. Messages
+* that no step expects are counted as stream data. E.g.
+*
+*   request RADC
+*   every 500ms for 10m
+*       request RTIM within 200ms
+*   end
+*
+******************************************************************************/
+class Scenario
+{
+public:
+
+	/**
+	* Step kinds.
+	*/
+	enum Kind
+	{
+		stepSend,		///< Write a command.
+		stepExpect,		///< Wait for a matching message.
+		stepRequest,	///< Write a command, then wait for a matching message.
+		stepSleep,		///< Wait for a duration.
+		stepEvery,		///< Head of a periodic block.
+		stepEnd,		///< End of a periodic block.
+	};
+
+	/**
+	* One step.
+	*/
+	struct Step
+	{
+		Kind kind;					///< Step kind.
+		std::string command;		///< Command written by send and request.
+		std::string prefix;			///< Prefix expected by expect and request.
+		std::uint32_t timeout;		///< Timeout of expect and request, in milliseconds.
+		std::uint64_t period;		///< Sleep duration, or period of every, in microseconds.
+		std::uint64_t duration;		///< Duration of every in microseconds, 0 for until stopped.
+		std::size_t jump;			///< Index of the matching end of every, or every of end.
+		std::size_t line;			///< Line in the scenario file.
+		std::string text;			///< The line, trimmed.
+	};
+
+	/**
+	* Scenario settings
+	*/
+	enum Settings
+	{
+		DEFAULT_TIMEOUT = 1000,	///< Default timeout of expect and request in milliseconds.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Read a scenario file.
+	*
+	* \param path Scenario file.
+	* \param[out] error Reason, if the file could not be read or parsed.
+	*
+	* \return false upon error.
+	*
+	******************************************************************************/
+	bool load(const std::string& path, std::string& error);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Parse a scenario.
+	*
+	* \param in Scenario text.
+	* \param[out] error Reason, with line number, if it could not be parsed.
+	*
+	* \return false upon error.
+	*
+	******************************************************************************/
+	bool parse(std::istream& in, std::string& error);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the steps. Every block is closed by its end.
+	*
+	******************************************************************************/
+	const std::vector<Step>& steps() const;
+
+private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Parse a duration.
+	*
+	* \param token Number with optional unit.
+	* \param[out] microSeconds Duration.
+	*
+	* \return false if the token is no duration.
+	*
+	******************************************************************************/
+	static bool parseDuration(const std::string& token, std::uint64_t& microSeconds);
+
+
+	std::vector<Step> steps_;	///< The steps.
+};
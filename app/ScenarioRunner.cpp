@@ -0,0 +1,317 @@
+/*****************************************************************************/
+/**
+* \file	ScenarioRunner.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "ScenarioRunner.hpp"
+#include <boost/bind.hpp>
+
+
+ScenarioRunner::ScenarioRunner(boost::asio::io_service& io, const Scenario& scenario,
+	std::vector<std::unique_ptr<ScenarioStepStatistics>>& statistics,
+	const std::string& devname, std::uint32_t baudrate, const std::string& delim,
+	boost::asio::serial_port_base::parity opt_parity,
+	boost::asio::serial_port_base::character_size opt_csize,
+	boost::asio::serial_port_base::flow_control opt_flow,
+	boost::asio::serial_port_base::stop_bits opt_stop) :
+	steps_(scenario.steps()),
+	stepStatistics_(statistics),
+	devname_(devname),
+	baudrate_(baudrate),
+	opt_parity_(opt_parity),
+	opt_csize_(opt_csize),
+	opt_flow_(opt_flow),
+	opt_stop_(opt_stop),
+	port_(io),
+	timer_(io),
+	framer_(delim),
+	messages_(),
+	assembler_(&framer_, &messages_),
+	readData_(nullptr),
+	pc_(0),
+	token_(0),
+	loops_(),
+	expecting_(false),
+	expectStart_(),
+	statistics_(),
+	done_(false)
+{
+	statistics_.finished = false;
+}
+
+bool ScenarioRunner::start()
+{
+	boost::system::error_code error;
+	port_.open(devname_, error);
+
+	// all line settings, as TimeoutSerialThread, not whatever the port last had
+	if (!error)
+	{
+		port_.set_option(boost::asio::serial_port_base::baud_rate(baudrate_), error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_parity_, error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_csize_, error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_flow_, error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_stop_, error);
+	}
+	if (error)
+	{
+		statistics_.error = error.message();
+		boost::system::error_code ignored;
+		port_.close(ignored);
+		done_ = true;
+		return false;
+	}
+
+	asyncRead();
+	run();
+	return true;
+}
+
+void ScenarioRunner::stop()
+{
+	if (done_)
+	{
+		return;
+	}
+	done_ = true;
+	expecting_ = false;
+	boost::system::error_code error;
+	timer_.cancel(error);
+	port_.close(error);
+}
+
+bool ScenarioRunner::done() const
+{
+	return done_;
+}
+
+const std::string& ScenarioRunner::device() const
+{
+	return devname_;
+}
+
+ScenarioRunner::Statistics ScenarioRunner::statistics() const
+{
+	return statistics_;
+}
+
+void ScenarioRunner::run()
+{
+	if (done_)
+	{
+		return;
+	}
+	++token_;
+	if (pc_ >= steps_.size())
+	{
+		statistics_.finished = true;
+		stop();
+		return;
+	}
+
+	const Scenario::Step& step = steps_[pc_];
+	const Clock::time_point now = Clock::now();
+	switch (step.kind)
+	{
+	case Scenario::stepSend:
+	case Scenario::stepRequest:
+		write();
+		break;
+
+	case Scenario::stepExpect:
+		expect(now);
+		break;
+
+	case Scenario::stepSleep:
+		waitUntil(now + std::chrono::microseconds(step.period));
+		break;
+
+	case Scenario::stepEvery:
+	{
+		if (loops_.empty() || loops_.back().head != pc_)
+		{
+			Loop loop;
+			loop.head = pc_;
+			loop.next = now;
+			loop.until = step.duration > 0 ? now + std::chrono::microseconds(step.duration) : Clock::time_point::max();
+			loops_.push_back(loop);
+		}
+		const Loop& loop = loops_.back();
+		if (loop.next >= loop.until)
+		{
+			loops_.pop_back();
+			pc_ = step.jump + 1;
+			run();
+			break;
+		}
+		waitUntil(loop.next);
+		break;
+	}
+
+	case Scenario::stepEnd:
+	{
+		// the next period is due a whole period after the previous one, not after the block
+		Loop& loop = loops_.back();
+		const Clock::duration period = std::chrono::microseconds(steps_[step.jump].period);
+		loop.next += period;
+		const Clock::duration behind = now - loop.next;
+		if (behind >= period)
+		{
+			const Clock::duration::rep missed = behind / period;
+			loop.next += missed * period;
+			stepStatistics_[step.jump]->skipped += missed;
+		}
+		pc_ = step.jump;
+		run();
+		break;
+	}
+	}
+}
+
+void ScenarioRunner::complete(bool success, Clock::time_point start)
+{
+	ScenarioStepStatistics& s = *stepStatistics_[pc_];
+	if (success)
+	{
+		++s.runs;
+		++statistics_.steps;
+		s.latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+	}
+	else
+	{
+		++s.failed;
+		++statistics_.failed;
+	}
+	++pc_;
+	run();
+}
+
+void ScenarioRunner::write()
+{
+	const Scenario::Step& step = steps_[pc_];
+	const Clock::time_point start = Clock::now();
+	const std::uint64_t token = token_;
+	const bool request = step.kind == Scenario::stepRequest;
+	if (request)
+	{
+		// the response may be read before the write completion runs
+		expect(start);
+	}
+
+	std::shared_ptr<std::string> data = std::make_shared<std::string>(framer_.encode(step.command));
+	boost::asio::async_write(port_, boost::asio::buffer(*data),
+		[this, data, token, start, request](const boost::system::error_code& error, std::size_t)
+	{
+		if (done_ || token != token_)
+		{
+			return;
+		}
+		if (error)
+		{
+			fail("write: " + error.message());
+		}
+		else if (!request)
+		{
+			complete(true, start);
+		}
+	});
+}
+
+void ScenarioRunner::expect(Clock::time_point start)
+{
+	expecting_ = true;
+	expectStart_ = start;
+	const std::uint64_t token = token_;
+	timer_.expires_at(start + std::chrono::milliseconds(steps_[pc_].timeout));
+	timer_.async_wait([this, token](const boost::system::error_code& error)
+	{
+		if (error || done_ || token != token_)
+		{
+			return;
+		}
+		expecting_ = false;
+		complete(false, expectStart_);
+	});
+}
+
+void ScenarioRunner::waitUntil(Clock::time_point due)
+{
+	const std::uint64_t token = token_;
+	timer_.expires_at(due);
+	timer_.async_wait([this, token, due](const boost::system::error_code& error)
+	{
+		if (error || done_ || token != token_)
+		{
+			return;
+		}
+		complete(true, due);
+	});
+}
+
+void ScenarioRunner::asyncRead()
+{
+	std::size_t available = 0;
+	readData_ = assembler_.prepare(READ_BUFFER_SIZE, available);
+	port_.async_read_some(boost::asio::buffer(readData_, available),
+		boost::bind(&ScenarioRunner::readCompleted, this,
+			boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void ScenarioRunner::readCompleted(const boost::system::error_code& error, std::size_t bytesTransferred)
+{
+	if (done_)
+	{
+		return;
+	}
+	if (error)
+	{
+		fail("read: " + error.message());
+		return;
+	}
+
+	assembler_.commit(bytesTransferred);
+	std::string *message = nullptr;
+	while (messages_.tryPop(message))
+	{
+		if (expecting_ && message->compare(0, steps_[pc_].prefix.size(), steps_[pc_].prefix) == 0)
+		{
+			++statistics_.responses;
+			expecting_ = false;
+			boost::system::error_code ignored;
+			timer_.cancel(ignored);
+			complete(true, expectStart_);
+		}
+		else
+		{
+			++statistics_.stream;
+		}
+		delete message;
+	}
+	if (!done_)
+	{
+		asyncRead();
+	}
+}
+
+void ScenarioRunner::fail(const std::string& what)
+{
+	statistics_.error = what;
+	stop();
+}
@@ -0,0 +1,279 @@
+/*****************************************************************************/
+/**
+* \file	ScenarioRunner.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "Scenario.hpp"
+#include "DelimiterFramer.hpp"
+#include "FrameAssembler.hpp"
+#include "ThreadSafeQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/utility.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Counters of one scenario step, summed over all devices.
+*
+* The latency is the time from the start of the step until its message
+* was written (send) or the expected message arrived (expect, request), or
+* how late the timer fired (sleep, every).
+*
+******************************************************************************/
+struct ScenarioStepStatistics
+{
+	ScenarioStepStatistics() :
+		runs(0),
+		failed(0),
+		skipped(0)
+	{
+	}
+
+	std::uint64_t runs;			///< Times completed.
+	std::uint64_t failed;		///< Times timed out or not written.
+	std::uint64_t skipped;		///< Every only: periods skipped because the block overran.
+	LatencyHistogram latency;	///< Step latency.
+};
+
+
+/*****************************************************************************/
+/**
+* \brief Runs a Scenario against one device, on a shared io_service.
+*
+* Nothing blocks: the port is read continuously and each step is a write,
+* a timer or an expected message that completes asynchronously, so one
+* thread running the io_service drives hundreds of devices.
+*
+* Timers expire at absolute steady clock times. The periods of an every
+* block are due at fixed offsets from its start, so late wake-ups and slow
+* responses do not accumulate into drift. A period that starts late runs
+* at once; periods the block overran by more than one period are skipped
+* and counted.
+*
+* The port is opened here rather than by a TimeoutSerialThread, which runs
+* an io_service and a thread per port, so a lost device fails the runner
+* instead of being reopened.
+*
+* All member functions must be called from the thread running the io_service,
+* e.g. through post(), except the constructor and statistics() once the
+* io_service stopped.
+*
+******************************************************************************/
+class ScenarioRunner : private boost::noncopyable
+{
+public:
+
+	/**
+	* Runner counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t steps;		///< Steps completed.
+		std::uint64_t failed;		///< Steps timed out or not written.
+		std::uint64_t responses;	///< Messages matched by a step.
+		std::uint64_t stream;		///< Messages no step expected.
+		bool finished;				///< Ran to the last step.
+		std::string error;			///< Why the device failed, empty if it did not.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param io Runs the scenario.
+	* \param scenario Steps. Not owned, must outlive the object.
+	* \param statistics Counters per step, shared by all runners of the scenario. Not owned.
+	* \param devname Serial device.
+	* \param baudrate Baudrate.
+	* \param delim Message delimiter, also appended to each command.
+	* \param opt_parity Parity. Default: none.
+	* \param opt_csize Nr of databits. Default: 8.
+	* \param opt_flow Flow control. Default: none.
+	* \param opt_stop Nr of stopbits. Default: 1.
+	*
+	******************************************************************************/
+	ScenarioRunner(boost::asio::io_service& io, const Scenario& scenario,
+		std::vector<std::unique_ptr<ScenarioStepStatistics>>& statistics,
+		const std::string& devname, std::uint32_t baudrate, const std::string& delim,
+		boost::asio::serial_port_base::parity opt_parity =
+		boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none),
+		boost::asio::serial_port_base::character_size opt_csize =
+		boost::asio::serial_port_base::character_size(8),
+		boost::asio::serial_port_base::flow_control opt_flow =
+		boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none),
+		boost::asio::serial_port_base::stop_bits opt_stop =
+		boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one));
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Open the device with all line settings and start the first step.
+	*
+	* \return false if the device could not be opened.
+	*
+	******************************************************************************/
+	bool start();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Abandon the scenario and close the device.
+	*
+	******************************************************************************/
+	void stop();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true once the scenario finished, failed or was stopped.
+	*
+	******************************************************************************/
+	bool done() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the device name.
+	*
+	******************************************************************************/
+	const std::string& device() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the runner counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+	/**
+	* Runner settings
+	*/
+	enum Settings
+	{
+		READ_BUFFER_SIZE = 1024,	///< Min free space in the read buffer per read.
+	};
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	* An every block in progress.
+	*/
+	struct Loop
+	{
+		std::size_t head;			///< Index of the every step.
+		Clock::time_point next;		///< Start of the next period.
+		Clock::time_point until;	///< End of the block, Clock::time_point::max() for none.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Run the current step.
+	*
+	******************************************************************************/
+	void run();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Count the current step and run the next one.
+	*
+	* \param success false if the step failed.
+	* \param start When the step started, for its latency.
+	*
+	******************************************************************************/
+	void complete(bool success, Clock::time_point start);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Write the command of the current step, then expect or complete.
+	*
+	******************************************************************************/
+	void write();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait for the message the current step expects, until its timeout.
+	*
+	* \param start When the step started.
+	*
+	******************************************************************************/
+	void expect(Clock::time_point start);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait until a time, then complete the current step with the timer lag.
+	*
+	* \param due When the step is due.
+	*
+	******************************************************************************/
+	void waitUntil(Clock::time_point due);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Asynchronous read of whatever is available.
+	*
+	******************************************************************************/
+	void asyncRead();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Read completion. Matches or counts the received messages.
+	*
+	******************************************************************************/
+	void readCompleted(const boost::system::error_code& error, std::size_t bytesTransferred);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Give up on the device.
+	*
+	* \param what Reason.
+	*
+	******************************************************************************/
+	void fail(const std::string& what);
+
+
+	const std::vector<Scenario::Step>& steps_;	///< The scenario.
+	std::vector<std::unique_ptr<ScenarioStepStatistics>>& stepStatistics_;	///< Counters per step.
+	std::string devname_;					///< Serial device.
+	std::uint32_t baudrate_;				///< Baudrate.
+	boost::asio::serial_port_base::parity opt_parity_;			///< Parity.
+	boost::asio::serial_port_base::character_size opt_csize_;	///< Nr of databits.
+	boost::asio::serial_port_base::flow_control opt_flow_;		///< Flow control.
+	boost::asio::serial_port_base::stop_bits opt_stop_;			///< Nr of stopbits.
+	boost::asio::serial_port port_;			///< The device.
+	boost::asio::steady_timer timer_;		///< Timeouts and waits.
+	DelimiterFramer framer_;				///< Splits the received data.
+	ThreadSafeQueue<std::string *> messages_;	///< Messages of the last read.
+	FrameAssembler assembler_;				///< Received, not yet delimited data.
+	char *readData_;						///< Where the read in progress puts its data.
+	std::size_t pc_;						///< Index of the current step.
+	std::uint64_t token_;					///< Changed per step, so handlers of an earlier one are ignored.
+	std::vector<Loop> loops_;				///< Every blocks in progress, innermost last.
+	bool expecting_;						///< The current step waits for a message.
+	Clock::time_point expectStart_;			///< Start of the expecting step.
+	Statistics statistics_;					///< Runner counters.
+	bool done_;								///< Finished, failed or stopped.
+};
@@ -0,0 +1,230 @@
+/*****************************************************************************/
+/**
+* \file	SimulatedDevice.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "SimulatedDevice.hpp"
+#include <algorithm>
+#include <deque>
+#include <utility>
+
+
+static std::int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SimulatedDevice::SimulatedDevice(std::uint32_t id, const Settings& settings) :
+	id_(id),
+	settings_(settings),
+	pty_(),
+	commands_(),
+	port_(settings_.delim.c_str(), &commands_, "", 0),
+	probe_("port " + std::to_string(id)),
+	latency_(settings.latency),
+	silentUntil_(0),
+	streamSeq_(0),
+	stopRequested_(false),
+	commandCount_(0),
+	responseCount_(0),
+	streamCount_(0),
+	dropCount_(0),
+	rng_(id)
+{
+}
+
+SimulatedDevice::~SimulatedDevice()
+{
+	stop();
+
+	std::string *command = nullptr;
+	while (commands_.tryPop(command))
+	{
+		delete command;
+	}
+}
+
+bool SimulatedDevice::start()
+{
+	if (!port_.assign(pty_.releaseMaster()))
+	{
+		return false;
+	}
+
+	// a device waits for its client forever
+	port_.setMessageTimeout(0);
+	port_.setWriteQueueDepth(WRITE_QUEUE_DEPTH);
+	port_.setLatencyProbe(&probe_);
+
+	ioThread_ = std::thread(std::ref(port_));
+	responder_ = std::thread(&SimulatedDevice::respond, this);
+	if (settings_.streamPeriod > 0)
+	{
+		streamer_ = std::thread(&SimulatedDevice::stream, this);
+	}
+	return true;
+}
+
+void SimulatedDevice::stop()
+{
+	stopRequested_ = true;
+	if (responder_.joinable())
+	{
+		responder_.join();
+	}
+	if (streamer_.joinable())
+	{
+		streamer_.join();
+	}
+	if (ioThread_.joinable())
+	{
+		port_.requestStop();
+		ioThread_.join();
+	}
+}
+
+const std::string& SimulatedDevice::slaveName() const
+{
+	return pty_.slaveName();
+}
+
+void SimulatedDevice::setLatency(std::uint32_t milliSeconds)
+{
+	latency_ = milliSeconds;
+}
+
+void SimulatedDevice::injectNoise(std::size_t size)
+{
+	std::string noise(size, '\0');
+	{
+		std::lock_guard<std::mutex> lock{ rngMutex_ };
+		for (char& c : noise)
+		{
+			c = static_cast<char>(rng_());
+		}
+	}
+	send(noise);
+}
+
+void SimulatedDevice::injectPartialFrame()
+{
+	std::string message = streamMessage();
+	message.resize(message.size() / 2);
+	send(message);
+}
+
+void SimulatedDevice::injectSilence(std::uint32_t seconds)
+{
+	silentUntil_ = nowNs() + static_cast<std::int64_t>(seconds) * 1000000000;
+}
+
+void SimulatedDevice::injectBurst(std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (send(streamMessage()))
+		{
+			++streamCount_;
+		}
+	}
+}
+
+SimulatedDevice::Statistics SimulatedDevice::statistics() const
+{
+	Statistics s;
+	s.commands = commandCount_;
+	s.responses = responseCount_;
+	s.streamed = streamCount_;
+	s.dropped = dropCount_;
+	return s;
+}
+
+void SimulatedDevice::dumpLatency(std::ostream& out) const
+{
+	probe_.dump(out);
+}
+
+void SimulatedDevice::respond()
+{
+	std::deque<std::pair<Clock::time_point, std::string>> pending;	// due time, response
+	while (!stopRequested_)
+	{
+		std::uint32_t wait = POLL_TIMEOUT;
+		if (!pending.empty())
+		{
+			const std::int64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(pending.front().first - Clock::now()).count();
+			wait = static_cast<std::uint32_t>(std::max<std::int64_t>(0, std::min<std::int64_t>(left, POLL_TIMEOUT)));
+		}
+
+		std::string *command = nullptr;
+		bool popped = commands_.waitPop(command, wait);
+		while (popped)
+		{
+			probe_.popped();
+			++commandCount_;
+			std::map<std::string, std::string>::const_iterator it = settings_.responses.find(*command);
+			pending.push_back(std::make_pair(Clock::now() + std::chrono::milliseconds(latency_.load()),
+				(it != settings_.responses.end() ? it->second : *command + " OK") + settings_.delim));
+			delete command;
+			popped = commands_.tryPop(command);
+		}
+
+		while (!pending.empty() && pending.front().first <= Clock::now())
+		{
+			if (send(pending.front().second))
+			{
+				++responseCount_;
+			}
+			pending.pop_front();
+		}
+	}
+}
+
+void SimulatedDevice::stream()
+{
+	Clock::time_point next = Clock::now();
+	while (!stopRequested_)
+	{
+		next += std::chrono::microseconds(settings_.streamPeriod);
+		std::this_thread::sleep_until(next);
+		if (send(streamMessage()))
+		{
+			++streamCount_;
+		}
+	}
+}
+
+bool SimulatedDevice::send(const std::string& data)
+{
+	if (isSilent())
+	{
+		return false;
+	}
+	if (!port_.asyncWrite(data, TimeoutSerialThread::WriteHandler(), POLL_TIMEOUT))
+	{
+		++dropCount_;
+		return false;
+	}
+	return true;
+}
+
+std::string SimulatedDevice::streamMessage()
+{
+	std::string message = "DATA " + std::to_string(id_) + " " + std::to_string(streamSeq_++) + " ";
+	for (std::size_t i = 0; message.size() < settings_.streamSize; ++i)
+	{
+		message += static_cast<char>('0' + i % 10);
+	}
+	return message + settings_.delim;
+}
+
+bool SimulatedDevice::isSilent() const
+{
+	return nowNs() < silentUntil_;
+}
@@ -0,0 +1,258 @@
+/*****************************************************************************/
+/**
+* \file	SimulatedDevice.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "TimeoutSerialThread.hpp"
+#include "PseudoTerminal.hpp"
+#include "LatencyProbe.hpp"
+#include "ThreadSafeQueue.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+/*****************************************************************************/
+/**
+* \brief A ventilator SCI port simulated on a pseudo-terminal.
+*
+* Clients open slaveName() like a real serial device. Commands are answered
+* after a configurable latency, either from a response table or with the
+* command followed by " OK". A data stream of configurable size and period
+* can run alongside. Faults are injected on demand.
+*
+* All I/O on the master side goes through a TimeoutSerialThread.
+*
+******************************************************************************/
+class SimulatedDevice : private boost::noncopyable
+{
+public:
+
+	/**
+	* Device behavior.
+	*/
+	struct Settings
+	{
+		std::string delim;								///< Message delimiter.
+		std::uint32_t latency;							///< Response latency in milliseconds.
+		std::uint32_t streamPeriod;						///< Data stream period in microseconds, 0 for no stream.
+		std::size_t streamSize;							///< Data stream message size, without delimiter.
+		std::map<std::string, std::string> responses;	///< Response per command. Other commands get "<command> OK".
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Opens the pseudo-terminal.
+	*
+	* \param id Port id, used in the stream messages.
+	* \param settings Device behavior.
+	*
+	******************************************************************************/
+	SimulatedDevice(std::uint32_t id, const Settings& settings);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Stops the device.
+	*
+	*****************************************************************************/
+	~SimulatedDevice();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Start the I/O, responder and stream threads.
+	*
+	* \return false if the master side could not be used.
+	*
+	******************************************************************************/
+	bool start();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Stop all threads.
+	*
+	******************************************************************************/
+	void stop();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the device name clients open.
+	*
+	******************************************************************************/
+	const std::string& slaveName() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set the response latency.
+	*
+	* \param milliSeconds Latency.
+	*
+	******************************************************************************/
+	void setLatency(std::uint32_t milliSeconds);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send random bytes, without delimiter.
+	*
+	* \param size Nr of bytes.
+	*
+	******************************************************************************/
+	void injectNoise(std::size_t size);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send the first half of a stream message, without delimiter.
+	*
+	******************************************************************************/
+	void injectPartialFrame();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send nothing at all for a while. Commands received meanwhile are not answered.
+	*
+	* \param seconds Silence duration.
+	*
+	******************************************************************************/
+	void injectSilence(std::uint32_t seconds);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send stream messages back to back.
+	*
+	* \param count Nr of messages.
+	*
+	******************************************************************************/
+	void injectBurst(std::size_t count);
+
+
+	/**
+	* Device counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t commands;		///< Commands received.
+		std::uint64_t responses;	///< Responses sent.
+		std::uint64_t streamed;		///< Stream messages sent.
+		std::uint64_t dropped;		///< Writes that could not be queued.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the device counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Print the command receive latency histograms.
+	*
+	* \param out Stream to print on.
+	*
+	******************************************************************************/
+	void dumpLatency(std::ostream& out) const;
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	* Device limits
+	*/
+	enum Limits
+	{
+		WRITE_QUEUE_DEPTH = 4096,	///< Max nr of queued writes, bursts included.
+		POLL_TIMEOUT = 100,			///< Max time in milliseconds between stop checks.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Answer the commands popped from the queue.
+	*
+	* Each response is due its latency after the command was popped, so
+	* pipelined commands are answered back to back.
+	*
+	******************************************************************************/
+	void respond();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send the periodic data stream.
+	*
+	******************************************************************************/
+	void stream();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue data to be written, unless silent.
+	*
+	* \param data Data, including any delimiter.
+	*
+	* \return true if queued.
+	*
+	******************************************************************************/
+	bool send(const std::string& data);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the next stream message, including delimiter.
+	*
+	******************************************************************************/
+	std::string streamMessage();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true during an injected silence.
+	*
+	******************************************************************************/
+	bool isSilent() const;
+
+
+	std::uint32_t id_;								///< Port id.
+	Settings settings_;								///< Device behavior.
+	PseudoTerminal pty_;							///< Pseudo-terminal pair.
+	ThreadSafeQueue<std::string *> commands_;		///< Received commands.
+	TimeoutSerialThread port_;						///< I/O on the master side.
+	LatencyProbe probe_;							///< Command receive latency.
+	std::thread ioThread_;							///< Runs port_.
+	std::thread responder_;							///< Runs respond().
+	std::thread streamer_;							///< Runs stream().
+	std::atomic<std::uint32_t> latency_;			///< Response latency in milliseconds.
+	std::atomic<std::int64_t> silentUntil_;			///< End of injected silence, steady clock nanoseconds.
+	std::atomic<std::uint64_t> streamSeq_;			///< Sequence nr of the next stream message.
+	std::atomic<bool> stopRequested_;				///< Request to terminate the threads.
+	std::atomic<std::uint64_t> commandCount_;		///< Commands received.
+	std::atomic<std::uint64_t> responseCount_;		///< Responses sent.
+	std::atomic<std::uint64_t> streamCount_;		///< Stream messages sent.
+	std::atomic<std::uint64_t> dropCount_;			///< Writes that could not be queued.
+	std::mt19937 rng_;								///< Noise generator. Used under rngMutex_.
+	std::mutex rngMutex_;							///< Guards rng_.
+};
@@ -0,0 +1,213 @@
+/*****************************************************************************/
+/**
+* \file	sci_sim.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Simulated ventilator SCI ports on pseudo-terminals, for load and soak tests
+* of sci_test without hardware. Prints the device name of each port, then
+* reads fault injection commands from stdin:
+*
+*   noise [bytes] [port]    random bytes without delimiter. Default: 16 bytes.
+*   partial [port]          half a stream message.
+*   silence [s] [port]      no output at all. Default: MESSAGE_TIMEOUT + 10 s.
+*   burst [count] [port]    stream messages back to back. Default: 1000.
+*   latency <ms> [port]     change the response latency.
+*   stats                   print the port counters and command latency histograms.
+*   quit                    stop. So does end of input.
+*
+* Without a port, a command applies to all ports.
+*
+* Usage: sci_sim [-p ports] [-l latency ms] [-i stream period us] [-z stream size]
+*                [-d delimiter] [-f response file]
+*
+* The response file holds one "command<TAB>response" per line.
+*
+******************************************************************************/
+
+#include "SimulatedDevice.hpp"
+#include "TimeoutSerialThread.hpp"
+#include "GetOpt.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+static std::string parseDelimiter(const std::string& arg)
+{
+	if (arg == "cr")
+	{
+		return "\r";
+	}
+	if (arg == "lf")
+	{
+		return "\n";
+	}
+	if (arg == "crlf")
+	{
+		return "\r\n";
+	}
+	return arg;
+}
+
+static bool readResponses(const std::string& path, std::map<std::string, std::string>& responses)
+{
+	std::ifstream file(path.c_str());
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		const std::string::size_type tab = line.find('\t');
+		if (tab != std::string::npos)
+		{
+			responses[line.substr(0, tab)] = line.substr(tab + 1);
+		}
+	}
+	return true;
+}
+
+static void printStatistics(const std::vector<std::unique_ptr<SimulatedDevice>>& devices)
+{
+	for (std::size_t i = 0; i < devices.size(); ++i)
+	{
+		const SimulatedDevice::Statistics s = devices[i]->statistics();
+		std::cout << "port " << i << " " << devices[i]->slaveName()
+			<< ": commands " << s.commands << ", responses " << s.responses
+			<< ", streamed " << s.streamed << ", dropped " << s.dropped << std::endl;
+		devices[i]->dumpLatency(std::cout);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::size_t ports = 1;
+	SimulatedDevice::Settings settings;
+	settings.delim = "\r";
+	settings.latency = 20;
+	settings.streamPeriod = 0;
+	settings.streamSize = 64;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "p:l:i:z:d:f:")) != -1)
+	{
+		switch (c)
+		{
+		case 'p':
+			ports = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'l':
+			settings.latency = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'i':
+			settings.streamPeriod = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'z':
+			settings.streamSize = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'd':
+			settings.delim = parseDelimiter(g.optarg);
+			break;
+		case 'f':
+			if (!readResponses(g.optarg, settings.responses))
+			{
+				std::cerr << "Cannot read " << g.optarg << std::endl;
+				return 1;
+			}
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-p ports] [-l latency ms] [-i stream period us] [-z stream size]"
+				" [-d delimiter] [-f response file]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<std::unique_ptr<SimulatedDevice>> devices;
+	for (std::size_t i = 0; i < ports; ++i)
+	{
+		devices.push_back(std::unique_ptr<SimulatedDevice>(new SimulatedDevice(static_cast<std::uint32_t>(i), settings)));
+		if (!devices.back()->start())
+		{
+			std::cerr << "Cannot start port " << i << std::endl;
+			return 1;
+		}
+		std::cout << "port " << i << " " << devices.back()->slaveName() << std::endl;
+	}
+
+	std::string line;
+	while (std::getline(std::cin, line))
+	{
+		std::istringstream in(line);
+		std::string command;
+		in >> command;
+
+		// the optional port follows the optional argument
+		long arg = -1;
+		long port = -1;
+		in >> arg >> port;
+		if (command == "partial")
+		{
+			port = arg;
+		}
+		const std::size_t first = (port >= 0) ? static_cast<std::size_t>(port) : 0;
+		const std::size_t last = (port >= 0) ? std::min<std::size_t>(port + 1, devices.size()) : devices.size();
+
+		if (command == "quit")
+		{
+			break;
+		}
+		if (command == "stats")
+		{
+			printStatistics(devices);
+			continue;
+		}
+
+		for (std::size_t i = first; i < last; ++i)
+		{
+			if (command == "noise")
+			{
+				devices[i]->injectNoise(arg >= 0 ? arg : 16);
+			}
+			else if (command == "partial")
+			{
+				devices[i]->injectPartialFrame();
+			}
+			else if (command == "silence")
+			{
+				devices[i]->injectSilence(arg >= 0 ? arg : TimeoutSerialThread::MESSAGE_TIMEOUT + 10);
+			}
+			else if (command == "burst")
+			{
+				devices[i]->injectBurst(arg >= 0 ? arg : 1000);
+			}
+			else if (command == "latency" && arg >= 0)
+			{
+				devices[i]->setLatency(arg);
+			}
+			else if (!command.empty())
+			{
+				std::cerr << "Unknown command: " << line << std::endl;
+				break;
+			}
+		}
+	}
+
+	for (std::unique_ptr<SimulatedDevice>& device : devices)
+	{
+		device->stop();
+	}
+	printStatistics(devices);
+	return 0;
+}
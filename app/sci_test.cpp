@@ -1,8 +1,382 @@
+/*****************************************************************************/
+/**
+* \file	sci_test.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Sends SCI commands to one or more ventilators. Without devices it runs the
+* trace self-test.
+*
+* With -d it polls each device concurrently: the commands are sent round
+* robin, pipelined up to the window, at the target rate per device, until
+* the duration passed or on Ctrl-C. Then it prints per device the commands
+* per second, the send to response latency percentiles and the errors, and
+* with -i also every interval while running.
+*
+* With -d and -s it runs a scenario file on each device instead, see
+* Scenario.hpp. All devices share one io_service run by the main thread.
+* Then it prints per step the runs, failures and latency percentiles summed
+* over the devices, and per device the steps run and the messages received.
+*
+* Usage: sci_test [-# trace context] [-f trace config]
+*                 [-d device[:baudrate]]... [-b baudrate] [-c cmd,cmd,...] [-C command file]
+*                 [-r rate] [-t seconds] [-w window] [-T timeout ms] [-e delimiter] [-m] [-i seconds]
+*                 [-s scenario file]
+*   -d  Device to poll, repeated for more. Default baudrate: -b, 115200. A name with
+*       colons, e.g. under /dev/serial/by-path, is kept whole unless it ends in :digits.
+*   -c  Commands, comma separated. -C reads one per line.
+*   -r  Commands per second per device. Default: 10. 0 for as fast as the window allows.
+*   -t  Duration in seconds. Default: 0, until Ctrl-C.
+*   -w  Max nr of commands in flight per device. Default: 1.
+*   -T  Command timeout. Default: 1000 ms.
+*   -e  Delimiter: cr, lf, crlf or literal. Default: cr.
+*   -m  Responses start with their command; others are skipped, not matched in order.
+*   -i  Report interval in seconds. Default: 0, at the end only.
+*   -s  Run the scenario on each device. -c, -C, -r, -w, -T and -m do not apply.
+*
+******************************************************************************/
+
 #include "Trace.hpp"
 #include "GetOpt.hpp"
+#include "DevicePoller.hpp"
+#include "ScenarioRunner.hpp"
 
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+static volatile std::sig_atomic_t interrupted = 0;
+
+static void interrupt(int)
+{
+	interrupted = 1;
+}
+
+static std::string parseDelimiter(const std::string& arg)
+{
+	if (arg == "cr")
+	{
+		return "\r";
+	}
+	if (arg == "lf")
+	{
+		return "\n";
+	}
+	if (arg == "crlf")
+	{
+		return "\r\n";
+	}
+	return arg;
+}
+
+/**
+* Split "device[:baudrate]". Stable names such as /dev/serial/by-path/pci-0000:00:14.0-usb-0:1:1.0-port0
+* hold colons, so the suffix is a baudrate only if it is all digits, the part before it is a
+* path and the whole argument is no existing file.
+*
+* \param[out] baudrate The baudrate, 0 if none was given.
+*/
+static void parseDevice(const std::string& arg, std::string& device, std::uint32_t& baudrate)
+{
+	device = arg;
+	baudrate = 0;
+	const std::string::size_type colon = arg.rfind(':');
+	if (colon == std::string::npos || colon == 0 || arg[colon - 1] == '/'
+		|| colon + 1 == arg.size() || arg.size() - colon - 1 > 7
+		|| arg.find_first_not_of("0123456789", colon + 1) != std::string::npos
+		|| access(arg.c_str(), F_OK) == 0)
+	{
+		return;
+	}
+	device = arg.substr(0, colon);
+	baudrate = std::strtoul(arg.c_str() + colon + 1, nullptr, 10);
+}
+
+static void splitCommands(const std::string& list, std::vector<std::string>& commands)
+{
+	std::istringstream in(list);
+	std::string command;
+	while (std::getline(in, command, ','))
+	{
+		if (!command.empty())
+		{
+			commands.push_back(command);
+		}
+	}
+}
+
+static bool readCommands(const std::string& path, std::vector<std::string>& commands)
+{
+	std::ifstream file(path.c_str());
+	if (!file)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (!line.empty() && line[line.size() - 1] == '\r')
+		{
+			line.resize(line.size() - 1);
+		}
+		if (!line.empty() && line[0] != '#')
+		{
+			commands.push_back(line);
+		}
+	}
+	return true;
+}
+
+static void printReport(const std::vector<std::unique_ptr<DevicePoller>>& pollers)
+{
+	std::cout << std::left << std::setw(20) << "device" << std::right
+		<< std::setw(10) << "cmds/s" << std::setw(10) << "sent" << std::setw(10) << "answered"
+		<< std::setw(9) << "timeout" << std::setw(8) << "failed" << std::setw(6) << "late"
+		<< std::setw(8) << "unsol" << std::setw(6) << "lost"
+		<< std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << std::endl;
+
+	DevicePoller::Statistics total = DevicePoller::Statistics();
+	double rate = 0;
+	for (const std::unique_ptr<DevicePoller>& poller : pollers)
+	{
+		const DevicePoller::Statistics s = poller->statistics();
+		const LatencyHistogram& latency = poller->latency();
+		const double r = s.seconds > 0 ? s.answered / s.seconds : 0;
+		std::cout << std::left << std::setw(20) << poller->device() << std::right
+			<< std::fixed << std::setprecision(1) << std::setw(10) << r
+			<< std::setw(10) << s.sent << std::setw(10) << s.answered
+			<< std::setw(9) << s.timedOut << std::setw(8) << s.failed << std::setw(6) << s.late
+			<< std::setw(8) << s.unsolicited << std::setw(6) << s.disconnects
+			<< std::setprecision(3) << std::setw(10) << latency.percentile(50) / 1e6
+			<< std::setw(10) << latency.percentile(90) / 1e6 << std::setw(10) << latency.percentile(99) / 1e6
+			<< std::setw(10) << latency.max() / 1e6 << std::endl;
+
+		rate += r;
+		total.sent += s.sent;
+		total.answered += s.answered;
+		total.timedOut += s.timedOut;
+		total.failed += s.failed;
+		total.late += s.late;
+		total.unsolicited += s.unsolicited;
+		total.disconnects += s.disconnects;
+	}
+	if (pollers.size() > 1)
+	{
+		std::cout << std::left << std::setw(20) << "total" << std::right
+			<< std::fixed << std::setprecision(1) << std::setw(10) << rate
+			<< std::setw(10) << total.sent << std::setw(10) << total.answered
+			<< std::setw(9) << total.timedOut << std::setw(8) << total.failed << std::setw(6) << total.late
+			<< std::setw(8) << total.unsolicited << std::setw(6) << total.disconnects << std::endl;
+	}
+}
+
+/**
+* Polls all devices until the duration passed or Ctrl-C.
+*
+* \return Exit code, 1 if a device could not be opened or a command was not answered.
+*/
+static int poll(const std::vector<DevicePoller::Settings>& devices, std::uint32_t duration, std::uint32_t interval)
+{
+	std::vector<std::unique_ptr<DevicePoller>> pollers;
+	for (const DevicePoller::Settings& settings : devices)
+	{
+		pollers.push_back(std::unique_ptr<DevicePoller>(new DevicePoller(settings)));
+		std::string reason;
+		bool started = false;
+		try
+		{
+			started = pollers.back()->start();
+		}
+		catch (boost::system::system_error& e)
+		{
+			reason = std::string(": ") + e.what();
+		}
+		if (!started)
+		{
+			std::cerr << "Cannot open " << settings.device << reason << std::endl;
+			return 1;
+		}
+	}
+
+	std::signal(SIGINT, interrupt);
+	std::signal(SIGTERM, interrupt);
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	Clock::time_point report = start + std::chrono::seconds(interval);
+	while (!interrupted && (duration == 0 || Clock::now() - start < std::chrono::seconds(duration)))
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		if (interval > 0 && Clock::now() >= report)
+		{
+			report += std::chrono::seconds(interval);
+			printReport(pollers);
+		}
+	}
+
+	for (std::unique_ptr<DevicePoller>& poller : pollers)
+	{
+		poller->requestStop();
+	}
+	// a port takes up to its timer period to stop, so stop them all at once
+	std::vector<std::thread> stoppers;
+	for (std::unique_ptr<DevicePoller>& poller : pollers)
+	{
+		stoppers.push_back(std::thread(&DevicePoller::stop, poller.get()));
+	}
+	for (std::thread& stopper : stoppers)
+	{
+		stopper.join();
+	}
+	printReport(pollers);
+
+	for (std::unique_ptr<DevicePoller>& poller : pollers)
+	{
+		const DevicePoller::Statistics s = poller->statistics();
+		if (s.answered < s.sent)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void printScenarioReport(const Scenario& scenario,
+	const std::vector<std::unique_ptr<ScenarioStepStatistics>>& steps,
+	const std::vector<std::unique_ptr<ScenarioRunner>>& runners)
+{
+	std::cout << std::setw(6) << "line" << std::setw(10) << "runs" << std::setw(8) << "failed" << std::setw(8) << "skipped"
+		<< std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << "  step" << std::endl;
+	for (std::size_t i = 0; i < steps.size(); ++i)
+	{
+		const Scenario::Step& step = scenario.steps()[i];
+		if (step.kind == Scenario::stepEnd)
+		{
+			continue;
+		}
+		const ScenarioStepStatistics& s = *steps[i];
+		std::cout << std::setw(6) << step.line << std::setw(10) << s.runs << std::setw(8) << s.failed << std::setw(8) << s.skipped
+			<< std::fixed << std::setprecision(3) << std::setw(10) << s.latency.percentile(50) / 1e6
+			<< std::setw(10) << s.latency.percentile(99) / 1e6 << std::setw(10) << s.latency.max() / 1e6
+			<< "  " << step.text << std::endl;
+	}
 
+	std::cout << std::left << std::setw(20) << "device" << std::right << std::setw(10) << "steps" << std::setw(8) << "failed"
+		<< std::setw(10) << "responses" << std::setw(10) << "stream" << "  state" << std::endl;
+	for (const std::unique_ptr<ScenarioRunner>& runner : runners)
+	{
+		const ScenarioRunner::Statistics s = runner->statistics();
+		std::cout << std::left << std::setw(20) << runner->device() << std::right << std::setw(10) << s.steps
+			<< std::setw(8) << s.failed << std::setw(10) << s.responses << std::setw(10) << s.stream << "  "
+			<< (!s.error.empty() ? s.error : s.finished ? "finished" : runner->done() ? "stopped" : "running") << std::endl;
+	}
+}
+
+/**
+* Runs the scenario on all devices until it finished everywhere, the duration passed or Ctrl-C.
+*
+* \return Exit code, 1 if a device failed or a step timed out.
+*/
+static int runScenario(const Scenario& scenario, const std::vector<DevicePoller::Settings>& devices,
+	const std::string& delim, std::uint32_t duration, std::uint32_t interval)
+{
+	boost::asio::io_service io;
+	std::vector<std::unique_ptr<ScenarioStepStatistics>> steps;
+	for (std::size_t i = 0; i < scenario.steps().size(); ++i)
+	{
+		steps.push_back(std::unique_ptr<ScenarioStepStatistics>(new ScenarioStepStatistics));
+	}
+	std::vector<std::unique_ptr<ScenarioRunner>> runners;
+	for (const DevicePoller::Settings& settings : devices)
+	{
+		runners.push_back(std::unique_ptr<ScenarioRunner>(
+			new ScenarioRunner(io, scenario, steps, settings.device, settings.baudrate, delim)));
+		if (!runners.back()->start())
+		{
+			std::cerr << "Cannot open " << settings.device << ": " << runners.back()->statistics().error << std::endl;
+			return 1;
+		}
+	}
+
+	// one monitor on the loop stops the runners and prints the reports
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point start = Clock::now();
+	const Clock::time_point end = duration > 0 ? start + std::chrono::seconds(duration) : Clock::time_point::max();
+	Clock::time_point report = start + std::chrono::seconds(interval);
+	boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+	boost::asio::steady_timer monitor(io);
+	std::function<void()> stopAll = [&]()
+	{
+		for (std::unique_ptr<ScenarioRunner>& runner : runners)
+		{
+			runner->stop();
+		}
+		boost::system::error_code ignored;
+		signals.cancel(ignored);
+		monitor.cancel(ignored);
+	};
+	signals.async_wait([&](const boost::system::error_code& error, int)
+	{
+		if (!error)
+		{
+			stopAll();
+		}
+	});
+	std::function<void(const boost::system::error_code&)> check = [&](const boost::system::error_code& error)
+	{
+		if (error)
+		{
+			return;
+		}
+		const Clock::time_point now = Clock::now();
+		bool done = true;
+		for (std::unique_ptr<ScenarioRunner>& runner : runners)
+		{
+			done &= runner->done();
+		}
+		if (done || now >= end)
+		{
+			stopAll();
+			return;
+		}
+		if (interval > 0 && now >= report)
+		{
+			report += std::chrono::seconds(interval);
+			printScenarioReport(scenario, steps, runners);
+		}
+		monitor.expires_at(monitor.expires_at() + std::chrono::milliseconds(100));
+		monitor.async_wait(check);
+	};
+	monitor.expires_at(start + std::chrono::milliseconds(100));
+	monitor.async_wait(check);
+
+	io.run();
+	printScenarioReport(scenario, steps, runners);
+
+	for (const std::unique_ptr<ScenarioRunner>& runner : runners)
+	{
+		const ScenarioRunner::Statistics s = runner->statistics();
+		if (!s.error.empty() || s.failed > 0)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
 
 void test2()
 {
@@ -31,7 +405,18 @@ int main(int argc, char* argv[])
     std::string opt;
     GetOpt g;
     std::string configFile;
-    while ((c = g.getopt(argc, argv, "#:f:")) != -1)
+    std::vector<DevicePoller::Settings> devices;
+    std::vector<std::string> commands;
+    std::uint32_t baudrate = 115200;
+    std::string delim = "\r";
+    double rate = 10;
+    std::size_t window = 1;
+    std::uint32_t timeout = SciClient::DEFAULT_COMMAND_TIMEOUT;
+    bool match = false;
+    std::uint32_t duration = 0;
+    std::uint32_t interval = 0;
+    std::string scenarioFile;
+    while ((c = g.getopt(argc, argv, "#:f:d:b:c:C:r:t:w:T:e:mi:s:")) != -1)
     {        
         switch (c)
         {
@@ -41,6 +426,50 @@ int main(int argc, char* argv[])
         case 'f':
         	TRACE_READ_CONFIG_FILE("example", g.optarg);
         	break;
+        case 'd':
+            {
+                // the default baudrate is filled in after all options are read
+                DevicePoller::Settings settings = DevicePoller::Settings();
+                parseDevice(g.optarg, settings.device, settings.baudrate);
+                devices.push_back(settings);
+            }
+            break;
+        case 'b':
+            baudrate = std::strtoul(g.optarg, nullptr, 10);
+            break;
+        case 'c':
+            splitCommands(g.optarg, commands);
+            break;
+        case 'C':
+            if (!readCommands(g.optarg, commands)) {
+                std::cerr << "Cannot read " << g.optarg << std::endl;
+                exit(1);
+            }
+            break;
+        case 'r':
+            rate = std::max(std::strtod(g.optarg, nullptr), 0.0);
+            break;
+        case 't':
+            duration = std::strtoul(g.optarg, nullptr, 10);
+            break;
+        case 'w':
+            window = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+            break;
+        case 'T':
+            timeout = std::max<std::uint32_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+            break;
+        case 'e':
+            delim = parseDelimiter(g.optarg);
+            break;
+        case 'm':
+            match = true;
+            break;
+        case 'i':
+            interval = std::strtoul(g.optarg, nullptr, 10);
+            break;
+        case 's':
+            scenarioFile = g.optarg;
+            break;
         case '?':
         	if (g.optopt == 'c') {
                 std::cerr << "Option -`" << g.optopt << "' requires an argument." <<std::endl;
@@ -58,6 +487,41 @@ int main(int argc, char* argv[])
        }
 	}
 
+	if (!devices.empty() && !scenarioFile.empty())
+	{
+		Scenario scenario;
+		std::string error;
+		if (!scenario.load(scenarioFile, error))
+		{
+			std::cerr << scenarioFile << ": " << error << std::endl;
+			return 1;
+		}
+		for (DevicePoller::Settings& settings : devices)
+		{
+			settings.baudrate = settings.baudrate != 0 ? settings.baudrate : baudrate;
+		}
+		return runScenario(scenario, devices, delim, duration, interval);
+	}
+	if (!devices.empty())
+	{
+		if (commands.empty())
+		{
+			std::cerr << "No commands, see -c and -C." << std::endl;
+			return 1;
+		}
+		for (DevicePoller::Settings& settings : devices)
+		{
+			settings.baudrate = settings.baudrate != 0 ? settings.baudrate : baudrate;
+			settings.delim = delim;
+			settings.commands = commands;
+			settings.rate = rate;
+			settings.window = window;
+			settings.timeout = timeout;
+			settings.match = match;
+		}
+		return poll(devices, duration, interval);
+	}
+
 	TRACE_CREATE_CONTEXT("thread1", "tl");
 
 	test1();
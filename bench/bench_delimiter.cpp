@@ -0,0 +1,222 @@
+/*****************************************************************************/
+/**
+* \file	bench_delimiter.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Throughput of the DelimiterScanner kernels over synthetic SCI traffic,
+* fed in serial-read sized chunks the way TimeoutSerialThread does.
+* Every kernel is checked against a plain std::search over the whole stream;
+* the benchmark fails if any kernel finds a different set of messages.
+*
+* Usage: bench_delimiter [-m megabytes] [-c chunk size]
+*
+******************************************************************************/
+
+#include "DelimiterScanner.hpp"
+#include "GetOpt.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+
+/**
+* Messages found in a stream.
+*/
+struct Result
+{
+	std::uint64_t messages;	///< Nr of messages.
+	std::uint64_t checksum;	///< Sum of message offsets and sizes.
+	double seconds;			///< Time spent.
+};
+
+/**
+* Generate synthetic SCI traffic: responses of space separated numeric fields.
+* Multi-byte delimiters also get stray delimiter prefixes inside the messages.
+*/
+static std::string generate(std::size_t size, const std::string& delim)
+{
+	std::mt19937 rng(4711);
+	std::uniform_int_distribution<int> fields(1, 24);
+	std::uniform_int_distribution<int> digits(1, 6);
+	std::uniform_int_distribution<int> digit(0, 9);
+	std::uniform_int_distribution<int> stray(0, 7);
+
+	std::string data;
+	data.reserve(size + 256);
+	while (data.size() < size)
+	{
+		data += "RTIMS";
+		const int n = fields(rng);
+		for (int i = 0; i < n; ++i)
+		{
+			data += ' ';
+			const int d = digits(rng);
+			for (int j = 0; j < d; ++j)
+			{
+				data += static_cast<char>('0' + digit(rng));
+			}
+			if (delim.size() > 1 && stray(rng) == 0)
+			{
+				data.append(delim, 0, delim.size() - 1);
+			}
+		}
+		data += delim;
+	}
+	return data;
+}
+
+/**
+* Reference: search the whole stream at once.
+*/
+static Result reference(const std::string& data, const std::string& delim)
+{
+	Result r = Result();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::string::const_iterator p = data.begin();
+	for (;;)
+	{
+		std::string::const_iterator hit = std::search(p, data.end(), delim.begin(), delim.end());
+		if (hit == data.end())
+		{
+			break;
+		}
+		++r.messages;
+		r.checksum += (hit - data.begin()) + (hit - p);
+		p = hit + delim.size();
+	}
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return r;
+}
+
+/**
+* Feed the stream in chunks into a read buffer and extract messages like the
+* reader does. With rescan set, every chunk searches the unconsumed data from
+* its start with std::search instead of using the scanner.
+*/
+static Result feed(const std::string& data, const std::string& delim, std::size_t chunk,
+	DelimiterScanner::Kernel kernel, bool rescan)
+{
+	DelimiterScanner scanner(delim, kernel);
+	std::vector<char> buffer(chunk * 2 + 1024);
+	std::size_t size = 0;
+	std::size_t consumed = 0;	// offset of buffer[0] in the stream
+	Result r = Result();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (std::size_t offset = 0; offset < data.size(); offset += chunk)
+	{
+		const std::size_t n = std::min(chunk, data.size() - offset);
+		if (buffer.size() - size < n)
+		{
+			buffer.resize(size + n);
+		}
+		std::memcpy(&buffer[size], data.data() + offset, n);
+		size += n;
+
+		std::size_t begin = 0;
+		for (;;)
+		{
+			std::size_t pos;
+			if (rescan)
+			{
+				const char *hit = std::search(&buffer[begin], &buffer[0] + size, delim.begin(), delim.end());
+				pos = (hit == &buffer[0] + size) ? DelimiterScanner::npos : hit - &buffer[begin];
+			}
+			else
+			{
+				pos = scanner.find(&buffer[begin], size - begin);
+			}
+			if (pos == DelimiterScanner::npos)
+			{
+				break;
+			}
+			++r.messages;
+			r.checksum += (consumed + begin + pos) + pos;
+			begin += pos + delim.size();
+		}
+
+		std::memmove(&buffer[0], &buffer[begin], size - begin);
+		size -= begin;
+		consumed += begin;
+	}
+	r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return r;
+}
+
+static void report(const char *name, const Result& r, std::size_t bytes)
+{
+	std::cout << "  " << std::left << std::setw(10) << name << std::right
+		<< std::setw(10) << std::fixed << std::setprecision(1) << bytes / r.seconds / 1e6 << " MB/s"
+		<< std::setw(10) << std::setprecision(2) << r.seconds * 1e9 / std::max<std::uint64_t>(r.messages, 1) << " ns/msg"
+		<< std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	std::size_t megabytes = 64;
+	std::size_t chunk = 256;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "m:c:")) != -1)
+	{
+		switch (c)
+		{
+		case 'm':
+			megabytes = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'c':
+			chunk = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-m megabytes] [-c chunk size]" << std::endl;
+			return 1;
+		}
+	}
+
+	const std::string delimiters[] = { "\r", "\r\n", std::string("\r\n\0\n", 4) };
+	const DelimiterScanner::Kernel kernels[] = { DelimiterScanner::kernelMemchr, DelimiterScanner::kernelSse2, DelimiterScanner::kernelAvx2 };
+	bool ok = true;
+
+	std::cout << "auto kernel: " << DelimiterScanner::kernelName(DelimiterScanner("\r").kernel())
+		<< ", " << megabytes << " MB, " << chunk << " byte reads" << std::endl;
+
+	for (const std::string& delim : delimiters)
+	{
+		const std::string data = generate(megabytes << 20, delim);
+		const Result expected = reference(data, delim);
+		std::cout << delim.size() << "-byte delimiter, " << expected.messages << " messages" << std::endl;
+
+		const Result rescan = feed(data, delim, chunk, DelimiterScanner::kernelMemchr, true);
+		report("rescan", rescan, data.size());
+		ok = ok && rescan.messages == expected.messages && rescan.checksum == expected.checksum;
+
+		for (DelimiterScanner::Kernel kernel : kernels)
+		{
+			if (!DelimiterScanner::isSupported(kernel))
+			{
+				std::cout << "  " << DelimiterScanner::kernelName(kernel) << " not supported" << std::endl;
+				continue;
+			}
+			const Result r = feed(data, delim, chunk, kernel, false);
+			report(DelimiterScanner::kernelName(kernel), r, data.size());
+			if (r.messages != expected.messages || r.checksum != expected.checksum)
+			{
+				std::cout << "  MISMATCH: " << r.messages << " messages, expected " << expected.messages << std::endl;
+				ok = false;
+			}
+		}
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+/*****************************************************************************/
+/**
+* \file	bench_pool.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Scaling of message processing on the work-stealing pool.
+*
+* Simulated ports each deliver numbered SCI responses, interleaved as they
+* would arrive. Every response is posted to the parse strand of its port,
+* which parses it into batches; every full batch is posted to the store
+* strand of the port, which appends it to a time-series store of its own.
+* Ports and the two stages run in parallel, the responses of a port in
+* order. Runs with 1, 2, 4, ... workers up to the max and reports the rate
+* against one worker. Fails if a port sees a response out of order or the
+* stores do not hold every row, or if on a single worker a strand that keeps
+* feeding itself delays the task of another strand by more than a batch.
+*
+* Usage: bench_pool [-p ports] [-n responses] [-w max workers] [-c first cpu] [-D dir]
+*   -p  Nr of ports. Default: 64.
+*   -n  Responses per port. Default: 5000.
+*   -w  Max nr of workers. Default: nr of CPUs, at least 4.
+*   -c  Pin worker i to CPU c + i. Default: no pinning.
+*   -D  Store directory, kept. Default: a temporary one, removed.
+*
+******************************************************************************/
+
+#include "WorkStealingPool.hpp"
+#include "SciParser.hpp"
+#include "TimeSeriesStore.hpp"
+#include "GetOpt.hpp"
+
+#include <boost/filesystem.hpp>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* The stages of one simulated port.
+*/
+struct Port
+{
+	Port(WorkStealingPool& pool, const std::string& root) :
+		parser(input, batches),
+		store(root, batches, 4096),
+		parseStrand(pool),
+		storeStrand(pool),
+		last(-1),
+		outOfOrder(0)
+	{
+	}
+
+	ThreadSafeQueue<std::string *> input;	///< Unused, the parser is called directly.
+	ThreadSafeQueue<SciBatch *> batches;	///< Batches posted by the parser.
+	SciParser parser;						///< Parse stage.
+	TimeSeriesStore store;					///< Store stage.
+	Strand parseStrand;						///< Orders the responses.
+	Strand storeStrand;						///< Orders the batches.
+	std::int64_t last;						///< Last sequence number parsed.
+	std::size_t outOfOrder;					///< Responses parsed out of order.
+};
+
+/**
+* Post the batches the parser completed to the store strand. Parse strand only.
+*/
+static void forward(Port& port)
+{
+	SciBatch *batch = nullptr;
+	while (port.batches.tryPop(batch))
+	{
+		port.storeStrand.post([&port, batch]()
+		{
+			port.store.append(*batch);
+			delete batch;
+		});
+	}
+}
+
+/**
+* Processes all responses with the given nr of workers.
+*
+* \return Responses per second, 0 if one was lost or reordered.
+*/
+static double run(std::size_t workers, int firstCpu, const std::vector<std::string>& responses,
+	std::size_t ports, const std::string& root, WorkStealingPool::Statistics& statistics)
+{
+	boost::filesystem::remove_all(root);
+	boost::filesystem::create_directories(root);
+	WorkStealingPool pool(workers, firstCpu);
+	std::vector<std::unique_ptr<Port>> stages;
+	for (std::size_t p = 0; p < ports; ++p)
+	{
+		stages.push_back(std::unique_ptr<Port>(new Port(pool, root + "/port" + std::to_string(p))));
+	}
+
+	const Clock::time_point start = Clock::now();
+	for (std::size_t i = 0; i < responses.size(); ++i)
+	{
+		for (std::size_t p = 0; p < ports; ++p)
+		{
+			Port& port = *stages[p];
+			const std::string *response = &responses[i];
+			const std::int64_t seq = static_cast<std::int64_t>(i);
+			port.parseStrand.post([&port, response, seq]()
+			{
+				if (seq <= port.last)
+				{
+					++port.outOfOrder;
+				}
+				port.last = seq;
+				port.parser.parse(*response, std::chrono::duration_cast<std::chrono::nanoseconds>(
+					Clock::now().time_since_epoch()).count());
+				forward(port);
+			});
+		}
+	}
+	for (std::unique_ptr<Port>& port : stages)
+	{
+		Port *p = port.get();
+		p->parseStrand.post([p]()
+		{
+			p->parser.flush();
+			forward(*p);
+		});
+	}
+	pool.stop();
+	const double seconds = std::max<double>(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+	statistics = pool.statistics();
+
+	bool success = true;
+	for (std::unique_ptr<Port>& port : stages)
+	{
+		success &= port->outOfOrder == 0 && port->store.statistics().rows == responses.size();
+	}
+	return success ? responses.size() * ports / seconds : 0;
+}
+
+/**
+* One worker, strand b posted one task, strand a feeding itself count tasks.
+*
+* \return Nr of tasks of a run before the task of b, at most BATCH if a
+* yields the worker.
+*/
+static std::size_t fairness(std::size_t count)
+{
+	WorkStealingPool pool(1);
+	Strand a(pool);
+	Strand b(pool);
+	std::atomic<std::size_t> done(0);
+	std::atomic<std::size_t> before(count);
+
+	std::function<void()> feed;
+	feed = [&]()
+	{
+		if (++done < count)
+		{
+			a.post(feed);
+		}
+	};
+	b.post([&]() { before = done.load(); });
+	a.post(feed);
+	pool.stop();
+	return before;
+}
+
+int main(int argc, char *argv[])
+{
+	std::size_t ports = 64;
+	std::size_t count = 5000;
+	std::size_t maxWorkers = std::max<unsigned>(std::thread::hardware_concurrency(), 4);
+	int firstCpu = -1;
+	std::string dir;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "p:n:w:c:D:")) != -1)
+	{
+		switch (c)
+		{
+		case 'p':
+			ports = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'n':
+			count = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'w':
+			maxWorkers = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'c':
+			firstCpu = std::atoi(g.optarg);
+			break;
+		case 'D':
+			dir = g.optarg;
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-p ports] [-n responses] [-w max workers] [-c first cpu] [-D dir]" << std::endl;
+			return 1;
+		}
+	}
+
+	const bool temporary = dir.empty();
+	if (temporary)
+	{
+		dir = "/tmp/bench_pool." + std::to_string(getpid());
+	}
+
+	// a waveform response: sequence number, pressure, flow, volume
+	std::vector<std::string> responses;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		responses.push_back("WAVE " + std::to_string(i) + " " + std::to_string(20 + i % 17) + "." + std::to_string(i % 10)
+			+ " " + std::to_string(i % 120) + ".25 " + std::to_string(i % 500));
+	}
+
+	std::cout << ports << " ports, " << count << " responses each, " << std::thread::hardware_concurrency() << " cpus" << std::endl
+		<< std::setw(8) << "workers" << std::setw(14) << "responses/s" << std::setw(10) << "speedup"
+		<< std::setw(10) << "stolen" << std::setw(10) << "parked" << std::endl;
+
+	bool success = true;
+	double single = 0;
+	for (std::size_t workers = 1; workers <= maxWorkers; workers *= 2)
+	{
+		WorkStealingPool::Statistics s;
+		const double rate = run(workers, firstCpu, responses, ports, dir, s);
+		if (workers == 1)
+		{
+			single = rate;
+		}
+		std::cout << std::fixed << std::setprecision(0)
+			<< std::setw(8) << workers << std::setw(14) << rate
+			<< std::setprecision(2) << std::setw(10) << (single > 0 ? rate / single : 0)
+			<< std::setw(10) << s.stolen << std::setw(10) << s.parked << std::endl;
+		success &= rate > 0 && s.failed == 0;
+	}
+
+	if (temporary)
+	{
+		boost::filesystem::remove_all(dir);
+	}
+	if (!success)
+	{
+		std::cerr << "responses lost or reordered" << std::endl;
+		return 1;
+	}
+
+	const std::size_t before = fairness(100000);
+	std::cout << "fairness: other strand ran after " << before << " tasks of a busy one" << std::endl;
+	if (before > Strand::BATCH)
+	{
+		std::cerr << "a busy strand starved another one" << std::endl;
+		return 1;
+	}
+	return 0;
+}
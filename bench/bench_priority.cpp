@@ -0,0 +1,180 @@
+/*****************************************************************************/
+/**
+* \file	bench_priority.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Alarm latency behind saturating bulk traffic.
+*
+* A bulk producer pushes readings as fast as the bounded queue takes them,
+* an alarm producer pushes an alarm at a fixed period, and one consumer
+* spends a fixed time per element, so the queue stays full. The alarm
+* latency, push to pop, is measured through a FIFO ThreadSafeQueue and
+* through a two-lane PriorityLaneQueue, with and without starvation guard.
+*
+* Usage: bench_priority [-t seconds] [-c capacity] [-w work ns] [-a alarm period us] [-g guard]
+*   -t  Duration per queue. Default: 2.
+*   -c  Queue capacity, per lane for the lane queue. Default: 4096.
+*   -w  Consumer time per element in nanoseconds. Default: 1000.
+*   -a  Alarm period in microseconds. Default: 1000.
+*   -g  Starvation guard of the guarded run. Default: 64.
+*
+******************************************************************************/
+
+#include "ThreadSafeQueue.hpp"
+#include "PriorityLaneQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include "GetOpt.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* Queued element
+*/
+struct Message
+{
+	std::int64_t sent;		///< Push time, steady clock nanoseconds.
+	bool alarm;				///< True for an alarm, else a reading.
+};
+
+/**
+* Benchmark settings
+*/
+struct Settings
+{
+	double seconds;			///< Duration per queue.
+	std::size_t capacity;	///< Queue capacity.
+	std::int64_t work;		///< Consumer time per element in nanoseconds.
+	std::int64_t period;	///< Alarm period in microseconds.
+	std::size_t guard;		///< Starvation guard.
+};
+
+static std::int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/**
+* Runs the producers and the consumer on a queue and prints the alarm latency.
+*
+* \return false if no alarm got through.
+*/
+static bool run(const std::string& name, MessageQueue<Message>& queue, const Settings& settings)
+{
+	std::atomic<bool> stop(false);
+	LatencyHistogram alarms;
+	std::uint64_t readings = 0;
+
+	std::thread bulk([&queue, &stop]()
+	{
+		while (!stop)
+		{
+			queue.push(Message{ nowNs(), false });
+		}
+	});
+	std::thread alarm([&queue, &stop, &settings]()
+	{
+		Clock::time_point next = Clock::now();
+		while (!stop)
+		{
+			next += std::chrono::microseconds(settings.period);
+			std::this_thread::sleep_until(next);
+			queue.push(Message{ nowNs(), true });
+		}
+	});
+
+	const std::int64_t end = nowNs() + static_cast<std::int64_t>(settings.seconds * 1e9);
+	Message message;
+	while (nowNs() < end)
+	{
+		if (!queue.waitPop(message, 10))
+		{
+			continue;
+		}
+		const std::int64_t popped = nowNs();
+		if (message.alarm)
+		{
+			alarms.record(popped - message.sent);
+		}
+		else
+		{
+			++readings;
+		}
+		while (nowNs() - popped < settings.work)
+		{
+		}
+	}
+
+	// drain so blocked producers see the stop
+	stop = true;
+	while (queue.waitPop(message, 10) || !queue.empty())
+	{
+	}
+	bulk.join();
+	alarm.join();
+
+	std::cout << std::fixed << std::setprecision(0) << name << ": " << readings / settings.seconds << " readings/s" << std::endl;
+	alarms.print(std::cout, "  alarm latency");
+	return alarms.count() > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	Settings settings = { 2, 4096, 1000, 1000, 64 };
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "t:c:w:a:g:")) != -1)
+	{
+		switch (c)
+		{
+		case 't':
+			settings.seconds = std::max(std::strtod(g.optarg, nullptr), 0.1);
+			break;
+		case 'c':
+			settings.capacity = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'w':
+			settings.work = std::strtol(g.optarg, nullptr, 10);
+			break;
+		case 'a':
+			settings.period = std::max<long>(std::strtol(g.optarg, nullptr, 10), 1);
+			break;
+		case 'g':
+			settings.guard = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-t seconds] [-c capacity] [-w work ns] [-a alarm period us] [-g guard]" << std::endl;
+			return 1;
+		}
+	}
+
+	const PriorityLaneQueue<Message>::Classifier classify = [](const Message& m) -> std::size_t { return m.alarm ? 0 : 1; };
+	bool success = true;
+
+	ThreadSafeQueue<Message> fifo;
+	fifo.setCapacity(settings.capacity);
+	success &= run("fifo", fifo, settings);
+
+	PriorityLaneQueue<Message> lanes(2, classify, settings.capacity);
+	success &= run("lanes", lanes, settings);
+
+	PriorityLaneQueue<Message> guarded(2, classify, settings.capacity);
+	guarded.setStarvationGuard(settings.guard);
+	success &= run("lanes, guard " + std::to_string(settings.guard), guarded, settings);
+
+	return success ? 0 : 1;
+}
@@ -0,0 +1,360 @@
+/*****************************************************************************/
+/**
+* \file	bench_queue.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Contention of the fan-in queues.
+*
+* Producers push numbered elements into one queue while consumers pop them
+* with the timed waitPop(), for every combination of 1, 2, 4, 8 and 16
+* producers and consumers up to the given max. Compares the mutex based
+* ThreadSafeQueue with the lock-free MpmcQueue, both bounded to the same
+* capacity. Fails if an element is lost or duplicated.
+*
+* Then passes payloads from one producer to one consumer through an
+* unbounded ThreadSafeQueue: a std::string copied in, moved in and emplaced,
+* a std::unique_ptr to one, and a string popped through the allocating
+* shared_ptr overload.
+*
+* Last measures the wake-up latency of a consumer blocked in waitPop() for
+* each wait strategy: the producer sleeps 20-200 us, then pushes its time.
+* The same for an EventQueue waited on with epoll, once with single pushes
+* and once with bursts of 16, counting eventfd writes and epoll wake-ups.
+*
+* Usage: bench_queue [-n elements] [-m max threads] [-c capacity] [-s size] [-w wake-ups]
+*   -n  Elements per run. Default: 200000.
+*   -m  Max producers and consumers. Default: 16.
+*   -c  Queue capacity. Default: 1024.
+*   -s  String payload size. Default: 256.
+*   -w  Wake-ups per strategy. Default: 2000.
+*
+******************************************************************************/
+
+#include "ThreadSafeQueue.hpp"
+#include "MpmcQueue.hpp"
+#include "SpscQueue.hpp"
+#include "EventQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include "GetOpt.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* Pushes and pops elements through a queue with the given nr of threads.
+*
+* \return Elements per second, 0 if an element was lost or duplicated.
+*/
+static double run(MessageQueue<std::uint64_t>& queue, std::size_t producers, std::size_t consumers, std::size_t elements)
+{
+	std::atomic<std::size_t> consumed(0);
+	std::atomic<std::uint64_t> sum(0);
+	std::vector<std::thread> threads;
+
+	const Clock::time_point start = Clock::now();
+	for (std::size_t p = 0; p < producers; ++p)
+	{
+		threads.push_back(std::thread([&queue, p, producers, elements]()
+		{
+			for (std::size_t i = p; i < elements; i += producers)
+			{
+				queue.push(i);
+			}
+		}));
+	}
+	for (std::size_t c = 0; c < consumers; ++c)
+	{
+		threads.push_back(std::thread([&queue, &consumed, &sum, elements]()
+		{
+			std::uint64_t local = 0;
+			std::uint64_t value = 0;
+			while (consumed.load(std::memory_order_relaxed) < elements)
+			{
+				if (queue.waitPop(value, 1))
+				{
+					local += value;
+					consumed.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+			sum += local;
+		}));
+	}
+	for (std::thread& t : threads)
+	{
+		t.join();
+	}
+	const double seconds = std::max<double>(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+
+	const std::uint64_t expected = static_cast<std::uint64_t>(elements) * (elements - 1) / 2;
+	return (consumed == elements && sum == expected && queue.empty()) ? elements / seconds : 0;
+}
+
+/**
+* Passes elements made by push from one producer to one consumer, popped by pop.
+*
+* \return Elements per second, 0 if an element was lost.
+*/
+template <typename T, typename Push, typename Pop>
+static double runPayload(Push push, Pop pop, std::size_t elements)
+{
+	ThreadSafeQueue<T> queue;
+	const Clock::time_point start = Clock::now();
+	std::thread producer([&queue, &push, elements]()
+	{
+		for (std::size_t i = 0; i < elements; ++i)
+		{
+			push(queue);
+		}
+	});
+
+	std::size_t bytes = 0;
+	std::size_t consumed = 0;
+	for (; consumed < elements; ++consumed)
+	{
+		const std::size_t size = pop(queue);
+		if (size == 0)
+		{
+			break;
+		}
+		bytes += size;
+	}
+	producer.join();
+	const double seconds = std::max<double>(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+	return (consumed == elements && bytes > 0) ? elements / seconds : 0;
+}
+
+/**
+* Wakes a consumer blocked in waitPop() with elements pushed at random
+* intervals, and records the time from push to pop.
+*
+* \return false if an element was lost.
+*/
+template <typename Queue>
+static bool runWakeup(Queue& queue, const WaitStrategy& strategy, std::size_t wakeups, LatencyHistogram& latency)
+{
+	queue.setWaitStrategy(strategy);
+	std::thread producer([&queue, wakeups]()
+	{
+		std::minstd_rand rng(1);
+		std::uniform_int_distribution<int> pause(20, 200);
+		for (std::size_t i = 0; i < wakeups; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(pause(rng)));
+			queue.push(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+		}
+	});
+
+	std::size_t consumed = 0;
+	std::int64_t pushed = 0;
+	const Clock::time_point giveUp = Clock::now() + std::chrono::seconds(10) + std::chrono::milliseconds(wakeups);
+	while (consumed < wakeups && Clock::now() < giveUp)
+	{
+		if (queue.waitPop(pushed, 100))
+		{
+			latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count() - pushed);
+			++consumed;
+		}
+	}
+	producer.join();
+	return consumed == wakeups;
+}
+
+/**
+* As runWakeup(), but pushes bursts into an EventQueue and waits for them
+* with edge-triggered epoll.
+*
+* \param[out] wakes Nr of epoll_wait() calls that returned the queue.
+*
+* \return false if an element was lost.
+*/
+static bool runEventWakeup(EventQueue<std::int64_t>& queue, std::size_t wakeups, std::size_t burst,
+	LatencyHistogram& latency, std::size_t& wakes)
+{
+	const int poller = ::epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event event = epoll_event();
+	event.events = EPOLLIN | EPOLLET;
+	if (poller < 0 || ::epoll_ctl(poller, EPOLL_CTL_ADD, queue.fd(), &event) != 0)
+	{
+		return false;
+	}
+
+	std::thread producer([&queue, wakeups, burst]()
+	{
+		std::minstd_rand rng(1);
+		std::uniform_int_distribution<int> pause(20, 200);
+		for (std::size_t i = 0; i < wakeups; ++i)
+		{
+			std::this_thread::sleep_for(std::chrono::microseconds(pause(rng)));
+			for (std::size_t j = 0; j < burst; ++j)
+			{
+				queue.push(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+			}
+		}
+	});
+
+	std::size_t consumed = 0;
+	std::vector<std::int64_t> pushed;
+	const Clock::time_point giveUp = Clock::now() + std::chrono::seconds(10) + std::chrono::milliseconds(wakeups);
+	wakes = 0;
+	while (consumed < wakeups * burst && Clock::now() < giveUp)
+	{
+		if (::epoll_wait(poller, &event, 1, 100) == 1)
+		{
+			++wakes;
+			pushed.clear();
+			queue.drain(pushed);
+			const std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+			for (std::int64_t t : pushed)
+			{
+				latency.record(now - t);
+			}
+			consumed += pushed.size();
+		}
+	}
+	producer.join();
+	::close(poller);
+	return consumed == wakeups * burst;
+}
+
+int main(int argc, char *argv[])
+{
+	std::size_t elements = 200000;
+	std::size_t maxThreads = 16;
+	std::size_t capacity = 1024;
+	std::size_t size = 256;
+	std::size_t wakeups = 2000;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "n:m:c:s:w:")) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			elements = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'm':
+			maxThreads = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'c':
+			capacity = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 2);
+			break;
+		case 's':
+			size = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'w':
+			wakeups = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-n elements] [-m max threads] [-c capacity] [-s size] [-w wake-ups]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::cout << elements << " elements per run, capacity " << capacity << ", "
+		<< std::thread::hardware_concurrency() << " cpus, Melements/s" << std::endl
+		<< std::setw(10) << "producers" << std::setw(10) << "consumers"
+		<< std::setw(16) << "ThreadSafeQueue" << std::setw(12) << "MpmcQueue" << std::setw(10) << "ratio" << std::endl;
+
+	bool success = true;
+	for (std::size_t producers = 1; producers <= maxThreads; producers *= 2)
+	{
+		for (std::size_t consumers = 1; consumers <= maxThreads; consumers *= 2)
+		{
+			ThreadSafeQueue<std::uint64_t> locked;
+			locked.setCapacity(capacity);
+			const double lockedRate = run(locked, producers, consumers, elements);
+
+			MpmcQueue<std::uint64_t> lockFree(capacity);
+			const double lockFreeRate = run(lockFree, producers, consumers, elements);
+
+			std::cout << std::fixed << std::setprecision(2)
+				<< std::setw(10) << producers << std::setw(10) << consumers
+				<< std::setw(16) << lockedRate / 1e6 << std::setw(12) << lockFreeRate / 1e6
+				<< std::setw(10) << (lockedRate > 0 ? lockFreeRate / lockedRate : 0) << std::endl;
+			success &= lockedRate > 0 && lockFreeRate > 0;
+		}
+	}
+
+	// payloads, 1 producer, 1 consumer
+	typedef std::unique_ptr<std::string> StringPtr;
+	const std::string payload(size, 'x');
+	const auto popString = [](ThreadSafeQueue<std::string>& q) -> std::size_t
+	{
+		std::string s;
+		return q.waitPop(s, 1000) ? s.size() : 0;
+	};
+	const double rates[] =
+	{
+		runPayload<std::string>([&payload](ThreadSafeQueue<std::string>& q) { q.push(payload); }, popString, elements),
+		runPayload<std::string>([&payload](ThreadSafeQueue<std::string>& q) { std::string s(payload); q.push(std::move(s)); }, popString, elements),
+		runPayload<std::string>([size](ThreadSafeQueue<std::string>& q) { q.emplace(size, 'x'); }, popString, elements),
+		runPayload<StringPtr>([&payload](ThreadSafeQueue<StringPtr>& q) { q.push(StringPtr(new std::string(payload))); },
+			[](ThreadSafeQueue<StringPtr>& q) -> std::size_t { StringPtr s; return q.waitPop(s, 1000) ? s->size() : 0; }, elements),
+		runPayload<std::string>([&payload](ThreadSafeQueue<std::string>& q) { std::string s(payload); q.push(std::move(s)); },
+			[](ThreadSafeQueue<std::string>& q) -> std::size_t { return q.waitPop()->size(); }, elements),
+	};
+	const char *names[] = { "string copied", "string moved", "string emplaced", "unique_ptr", "shared_ptr pop" };
+
+	std::cout << std::endl << "payload " << size << " bytes, 1 producer, 1 consumer, Melements/s" << std::endl;
+	for (std::size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i)
+	{
+		std::cout << std::setw(26) << names[i] << std::setw(10) << rates[i] / 1e6 << std::endl;
+		success &= rates[i] > 0;
+	}
+
+	// wake-up latency, 1 producer, 1 consumer
+	const WaitStrategy strategies[] =
+	{
+		WaitStrategy::blocking(), WaitStrategy::spin(), WaitStrategy::spinYieldPark(), WaitStrategy::busyPoll()
+	};
+	std::cout << std::endl << "wake-up latency, " << wakeups << " wake-ups, push after 20-200 us" << std::endl;
+	for (const WaitStrategy& strategy : strategies)
+	{
+		LatencyHistogram tsq, spsc, mpmc;
+		ThreadSafeQueue<std::int64_t> locked;
+		SpscQueue<std::int64_t> ring(capacity);
+		MpmcQueue<std::int64_t> lockFree(capacity);
+		success &= runWakeup(locked, strategy, wakeups, tsq);
+		success &= runWakeup(ring, strategy, wakeups, spsc);
+		success &= runWakeup(lockFree, strategy, wakeups, mpmc);
+		tsq.print(std::cout, std::string("ThreadSafeQueue ") + strategy.name());
+		spsc.print(std::cout, std::string("SpscQueue ") + strategy.name());
+		mpmc.print(std::cout, std::string("MpmcQueue ") + strategy.name());
+	}
+
+	const std::size_t bursts[] = { 1, 16 };
+	for (std::size_t burst : bursts)
+	{
+		LatencyHistogram latency;
+		EventQueue<std::int64_t> queue;
+		std::size_t wakes = 0;
+		success &= runEventWakeup(queue, wakeups, burst, latency, wakes);
+		const EventQueue<std::int64_t>::Statistics s = queue.statistics();
+		latency.print(std::cout, "EventQueue epoll, burst " + std::to_string(burst));
+		std::cout << "  pushed " << s.pushed << ", eventfd writes " << s.notified << ", epoll wake-ups " << wakes << std::endl;
+	}
+
+	if (!success)
+	{
+		std::cerr << "elements lost or duplicated" << std::endl;
+		return 1;
+	}
+	return 0;
+}
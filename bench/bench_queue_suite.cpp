@@ -0,0 +1,517 @@
+/*****************************************************************************/
+/**
+* \file	bench_queue_suite.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Matrix of all queue implementations, to choose the queue of a pipeline stage.
+*
+* Runs every combination of
+*   queue      tsq (ThreadSafeQueue), spsc (SpscQueue, 1 producer and 1
+*              consumer only), mpmc (MpmcQueue), lanes (PriorityLaneQueue,
+*              one lane) and event (EventQueue), all bounded to the same
+*              capacity with a blocking producer,
+*   api        single: push() and waitPop(); bulk: pushBulk() and
+*              waitPopBulk() of up to the burst size. Steady bulk pushes
+*              one element per period, so only max and burst push groups,
+*   payload    string* (allocated by the producer, deleted by the consumer),
+*              string (moved in and out) and buffer (a 4 KB struct, copied),
+*   pattern    max (no pacing), steady (evenly spaced at the rate) and burst
+*              (bursts back to back, at the same mean rate),
+*   threads    1, 2, 4, ... producers and consumers up to the max.
+*
+* Reports throughput, push to pop latency percentiles and the voluntary and
+* involuntary context switches of the process during the run (getrusage).
+* Fails if an element is lost: the consumers stop once the producers are
+* done and the queue is empty, whether they got every element or not.
+*
+* Usage: bench_queue_suite [-n elements] [-m max threads] [-c capacity] [-r rate] [-b burst]
+*                          [-s size] [-q queues] [-a apis] [-l payloads] [-t patterns] [-o csv]
+*   -n  Elements per run. Default: 20000.
+*   -m  Max producers and consumers. Default: 4.
+*   -c  Queue capacity. Default: 1024.
+*   -r  Elements per second of the steady and burst patterns. Default: 200000.
+*   -b  Burst size, also the bulk size. Default: 64.
+*   -s  String payload size, at least 8. Default: 64.
+*   -q  Comma separated queues to run. Default: all.
+*   -a  Comma separated apis. Default: all.
+*   -l  Comma separated payloads. Default: all.
+*   -t  Comma separated patterns. Default: all.
+*   -o  Also write the results to this CSV file, - for stdout instead of the table.
+*
+******************************************************************************/
+
+#include "ThreadSafeQueue.hpp"
+#include "SpscQueue.hpp"
+#include "MpmcQueue.hpp"
+#include "PriorityLaneQueue.hpp"
+#include "EventQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include "GetOpt.hpp"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* Settings of the suite.
+*/
+struct Settings
+{
+	std::size_t elements;	///< Elements per run.
+	std::size_t capacity;	///< Queue capacity.
+	double rate;			///< Elements per second, paced patterns.
+	std::size_t burst;		///< Burst and bulk size.
+	std::size_t size;		///< String payload size.
+};
+
+/**
+* One run of the matrix.
+*/
+struct Run
+{
+	std::string queue;		///< Queue name.
+	std::string api;		///< single or bulk.
+	std::string payload;	///< Payload name.
+	std::string pattern;	///< max, steady or burst.
+	std::size_t producers;	///< Nr of producer threads.
+	std::size_t consumers;	///< Nr of consumer threads.
+};
+
+/**
+* Outcome of a run.
+*/
+struct Result
+{
+	double seconds;				///< First push to last pop.
+	std::size_t consumed;		///< Elements popped.
+	std::uint64_t p50;			///< Median latency, ns.
+	std::uint64_t p99;			///< 99th percentile latency, ns.
+	std::uint64_t max;			///< Max latency, ns.
+	long voluntary;				///< Voluntary context switches.
+	long involuntary;			///< Involuntary context switches.
+};
+
+/**
+* 4 KB payload.
+*/
+struct Buffer
+{
+	std::int64_t stamp;								///< Push time.
+	char data[4096 - sizeof(std::int64_t)];			///< Filler.
+};
+
+static std::int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+/**
+* Creates, stamps and releases payloads of a type.
+*/
+template <typename T>
+struct Payload;
+
+template <>
+struct Payload<std::string *>
+{
+	static std::string *make(std::size_t size)
+	{
+		std::string *s = new std::string(size, 'x');
+		const std::int64_t stamp = nowNs();
+		std::memcpy(&(*s)[0], &stamp, sizeof(stamp));
+		return s;
+	}
+	static std::int64_t stamp(std::string *const& s)
+	{
+		std::int64_t stamp;
+		std::memcpy(&stamp, s->data(), sizeof(stamp));
+		return stamp;
+	}
+	static void release(std::string *& s)
+	{
+		delete s;
+	}
+};
+
+template <>
+struct Payload<std::string>
+{
+	static std::string make(std::size_t size)
+	{
+		std::string s(size, 'x');
+		const std::int64_t stamp = nowNs();
+		std::memcpy(&s[0], &stamp, sizeof(stamp));
+		return s;
+	}
+	static std::int64_t stamp(const std::string& s)
+	{
+		std::int64_t stamp;
+		std::memcpy(&stamp, s.data(), sizeof(stamp));
+		return stamp;
+	}
+	static void release(std::string&)
+	{
+	}
+};
+
+template <>
+struct Payload<Buffer>
+{
+	static Buffer make(std::size_t)
+	{
+		Buffer b;
+		std::memset(b.data, 'x', sizeof(b.data));
+		b.stamp = nowNs();
+		return b;
+	}
+	static std::int64_t stamp(const Buffer& b)
+	{
+		return b.stamp;
+	}
+	static void release(Buffer&)
+	{
+	}
+};
+
+/**
+* Creates a queue by name, bounded with a blocking producer.
+*/
+template <typename T>
+static std::unique_ptr<MessageQueue<T>> makeQueue(const std::string& name, std::size_t capacity)
+{
+	if (name == "tsq")
+	{
+		std::unique_ptr<ThreadSafeQueue<T>> q(new ThreadSafeQueue<T>);
+		q->setCapacity(capacity);
+		return q;
+	}
+	if (name == "spsc")
+	{
+		return std::unique_ptr<MessageQueue<T>>(new SpscQueue<T>(capacity));
+	}
+	if (name == "mpmc")
+	{
+		return std::unique_ptr<MessageQueue<T>>(new MpmcQueue<T>(capacity));
+	}
+	if (name == "lanes")
+	{
+		return std::unique_ptr<MessageQueue<T>>(new PriorityLaneQueue<T>(1, [](const T&) { return 0; }, capacity));
+	}
+	std::unique_ptr<EventQueue<T>> q(new EventQueue<T>);
+	q->setCapacity(capacity, ThreadSafeQueue<T>::overflowBlock);
+	return q;
+}
+
+static void contextSwitches(long& voluntary, long& involuntary)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	voluntary = usage.ru_nvcsw;
+	involuntary = usage.ru_nivcsw;
+}
+
+/**
+* Runs producers and consumers through a queue.
+*/
+template <typename T>
+static Result run(const Run& r, const Settings& settings)
+{
+	std::unique_ptr<MessageQueue<T>> queuePtr = makeQueue<T>(r.queue, settings.capacity);
+	MessageQueue<T>& queue = *queuePtr;
+	const bool bulk = r.api == "bulk";
+	const std::size_t elements = settings.elements;
+	LatencyHistogram latency;
+	std::atomic<std::size_t> consumed(0);
+	std::atomic<bool> produced(false);
+	std::vector<std::thread> producers;
+	std::vector<std::thread> consumers;
+
+	Result result;
+	long voluntary, involuntary;
+	contextSwitches(voluntary, involuntary);
+	const Clock::time_point start = Clock::now();
+
+	for (std::size_t p = 0; p < r.producers; ++p)
+	{
+		producers.push_back(std::thread([&, p]()
+		{
+			// per producer, the steady pattern spaces elements, the burst pattern bursts
+			const std::size_t count = elements / r.producers + (p < elements % r.producers ? 1 : 0);
+			const double period = r.producers / settings.rate;
+			const std::size_t group = r.pattern == "burst" || (r.pattern == "max" && bulk) ? settings.burst : 1;
+			std::vector<T> values;
+			for (std::size_t i = 0; i < count; i += group)
+			{
+				if (r.pattern != "max")
+				{
+					std::this_thread::sleep_until(start + std::chrono::duration_cast<Clock::duration>(
+						std::chrono::duration<double>(i * period)));
+				}
+				const std::size_t n = std::min(group, count - i);
+				for (std::size_t j = 0; j < n; ++j)
+				{
+					if (bulk)
+					{
+						values.push_back(Payload<T>::make(settings.size));
+					}
+					else
+					{
+						queue.push(Payload<T>::make(settings.size));
+					}
+				}
+				if (bulk)
+				{
+					queue.pushBulk(values);
+				}
+			}
+		}));
+	}
+	for (std::size_t c = 0; c < r.consumers; ++c)
+	{
+		consumers.push_back(std::thread([&]()
+		{
+			std::vector<T> values;
+			T value = T();
+			while (consumed.load(std::memory_order_relaxed) < elements)
+			{
+				if (bulk)
+				{
+					values.clear();
+					queue.waitPopBulk(values, settings.burst, 1);
+				}
+				else if (queue.waitPop(value, 1))
+				{
+					values.push_back(std::move(value));
+				}
+				if (values.empty())
+				{
+					if (produced && queue.empty())
+					{
+						break;	// elements were lost
+					}
+					continue;
+				}
+
+				const std::int64_t now = nowNs();
+				for (T& v : values)
+				{
+					latency.record(now - Payload<T>::stamp(v));
+					Payload<T>::release(v);
+				}
+				consumed += values.size();
+				values.clear();
+			}
+		}));
+	}
+	for (std::thread& thread : producers)
+	{
+		thread.join();
+	}
+	produced = true;
+	for (std::thread& thread : consumers)
+	{
+		thread.join();
+	}
+
+	result.seconds = std::max<double>(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+	long v, i;
+	contextSwitches(v, i);
+	result.voluntary = v - voluntary;
+	result.involuntary = i - involuntary;
+	result.consumed = consumed;
+	result.p50 = latency.percentile(50);
+	result.p99 = latency.percentile(99);
+	result.max = latency.max();
+	return result;
+}
+
+static std::vector<std::string> split(const std::string& list)
+{
+	std::vector<std::string> items;
+	std::istringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ','))
+	{
+		if (!item.empty())
+		{
+			items.push_back(item);
+		}
+	}
+	return items;
+}
+
+static bool selected(const std::vector<std::string>& filter, const std::string& name)
+{
+	return filter.empty() || std::find(filter.begin(), filter.end(), name) != filter.end();
+}
+
+int main(int argc, char *argv[])
+{
+	Settings settings;
+	settings.elements = 20000;
+	settings.capacity = 1024;
+	settings.rate = 200000;
+	settings.burst = 64;
+	settings.size = 64;
+	std::size_t maxThreads = 4;
+	std::vector<std::string> queues, apis, payloads, patterns;
+	std::string csvPath;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "n:m:c:r:b:s:q:a:l:t:o:")) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			settings.elements = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'm':
+			maxThreads = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'c':
+			settings.capacity = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 2);
+			break;
+		case 'r':
+			settings.rate = std::max(std::strtod(g.optarg, nullptr), 1.0);
+			break;
+		case 'b':
+			settings.burst = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 's':
+			settings.size = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), sizeof(std::int64_t));
+			break;
+		case 'q':
+			queues = split(g.optarg);
+			break;
+		case 'a':
+			apis = split(g.optarg);
+			break;
+		case 'l':
+			payloads = split(g.optarg);
+			break;
+		case 't':
+			patterns = split(g.optarg);
+			break;
+		case 'o':
+			csvPath = g.optarg;
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-n elements] [-m max threads] [-c capacity] [-r rate] [-b burst]"
+				" [-s size] [-q queues] [-a apis] [-l payloads] [-t patterns] [-o csv]" << std::endl;
+			return 1;
+		}
+	}
+
+	std::ofstream csvFile;
+	std::ostream *csv = nullptr;
+	if (csvPath == "-")
+	{
+		csv = &std::cout;
+	}
+	else if (!csvPath.empty())
+	{
+		csvFile.open(csvPath.c_str());
+		if (!csvFile)
+		{
+			std::cerr << "Cannot create " << csvPath << std::endl;
+			return 1;
+		}
+		csv = &csvFile;
+	}
+	const bool table = csv != &std::cout;
+
+	if (csv)
+	{
+		*csv << std::fixed << std::setprecision(6);
+		*csv << "queue,api,payload,pattern,producers,consumers,elements,seconds,elements_per_s,"
+			"p50_us,p99_us,max_us,voluntary_cs,involuntary_cs" << std::endl;
+	}
+	if (table)
+	{
+		std::cout << settings.elements << " elements per run, capacity " << settings.capacity << ", paced at "
+			<< settings.rate << "/s, burst " << settings.burst << ", " << std::thread::hardware_concurrency() << " cpus" << std::endl
+			<< std::left << std::setw(7) << "queue" << std::setw(7) << "api" << std::setw(9) << "payload"
+			<< std::setw(8) << "pattern" << std::right << std::setw(3) << "P" << std::setw(3) << "C"
+			<< std::setw(12) << "elements/s" << std::setw(10) << "p50 us" << std::setw(10) << "p99 us"
+			<< std::setw(8) << "vcsw" << std::setw(8) << "ivcsw" << std::endl;
+	}
+
+	const char *allQueues[] = { "tsq", "spsc", "mpmc", "lanes", "event" };
+	const char *allApis[] = { "single", "bulk" };
+	const char *allPayloads[] = { "string*", "string", "buffer" };
+	const char *allPatterns[] = { "max", "steady", "burst" };
+
+	bool success = true;
+	for (const char *queue : allQueues)
+	for (const char *api : allApis)
+	for (const char *payload : allPayloads)
+	for (const char *pattern : allPatterns)
+	for (std::size_t producers = 1; producers <= maxThreads; producers *= 2)
+	for (std::size_t consumers = 1; consumers <= maxThreads; consumers *= 2)
+	{
+		if (!selected(queues, queue) || !selected(apis, api) || !selected(payloads, payload) || !selected(patterns, pattern)
+			|| (std::string(queue) == "spsc" && (producers > 1 || consumers > 1)))
+		{
+			continue;
+		}
+
+		const Run r = { queue, api, payload, pattern, producers, consumers };
+		Result result;
+		if (r.payload == "string*")
+		{
+			result = run<std::string *>(r, settings);
+		}
+		else if (r.payload == "string")
+		{
+			result = run<std::string>(r, settings);
+		}
+		else
+		{
+			result = run<Buffer>(r, settings);
+		}
+		success &= result.consumed == settings.elements;
+
+		const double rate = result.consumed / result.seconds;
+		if (csv)
+		{
+			*csv << r.queue << "," << r.api << "," << r.payload << "," << r.pattern << "," << r.producers << "," << r.consumers
+				<< "," << result.consumed << "," << result.seconds << "," << rate << "," << result.p50 / 1e3 << ","
+				<< result.p99 / 1e3 << "," << result.max / 1e3 << "," << result.voluntary << "," << result.involuntary << std::endl;
+		}
+		if (table)
+		{
+			std::cout << std::fixed << std::setprecision(0)
+				<< std::left << std::setw(7) << r.queue << std::setw(7) << r.api << std::setw(9) << r.payload
+				<< std::setw(8) << r.pattern << std::right << std::setw(3) << r.producers << std::setw(3) << r.consumers
+				<< std::setw(12) << rate << std::setprecision(1) << std::setw(10) << result.p50 / 1e3
+				<< std::setw(10) << result.p99 / 1e3 << std::setw(8) << result.voluntary
+				<< std::setw(8) << result.involuntary << std::endl;
+		}
+	}
+
+	if (!success)
+	{
+		std::cerr << "elements lost" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,378 @@
+/*****************************************************************************/
+/**
+* \file	bench_replay.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Replay of a serial capture through the framing and queue path.
+*
+* Without a capture file, records a synthetic one first: numbered SCI
+* responses split into chunks of random size, as a serial read would return
+* them, one chunk per millisecond. At max speed (-x 0) the replay is a
+* repeatable throughput benchmark; the consumer checks that no message was
+* lost. With -P, the responses also go through the SciParser stage and the
+* consumer receives columnar batches; first the parser must type fields out
+* of integer or double range as the next wider type or as text.
+*
+* With -m, a monitor thread prints the metrics of the queues periodically,
+* see QueueMetrics.hpp; build with make QUEUE_METRICS=1 for more than depth.
+*
+* Usage: bench_replay [-f capture] [-p port] [-d delimiter] [-x speed]
+*                     [-n messages] [-s size] [-c chunk] [-P] [-q ring] [-m ms]
+*   -f  Capture file to replay. Default: synthesize one.
+*   -p  Port id to replay. Default: 0.
+*   -d  Delimiter: cr, lf, crlf or literal text. Default: cr.
+*   -x  Speed, 1 for recorded pace, 0 for max. Default: 0.
+*   -n  Nr of synthetic messages. Default: 1000000.
+*   -s  Synthetic message size including delimiter. Default: 64.
+*   -c  Max synthetic chunk size. Default: 4096.
+*   -P  Parse the responses into batches.
+*   -q  Use an SpscQueue of this size for the messages instead of a ThreadSafeQueue.
+*   -m  Print the queue metrics at this period in milliseconds. Default: 0, off.
+*
+******************************************************************************/
+
+#include "SerialCapture.hpp"
+#include "SerialReplay.hpp"
+#include "DelimiterFramer.hpp"
+#include "SciParser.hpp"
+#include "SpscQueue.hpp"
+#include "GetOpt.hpp"
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+
+
+typedef std::chrono::steady_clock Clock;
+
+static std::string parseDelimiter(const std::string& arg)
+{
+	if (arg == "cr")
+	{
+		return "\r";
+	}
+	if (arg == "lf")
+	{
+		return "\n";
+	}
+	if (arg == "crlf")
+	{
+		return "\r\n";
+	}
+	return arg;
+}
+
+/**
+* Records numbered responses "RTIMS <nr> 7 7 ...", split into random chunks, 1 ms apart.
+*/
+static bool synthesize(const std::string& path, std::uint16_t port, const std::string& delim,
+	std::size_t messages, std::size_t size, std::size_t chunk)
+{
+	SerialCapture capture(path);
+	if (!capture.isOpen())
+	{
+		return false;
+	}
+	std::thread writer(std::ref(capture));
+
+	std::mt19937 rng(1);
+	std::uniform_int_distribution<std::size_t> chunkSize(1, std::max<std::size_t>(chunk, 1));
+	std::string data;
+	std::int64_t time = 0;
+	for (std::size_t i = 0; i < messages; ++i)
+	{
+		std::string message = "RTIMS " + std::to_string(i);
+		const std::size_t payload = size > delim.size() ? size - delim.size() : 0;
+		while (message.size() + 2 <= payload)
+		{
+			message += " 7";
+		}
+		data += message;
+		data += delim;
+
+		std::size_t n;
+		while (data.size() >= (n = chunkSize(rng)) || (i + 1 == messages && !data.empty()))
+		{
+			n = std::min(n, data.size());
+			capture.record(time, port, data.data(), n);
+			data.erase(0, n);
+			time += 1000000;
+		}
+	}
+
+	capture.requestStop();
+	writer.join();
+	return true;
+}
+
+/**
+* Parses one response with fields out of range and checks their types.
+*
+* \return false if a field is typed wrong.
+*/
+static bool checkTyping()
+{
+	ThreadSafeQueue<std::string *> input;
+	ThreadSafeQueue<SciBatch *> output;
+	SciParser parser(input, output);
+	parser.parse("RANGE 12 123456789012345678901 1.5 1e999 1e-400 0e-400", 0);
+	parser.flush();
+
+	// integer, integer overflow, real, real overflow, real underflow, zero
+	const SciColumn::Type expected[] = { SciColumn::typeInteger, SciColumn::typeReal, SciColumn::typeReal,
+		SciColumn::typeText, SciColumn::typeText, SciColumn::typeReal };
+	const std::size_t count = sizeof(expected) / sizeof(expected[0]);
+	SciBatch *batch = nullptr;
+	if (!output.tryPop(batch))
+	{
+		return false;
+	}
+	bool success = batch->columns.size() == count;
+	for (std::size_t i = 0; success && i < count; ++i)
+	{
+		success = batch->columns[i].type == expected[i];
+	}
+	delete batch;
+	return success;
+}
+
+int main(int argc, char *argv[])
+{
+	std::string path;
+	std::uint16_t port = 0;
+	std::string delim = "\r";
+	double speed = 0;
+	std::size_t messages = 1000000;
+	std::size_t size = 64;
+	std::size_t chunk = 4096;
+	bool parse = false;
+	std::size_t ring = 0;
+	std::uint32_t monitorPeriod = 0;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "f:p:d:x:n:s:c:Pq:m:")) != -1)
+	{
+		switch (c)
+		{
+		case 'f':
+			path = g.optarg;
+			break;
+		case 'p':
+			port = static_cast<std::uint16_t>(std::strtoul(g.optarg, nullptr, 10));
+			break;
+		case 'd':
+			delim = parseDelimiter(g.optarg);
+			break;
+		case 'x':
+			speed = std::strtod(g.optarg, nullptr);
+			break;
+		case 'n':
+			messages = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 's':
+			size = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'c':
+			chunk = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'P':
+			parse = true;
+			break;
+		case 'q':
+			ring = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'm':
+			monitorPeriod = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-f capture] [-p port] [-d delimiter] [-x speed]"
+				" [-n messages] [-s size] [-c chunk] [-P] [-q ring] [-m ms]" << std::endl;
+			return 1;
+		}
+	}
+
+	const bool synthetic = path.empty();
+	if (synthetic)
+	{
+		path = "/tmp/bench_replay." + std::to_string(getpid()) + ".cap";
+		if (!synthesize(path, port, delim, messages, size, chunk))
+		{
+			std::cerr << "Cannot create " << path << std::endl;
+			return 1;
+		}
+	}
+
+	if (parse && !checkTyping())
+	{
+		std::cerr << "SciParser typed a field out of range wrong" << std::endl;
+		return 1;
+	}
+
+	SerialReplay replay(path);
+	if (!replay.isOpen())
+	{
+		std::cerr << "Not a capture file: " << path << std::endl;
+		return 1;
+	}
+
+	DelimiterFramer framer(delim);
+	std::unique_ptr<MessageQueue<std::string *>> queuePtr;
+	ThreadSafeQueue<std::string *> *lockedQueue = nullptr;
+	if (ring > 0)
+	{
+		queuePtr.reset(new SpscQueue<std::string *>(ring));
+	}
+	else
+	{
+		lockedQueue = new ThreadSafeQueue<std::string *>;
+		queuePtr.reset(lockedQueue);
+	}
+	MessageQueue<std::string *>& queue = *queuePtr;
+	replay.route(port, &framer, &queue);
+	replay.setSpeed(speed);
+
+	// the consumer checks the sequence numbers of synthetic messages, from
+	// the messages or from the first column of the parsed batches
+	std::size_t received = 0;
+	std::size_t outOfOrder = 0;
+	std::size_t batchCount = 0;
+	ThreadSafeQueue<SciBatch *> batches;
+	SciParser parser(queue, batches);
+	std::thread parserThread;
+	std::thread consumer;
+	if (!parse)
+	{
+		consumer = std::thread([&]()
+		{
+			std::string *message = nullptr;
+			while (replay.isAlive() || !queue.empty())
+			{
+				if (queue.waitPop(message, 10))
+				{
+					if (synthetic && std::strtoul(message->c_str() + 6, nullptr, 10) != received)
+					{
+						++outOfOrder;
+					}
+					++received;
+					delete message;
+				}
+			}
+		});
+	}
+	else
+	{
+		parserThread = std::thread(std::ref(parser));
+		consumer = std::thread([&]()
+		{
+			SciBatch *batch = nullptr;
+			while (parser.isAlive() || !batches.empty())
+			{
+				if (batches.waitPop(batch, 10))
+				{
+					const std::vector<std::int64_t> *seq = batch->columns.empty() ? nullptr : &batch->columns[0].integers;
+					for (std::size_t i = 0; i < batch->rows(); ++i)
+					{
+						if (synthetic && (seq == nullptr || i >= seq->size() || static_cast<std::size_t>((*seq)[i]) != received))
+						{
+							++outOfOrder;
+						}
+						++received;
+					}
+					++batchCount;
+					delete batch;
+				}
+			}
+		});
+	}
+
+	std::atomic<bool> replayed(false);
+	std::thread monitor;
+	if (monitorPeriod > 0)
+	{
+		monitor = std::thread([&]()
+		{
+			while (!replayed)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(monitorPeriod));
+				if (lockedQueue != nullptr)
+				{
+					lockedQueue->metrics().print(std::cout, "messages");
+				}
+				if (parse)
+				{
+					batches.metrics().print(std::cout, "batches");
+				}
+			}
+		});
+	}
+
+	const Clock::time_point start = Clock::now();
+	replay();
+	if (parse)
+	{
+		// the reader queue is drained by the parser, then it posts the rest
+		while (!queue.empty())
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		parser.requestStop();
+		parserThread.join();
+	}
+	consumer.join();
+	replayed = true;
+	if (monitor.joinable())
+	{
+		monitor.join();
+	}
+	const double seconds = std::max<double>(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+
+	if (synthetic)
+	{
+		std::remove(path.c_str());
+	}
+
+	const SerialReplay::Statistics s = replay.statistics();
+	std::cout << std::fixed << std::setprecision(1)
+		<< "replayed: " << s.chunks << " chunks, " << s.bytes << " bytes, " << received << " messages, speed ";
+	if (speed > 0)
+	{
+		std::cout << speed << "x" << std::endl;
+	}
+	else
+	{
+		std::cout << "max" << std::endl;
+	}
+	std::cout
+		<< "throughput: " << received / seconds << " frames/s, " << s.bytes / seconds / 1e6 << " MB/s" << std::endl;
+	if (parse)
+	{
+		std::cout << "parsed: " << batchCount << " batches, " << (batchCount > 0 ? received / batchCount : 0) << " rows/batch" << std::endl;
+	}
+
+	if (s.corrupt)
+	{
+		std::cerr << "corrupt capture file: " << path << std::endl;
+		return 1;
+	}
+	if (synthetic && (received != messages || outOfOrder > 0))
+	{
+		std::cerr << "lost or reordered: " << received << "/" << messages << " received, "
+			<< outOfOrder << " out of order" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,300 @@
+/*****************************************************************************/
+/**
+* \file	bench_serial.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Throughput and latency of TimeoutSerialThread without hardware.
+*
+* A generator thread writes numbered messages to the master side of a
+* pseudo-terminal; the real reader runs on the slave device and the main
+* thread pops the messages from the queue. Latency is measured from just
+* before the write to the queue pop. CPU time of the receive path is the
+* process CPU time minus the generator's.
+*
+* Usage: bench_serial [-n messages] [-s size] [-r rate] [-b burst] [-d delimiter] [-l]
+*                     [-q ring] [-t [-c cpu] [-p priority]]
+*   -n  Nr of messages. Default: 100000.
+*   -s  Message size including delimiter. Default: 64.
+*   -r  Messages per second, 0 for as fast as possible. Default: 0.
+*   -b  Messages written back to back in one burst. Default: 1.
+*   -d  Delimiter: cr, lf, crlf or literal text. Default: cr.
+*   -l  Break the receive latency down by stage with a LatencyProbe.
+*   -q  Use an SpscQueue of this size instead of a ThreadSafeQueue.
+*   -t  Run again with the low latency profile and compare.
+*   -c  CPU to pin the tuned reader to. Default: none.
+*   -p  SCHED_FIFO priority of the tuned reader. Default: none.
+*
+******************************************************************************/
+
+#include "TimeoutSerialThread.hpp"
+#include "PseudoTerminal.hpp"
+#include "LatencyProbe.hpp"
+#include "LowLatency.hpp"
+#include "SpscQueue.hpp"
+#include "GetOpt.hpp"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+* Benchmark settings
+*/
+struct Settings
+{
+	std::size_t messages;	///< Nr of messages.
+	std::size_t size;		///< Message size including delimiter.
+	double rate;			///< Messages per second, 0 for max.
+	std::size_t burst;		///< Messages per write.
+	std::string delim;		///< Message delimiter.
+	bool probe;				///< Measure latency per stage.
+	std::size_t ring;		///< SpscQueue size, 0 for a ThreadSafeQueue.
+};
+
+static std::int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static double cpuSeconds(int who)
+{
+	struct rusage usage;
+	getrusage(who, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static std::string parseDelimiter(const std::string& arg)
+{
+	if (arg == "cr")
+	{
+		return "\r";
+	}
+	if (arg == "lf")
+	{
+		return "\n";
+	}
+	if (arg == "crlf")
+	{
+		return "\r\n";
+	}
+	return arg;
+}
+
+/**
+* Writes the messages to the master side. Message i starts with i in decimal.
+*/
+static void generate(PseudoTerminal& pty, const Settings& settings,
+	std::atomic<std::int64_t> *sendTimes, double& cpu)
+{
+	const double cpuStart = cpuSeconds(RUSAGE_THREAD);
+	const Clock::time_point start = Clock::now();
+	std::string burst;
+
+	for (std::size_t i = 0; i < settings.messages; i += settings.burst)
+	{
+		if (settings.rate > 0)
+		{
+			std::this_thread::sleep_until(start + std::chrono::nanoseconds(static_cast<std::int64_t>(i * 1e9 / settings.rate)));
+		}
+
+		burst.clear();
+		const std::size_t n = std::min(settings.burst, settings.messages - i);
+		for (std::size_t j = 0; j < n; ++j)
+		{
+			std::string message = std::to_string(i + j) + ' ';
+			const std::size_t payload = settings.size > settings.delim.size() ? settings.size - settings.delim.size() : 0;
+			message.resize(std::max(payload, message.size()), 'x');
+			burst += message;
+			burst += settings.delim;
+		}
+
+		const std::int64_t t = nowNs();
+		for (std::size_t j = 0; j < n; ++j)
+		{
+			sendTimes[i + j].store(t, std::memory_order_relaxed);
+		}
+		pty.write(burst.data(), burst.size());
+	}
+	cpu = cpuSeconds(RUSAGE_THREAD) - cpuStart;
+}
+
+/**
+* Runs the benchmark once and prints the results.
+*
+* \param settings Benchmark settings.
+* \param profile Low latency tuning of the reader, nullptr for none.
+*
+* \return true if all messages were received.
+*/
+static bool run(const Settings& settings, const LowLatencyProfile *profile)
+{
+	PseudoTerminal pty;
+	std::unique_ptr<MessageQueue<std::string *>> queuePtr;
+	if (settings.ring > 0)
+	{
+		queuePtr.reset(new SpscQueue<std::string *>(settings.ring));
+	}
+	else
+	{
+		queuePtr.reset(new ThreadSafeQueue<std::string *>);
+	}
+	MessageQueue<std::string *>& queue = *queuePtr;
+	TimeoutSerialThread reader(settings.delim.c_str(), &queue, pty.slaveName(), 115200);
+	if (profile != nullptr)
+	{
+		reader.setLowLatency(*profile);
+	}
+	if (!reader.open())
+	{
+		std::cerr << "Cannot open " << pty.slaveName() << std::endl;
+		return false;
+	}
+	LatencyProbe probe("reader");
+	if (settings.probe)
+	{
+		reader.setLatencyProbe(&probe);
+	}
+	std::thread readerThread(std::ref(reader));
+
+	std::unique_ptr<std::atomic<std::int64_t>[]> sendTimes(new std::atomic<std::int64_t>[settings.messages]);
+	std::vector<std::int64_t> latencies;
+	latencies.reserve(settings.messages);
+
+	const double cpuStart = cpuSeconds(RUSAGE_SELF);
+	const std::int64_t start = nowNs();
+	double generatorCpu = 0;
+	std::thread generator(generate, std::ref(pty), std::cref(settings), sendTimes.get(), std::ref(generatorCpu));
+
+	std::size_t bytes = 0;
+	std::int64_t end = start;
+	while (latencies.size() < settings.messages)
+	{
+		std::string *message = nullptr;
+		if (!queue.waitPop(message, 2000))
+		{
+			break;	// the rest is lost
+		}
+		end = nowNs();
+		if (settings.probe)
+		{
+			probe.popped();
+		}
+		const std::size_t seq = std::strtoul(message->c_str(), nullptr, 10);
+		if (seq < settings.messages)
+		{
+			latencies.push_back(end - sendTimes[seq].load(std::memory_order_relaxed));
+		}
+		bytes += message->size() + settings.delim.size();
+		delete message;
+	}
+
+	generator.join();
+	const double cpu = cpuSeconds(RUSAGE_SELF) - cpuStart - generatorCpu;
+	reader.requestStop();
+	readerThread.join();
+
+	const double seconds = std::max<std::int64_t>(end - start, 1) / 1e9;
+	const std::size_t received = latencies.size();
+	std::sort(latencies.begin(), latencies.end());
+	std::cout << std::fixed << std::setprecision(1)
+		<< "== " << (profile != nullptr ? "tuned" : "default") << ", "
+		<< (settings.ring > 0 ? "SpscQueue " + std::to_string(settings.ring) : std::string("ThreadSafeQueue")) << std::endl
+		<< "messages: " << received << "/" << settings.messages << " received, "
+		<< settings.size << " bytes, burst " << settings.burst << ", rate "
+		<< (settings.rate > 0 ? std::to_string(static_cast<long>(settings.rate)) : std::string("max")) << std::endl
+		<< "throughput: " << received / seconds << " frames/s, " << bytes / seconds / 1e6 << " MB/s" << std::endl
+		<< "cpu: " << (received > 0 ? cpu * 1e6 / received : 0.0) << " us/frame (reader + consumer)" << std::endl;
+
+	if (received > 0)
+	{
+		std::cout << "latency us:";
+		const double percentiles[] = { 50, 90, 99, 99.9, 100 };
+		for (double p : percentiles)
+		{
+			const std::size_t i = std::min(received - 1, static_cast<std::size_t>(p / 100 * received));
+			std::cout << " p" << std::setprecision(p == 99.9 ? 1 : 0) << p << "=" << std::setprecision(1) << latencies[i] / 1e3;
+		}
+		std::cout << std::endl;
+	}
+	if (settings.probe)
+	{
+		probe.dump(std::cout);
+	}
+	for (const std::string& line : reader.tuningReport())
+	{
+		std::cout << "tuning: " << line << std::endl;
+	}
+	return received == settings.messages;
+}
+
+int main(int argc, char *argv[])
+{
+	Settings settings = { 100000, 64, 0, 1, "\r", false, 0 };
+	bool compare = false;
+	LowLatencyProfile profile = LowLatencyProfile::defaults();
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "n:s:r:b:d:lq:tc:p:")) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			settings.messages = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 's':
+			settings.size = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'r':
+			settings.rate = std::strtod(g.optarg, nullptr);
+			break;
+		case 'b':
+			settings.burst = std::max<std::size_t>(std::strtoul(g.optarg, nullptr, 10), 1);
+			break;
+		case 'd':
+			settings.delim = parseDelimiter(g.optarg);
+			break;
+		case 'l':
+			settings.probe = true;
+			break;
+		case 'q':
+			settings.ring = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 't':
+			compare = true;
+			break;
+		case 'c':
+			profile.cpu = std::atoi(g.optarg);
+			break;
+		case 'p':
+			profile.fifoPriority = std::atoi(g.optarg);
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-n messages] [-s size] [-r rate] [-b burst] [-d delimiter] [-l]"
+				" [-q ring] [-t [-c cpu] [-p priority]]" << std::endl;
+			return 1;
+		}
+	}
+
+	bool success = run(settings, nullptr);
+	if (compare)
+	{
+		success &= run(settings, &profile);
+	}
+	return success ? 0 : 1;
+}
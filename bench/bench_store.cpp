@@ -0,0 +1,219 @@
+/*****************************************************************************/
+/**
+* \file	bench_store.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Write and query throughput of the time-series store.
+*
+* Writes synthetic waveform rows, pressure, flow and volume, as parsed
+* batches through the store thread at a simulated sample rate, then times
+* random range queries of raw rows and downsampled reads of the whole series.
+* Fails if a query returns rows out of its range or a tier disagrees with
+* the rows.
+*
+* Usage: bench_store [-n rows] [-r rate] [-k chunk rows] [-w width s] [-q queries] [-D dir]
+*   -n  Nr of rows. Default: 2000000.
+*   -r  Simulated sample rate in Hz. Default: 50.
+*   -k  Rows per chunk file. Default: 65536.
+*   -w  Width of the raw queries in seconds. Default: 60.
+*   -q  Nr of raw queries. Default: 1000.
+*   -D  Store directory, kept. Default: a temporary one, removed.
+*
+******************************************************************************/
+
+#include "TimeSeriesStore.hpp"
+#include "TimeSeriesReader.hpp"
+#include "GetOpt.hpp"
+
+#include <boost/filesystem.hpp>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+typedef std::chrono::steady_clock Clock;
+
+static double seconds(Clock::time_point start)
+{
+	return std::max<double>(std::chrono::duration<double>(Clock::now() - start).count(), 1e-9);
+}
+
+int main(int argc, char *argv[])
+{
+	std::size_t rows = 2000000;
+	double rate = 50;
+	std::size_t chunkRows = TimeSeriesStore::CHUNK_ROWS;
+	double width = 60;
+	std::size_t queries = 1000;
+	std::string root;
+
+	char c;
+	GetOpt g;
+	while ((c = g.getopt(argc, argv, "n:r:k:w:q:D:")) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			rows = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'r':
+			rate = std::max(std::strtod(g.optarg, nullptr), 1e-3);
+			break;
+		case 'k':
+			chunkRows = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'w':
+			width = std::strtod(g.optarg, nullptr);
+			break;
+		case 'q':
+			queries = std::strtoul(g.optarg, nullptr, 10);
+			break;
+		case 'D':
+			root = g.optarg;
+			break;
+		default:
+			std::cerr << "Usage: " << argv[0] << " [-n rows] [-r rate] [-k chunk rows] [-w width s] [-q queries] [-D dir]" << std::endl;
+			return 1;
+		}
+	}
+
+	const bool temporary = root.empty();
+	if (temporary)
+	{
+		root = "/tmp/bench_store." + std::to_string(getpid());
+	}
+
+	ThreadSafeQueue<SciBatch *> batches;
+	std::unique_ptr<TimeSeriesStore> store(new TimeSeriesStore(root, batches, chunkRows));
+	if (!store->isOpen())
+	{
+		std::cerr << "Cannot create " << root << std::endl;
+		return 1;
+	}
+
+	// write
+	const std::int64_t period = static_cast<std::int64_t>(1e9 / rate);
+	const Clock::time_point writeStart = Clock::now();
+	std::thread writer(std::ref(*store));
+	for (std::size_t row = 0; row < rows; row += 256)
+	{
+		SciBatch *batch = new SciBatch;
+		batch->tag = "WAVE";
+		batch->columns.resize(3);
+		for (SciColumn& column : batch->columns)
+		{
+			column.type = SciColumn::typeReal;
+		}
+		for (std::size_t i = row; i < std::min(rows, row + 256); ++i)
+		{
+			const double phase = 2 * M_PI * static_cast<double>(i) / (4 * rate);
+			batch->times.push_back(static_cast<std::int64_t>(i) * period);
+			batch->columns[0].reals.push_back(10 + 10 * std::sin(phase));
+			batch->columns[1].reals.push_back(30 * std::cos(phase));
+			batch->columns[2].reals.push_back(static_cast<double>(i % 1000));
+		}
+		batches.push(batch);
+	}
+	while (!batches.empty())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	store->requestStop();
+	writer.join();
+	const double writeSeconds = seconds(writeStart);
+	const TimeSeriesStore::Statistics s = store->statistics();
+	store.reset();
+
+	std::cout << std::fixed << std::setprecision(1)
+		<< "written: " << s.rows << " rows, " << s.batches << " batches, " << s.chunks << " chunks, "
+		<< s.rows / writeSeconds << " rows/s" << std::endl;
+
+	// the whole series at the coarsest tier gives its time span
+	TimeSeriesReader reader(root);
+	TimeSeriesReader::Summary summary;
+	std::int64_t lo = INT64_MIN;
+	std::int64_t hi = INT64_MAX;
+	Clock::time_point start = Clock::now();
+	reader.summarize("WAVE", lo, hi, 1, summary);
+	const double tier1Seconds = seconds(start);
+	const std::size_t tier1Buckets = summary.times.size();
+
+	std::size_t errors = 0;
+	std::size_t counted = 0;
+	for (std::size_t b = 0; b < summary.times.size(); ++b)
+	{
+		counted += summary.counts[b];
+		if (summary.min[0][b] < -1e-9 || summary.max[0][b] > 20 + 1e-9 || summary.min[0][b] > summary.mean[0][b] || summary.mean[0][b] > summary.max[0][b])
+		{
+			++errors;
+		}
+	}
+	if (counted != rows || summary.times.empty())
+	{
+		std::cerr << "tier 1 covers " << counted << "/" << rows << " rows" << std::endl;
+		return 1;
+	}
+	lo = summary.times.front();
+	hi = lo + static_cast<std::int64_t>(rows) * period;
+
+	start = Clock::now();
+	reader.summarize("WAVE", lo, hi, 0, summary);
+	const double tier0Seconds = seconds(start);
+	const std::size_t tier0Buckets = summary.times.size();
+
+	// raw queries at random positions, checked against the row numbering in column 2
+	std::mt19937_64 rng(1);
+	const std::int64_t span = static_cast<std::int64_t>(width * 1e9);
+	std::uniform_int_distribution<std::int64_t> position(lo, std::max(lo, hi - span));
+	TimeSeriesReader::Range range;
+	std::size_t returned = 0;
+	start = Clock::now();
+	for (std::size_t q = 0; q < queries; ++q)
+	{
+		const std::int64_t from = position(rng);
+		reader.query("WAVE", from, from + span, range);
+		returned += range.times.size();
+		for (std::size_t i = 0; i < range.times.size(); ++i)
+		{
+			if (range.times[i] < from || range.times[i] >= from + span
+				|| (i > 0 && range.columns[2][i] != std::fmod(range.columns[2][i - 1] + 1, 1000)))
+			{
+				++errors;
+				break;
+			}
+		}
+	}
+	const double querySeconds = seconds(start);
+
+	std::cout << std::setprecision(3)
+		<< "tier 1: " << tier1Buckets << " buckets of whole series in " << tier1Seconds * 1e3 << " ms" << std::endl
+		<< "tier 0: " << tier0Buckets << " buckets of whole series in " << tier0Seconds * 1e3 << " ms" << std::endl
+		<< "raw: " << queries << " queries of " << width << " s, " << (queries > 0 ? returned / queries : 0) << " rows each, "
+		<< (queries > 0 ? querySeconds / queries * 1e6 : 0) << " us/query" << std::endl;
+
+	if (temporary)
+	{
+		boost::filesystem::remove_all(root);
+	}
+
+	if (errors > 0)
+	{
+		std::cerr << errors << " inconsistent buckets or queries" << std::endl;
+		return 1;
+	}
+	return 0;
+}
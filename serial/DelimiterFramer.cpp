@@ -0,0 +1,44 @@
+/*****************************************************************************/
+/**
+* \file	DelimiterFramer.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "DelimiterFramer.hpp"
+
+
+DelimiterFramer::DelimiterFramer(const std::string& delim, Checksum checksum) :
+	Framer(checksum),
+	scanner_(delim)
+{
+}
+
+std::size_t DelimiterFramer::extract(const char *data, std::size_t size, std::string *&frame)
+{
+	frame = nullptr;
+	const std::size_t pos = scanner_.find(data, size);
+	if (pos == DelimiterScanner::npos)
+	{
+		return 0;
+	}
+
+	frame = accept(data, pos, true);
+	return pos + scanner_.delimiter().size();
+}
+
+std::string DelimiterFramer::encode(const std::string& payload) const
+{
+	std::string frame(payload);
+	appendChecksum(frame, true);
+	frame += scanner_.delimiter();
+	return frame;
+}
+
+void DelimiterFramer::reset()
+{
+	scanner_.reset();
+}
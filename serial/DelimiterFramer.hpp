@@ -0,0 +1,45 @@
+/*****************************************************************************/
+/**
+* \file	DelimiterFramer.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "Framer.hpp"
+#include "DelimiterScanner.hpp"
+
+/*****************************************************************************/
+/**
+* \brief Frames terminated by a delimiter, e.g. SCI text lines.
+*
+* Frame: payload, checksum, delimiter. The checksum is sent as upper case hex
+* digits so a frame never holds binary data. The payload must not contain the
+* delimiter, so this framer is for text only.
+*
+******************************************************************************/
+class DelimiterFramer : public Framer
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param delim Message delimiter.
+	* \param checksum Frame checksum. Default: none.
+	*
+	******************************************************************************/
+	explicit DelimiterFramer(const std::string& delim, Checksum checksum = checksumNone);
+
+	std::size_t extract(const char *data, std::size_t size, std::string *&frame) override;
+	std::string encode(const std::string& payload) const override;
+	void reset() override;
+
+private:
+
+	DelimiterScanner scanner_;	///< Finds the delimiter.
+};
@@ -0,0 +1,178 @@
+/*****************************************************************************/
+/**
+* \file	DelimiterScanner.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "DelimiterScanner.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCANNER_X86 1
+#include <immintrin.h>
+#endif
+
+
+const std::size_t DelimiterScanner::npos;
+
+static const char *findByteMemchr(const char *begin, const char *end, char c)
+{
+	const void *p = std::memchr(begin, c, end - begin);
+	return p != nullptr ? static_cast<const char *>(p) : end;
+}
+
+#ifdef SCANNER_X86
+
+__attribute__((target("sse2")))
+static const char *findByteSse2(const char *begin, const char *end, char c)
+{
+	const __m128i needle = _mm_set1_epi8(c);
+	const char *p = begin;
+	for (; p + 16 <= end; p += 16)
+	{
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		const int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle));
+		if (mask != 0)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	for (; p < end; ++p)
+	{
+		if (*p == c)
+		{
+			return p;
+		}
+	}
+	return end;
+}
+
+__attribute__((target("avx2")))
+static const char *findByteAvx2(const char *begin, const char *end, char c)
+{
+	const __m256i needle = _mm256_set1_epi8(c);
+	const char *p = begin;
+	for (; p + 32 <= end; p += 32)
+	{
+		const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+		const unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+		if (mask != 0)
+		{
+			return p + __builtin_ctz(mask);
+		}
+	}
+	return findByteSse2(p, end, c);
+}
+
+#endif
+
+DelimiterScanner::DelimiterScanner(const std::string& delim, Kernel kernel) :
+	delim_(delim),
+	kernel_(kernelMemchr),
+	findByte_(findByteMemchr),
+	resume_(0)
+{
+	if (kernel == kernelAuto)
+	{
+		kernel = isSupported(kernelAvx2) ? kernelAvx2 : (isSupported(kernelSse2) ? kernelSse2 : kernelMemchr);
+	}
+
+#ifdef SCANNER_X86
+	if (kernel == kernelAvx2 && isSupported(kernelAvx2))
+	{
+		kernel_ = kernelAvx2;
+		findByte_ = findByteAvx2;
+	}
+	else if (kernel == kernelSse2 && isSupported(kernelSse2))
+	{
+		kernel_ = kernelSse2;
+		findByte_ = findByteSse2;
+	}
+#endif
+}
+
+std::size_t DelimiterScanner::find(const char *data, std::size_t size)
+{
+	const std::size_t delimSize = delim_.size();
+	if (delimSize == 0 || size < delimSize)
+	{
+		return npos;
+	}
+
+	// a candidate must leave room for the whole delimiter
+	const char *end = data + size - delimSize + 1;
+	const char *p = data + std::min(resume_, size);
+	while (p < end)
+	{
+		p = findByte_(p, end, delim_[0]);
+		if (p == end)
+		{
+			break;
+		}
+		if (std::memcmp(p + 1, delim_.data() + 1, delimSize - 1) == 0)
+		{
+			resume_ = 0;
+			return p - data;
+		}
+		++p;
+	}
+
+	// the tail may hold the start of a delimiter, scan it again with more data
+	resume_ = size - delimSize + 1;
+	return npos;
+}
+
+void DelimiterScanner::reset()
+{
+	resume_ = 0;
+}
+
+const std::string& DelimiterScanner::delimiter() const
+{
+	return delim_;
+}
+
+DelimiterScanner::Kernel DelimiterScanner::kernel() const
+{
+	return kernel_;
+}
+
+bool DelimiterScanner::isSupported(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case kernelAuto:
+	case kernelMemchr:
+		return true;
+#ifdef SCANNER_X86
+	case kernelSse2:
+		return __builtin_cpu_supports("sse2");
+	case kernelAvx2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+const char *DelimiterScanner::kernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case kernelAuto:
+		return "auto";
+	case kernelMemchr:
+		return "memchr";
+	case kernelSse2:
+		return "sse2";
+	case kernelAvx2:
+		return "avx2";
+	default:
+		return "unknown";
+	}
+}
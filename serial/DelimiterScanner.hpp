@@ -0,0 +1,125 @@
+/*****************************************************************************/
+/**
+* \file	DelimiterScanner.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Finds message delimiters in received serial data.
+*
+* Searches for the first byte of the delimiter with memchr, SSE2 or AVX2 and
+* verifies the rest of the delimiter on each candidate. The kernel is chosen
+* at runtime from the CPU features unless given explicitly.
+*
+* The scanner remembers how far a search got. When find() is called again on
+* the same unconsumed data with more data appended, the search resumes where
+* the previous one stopped instead of rescanning from the start.
+*
+******************************************************************************/
+class DelimiterScanner
+{
+public:
+
+	/**
+	* Search kernel for the first delimiter byte.
+	*/
+	enum Kernel
+	{
+		kernelAuto,		///< Best kernel supported by the CPU.
+		kernelMemchr,	///< memchr from the C library.
+		kernelSse2,		///< 16 bytes per step. x86 only.
+		kernelAvx2		///< 32 bytes per step. x86 only.
+	};
+
+	static const std::size_t npos = static_cast<std::size_t>(-1);	///< Returned by find() if no delimiter was found.
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param delim Message delimiter. An empty delimiter never matches.
+	* \param kernel Search kernel. Falls back to kernelMemchr if not supported.
+	*
+	******************************************************************************/
+	explicit DelimiterScanner(const std::string& delim, Kernel kernel = kernelAuto);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Find the first delimiter.
+	*
+	* \param data Unconsumed data. Must start with the data given to the previous
+	* call unless that call found a delimiter or reset() was called.
+	* \param size Nr of bytes in data.
+	*
+	* \return Offset of the first delimiter in data, or npos.
+	*
+	******************************************************************************/
+	std::size_t find(const char *data, std::size_t size);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Forget the position of the previous search.
+	*
+	******************************************************************************/
+	void reset();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the message delimiter.
+	*
+	******************************************************************************/
+	const std::string& delimiter() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the kernel in use.
+	*
+	******************************************************************************/
+	Kernel kernel() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the CPU supports the kernel.
+	*
+	* \param kernel Search kernel.
+	*
+	******************************************************************************/
+	static bool isSupported(Kernel kernel);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the name of the kernel.
+	*
+	* \param kernel Search kernel.
+	*
+	******************************************************************************/
+	static const char *kernelName(Kernel kernel);
+
+private:
+
+	/**
+	* Returns a pointer to the first c in [begin, end), or end.
+	*/
+	typedef const char *(*FindByte)(const char *begin, const char *end, char c);
+
+	std::string delim_;		///< Message delimiter.
+	Kernel kernel_;			///< Kernel in use.
+	FindByte findByte_;		///< Search function of the kernel.
+	std::size_t resume_;	///< Offset the next search starts at.
+};
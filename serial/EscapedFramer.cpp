@@ -0,0 +1,108 @@
+/*****************************************************************************/
+/**
+* \file	EscapedFramer.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "EscapedFramer.hpp"
+#include <cstring>
+
+
+EscapedFramer::EscapedFramer(Checksum checksum, char start, char end, char escape) :
+	Framer(checksum),
+	start_(start),
+	end_(end),
+	escape_(escape),
+	resume_(1),
+	body_()
+{
+}
+
+std::size_t EscapedFramer::extract(const char *data, std::size_t size, std::string *&frame)
+{
+	frame = nullptr;
+	if (size == 0)
+	{
+		return 0;
+	}
+
+	// skip anything outside a frame
+	if (data[0] != start_)
+	{
+		const void *start = std::memchr(data, start_, size);
+		resume_ = 1;
+		return start != nullptr ? static_cast<const char *>(start) - data : size;
+	}
+
+	const char *from = data + resume_;
+	const char *limit = data + size;
+	const char *end = static_cast<const char *>(std::memchr(from, end_, limit - from));
+	const char *restart = static_cast<const char *>(std::memchr(from, start_, (end != nullptr ? end : limit) - from));
+	if (restart != nullptr)
+	{
+		// the end of the previous frame was lost
+		drop();
+		resume_ = 1;
+		return restart - data;
+	}
+	if (end == nullptr)
+	{
+		resume_ = size;
+		return 0;
+	}
+
+	resume_ = 1;
+	body_.clear();
+	for (const char *p = data + 1; p < end; ++p)
+	{
+		if (*p != escape_)
+		{
+			body_ += *p;
+		}
+		else if (++p < end)
+		{
+			body_ += static_cast<char>(*p ^ 0x20);
+		}
+		else
+		{
+			drop();		// escape byte without a following byte
+			return end + 1 - data;
+		}
+	}
+
+	frame = accept(body_.data(), body_.size());
+	return end + 1 - data;
+}
+
+std::string EscapedFramer::encode(const std::string& payload) const
+{
+	std::string body(payload);
+	appendChecksum(body);
+
+	std::string frame;
+	frame.reserve(body.size() + body.size() / 8 + 2);
+	frame += start_;
+	for (char c : body)
+	{
+		if (c == start_ || c == end_ || c == escape_)
+		{
+			frame += escape_;
+			frame += static_cast<char>(c ^ 0x20);
+		}
+		else
+		{
+			frame += c;
+		}
+	}
+	frame += end_;
+	return frame;
+}
+
+void EscapedFramer::reset()
+{
+	resume_ = 1;
+}
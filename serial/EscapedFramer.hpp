@@ -0,0 +1,52 @@
+/*****************************************************************************/
+/**
+* \file	EscapedFramer.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "Framer.hpp"
+
+/*****************************************************************************/
+/**
+* \brief Binary frames between a start and an end byte, with byte stuffing.
+*
+* Frame: start byte, escaped payload and checksum, end byte. A start, end or
+* escape byte in the payload or checksum is sent as the escape byte followed
+* by the byte xor 0x20. Data before a start byte is skipped, and a start byte
+* before the end byte drops the truncated frame.
+*
+******************************************************************************/
+class EscapedFramer : public Framer
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param checksum Frame checksum. Default: CRC-16.
+	* \param start Start byte. Default: STX.
+	* \param end End byte. Default: ETX.
+	* \param escape Escape byte. Default: DLE.
+	*
+	******************************************************************************/
+	explicit EscapedFramer(Checksum checksum = checksumCrc16,
+		char start = '\x02', char end = '\x03', char escape = '\x10');
+
+	std::size_t extract(const char *data, std::size_t size, std::string *&frame) override;
+	std::string encode(const std::string& payload) const override;
+	void reset() override;
+
+private:
+
+	char start_;			///< Start byte.
+	char end_;				///< End byte.
+	char escape_;			///< Escape byte.
+	std::size_t resume_;	///< Offset the search for the end byte continues at.
+	std::string body_;		///< Unescaped frame body. Reused between frames.
+};
@@ -0,0 +1,114 @@
+/*****************************************************************************/
+/**
+* \file	FrameAssembler.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "FrameAssembler.hpp"
+#include <cstring>
+#include <stdexcept>
+
+
+FrameAssembler::FrameAssembler(Framer *framer, MessageQueue<std::string *> *queue) :
+	framer_(framer),
+	queue_(queue),
+	buffer_(),
+	size_(0),
+	frames_(),
+	probe_(nullptr)
+{
+}
+
+char *FrameAssembler::prepare(std::size_t minFree, std::size_t& available)
+{
+	if (buffer_.size() - size_ < minFree)
+	{
+		buffer_.resize(size_ + minFree);
+	}
+	available = buffer_.size() - size_;
+	return &buffer_[size_];
+}
+
+std::size_t FrameAssembler::commit(std::size_t size, std::int64_t readTime)
+{
+	size_ += size;
+
+	std::size_t start = 0;
+	std::size_t consumed;
+	std::string *frame = nullptr;
+	while (start < size_ &&
+		(consumed = framer_->extract(&buffer_[start], size_ - start, frame)) > 0)
+	{
+		start += consumed;
+		if (frame != nullptr)
+		{
+			if (probe_ != nullptr)
+			{
+				probe_->pushing(readTime, LatencyProbe::now());
+			}
+			frames_.push_back(frame);	// delimiter/framing not included
+		}
+	}
+
+	// all frames of one read under one lock and one wake-up of the consumer.
+	// Frames the queue discards went to its drop function, see the constructor
+	const std::size_t count = frames_.size();
+	if (count == 1)
+	{
+		queue_->push(frames_.front());
+		frames_.clear();
+	}
+	else if (count > 1)
+	{
+		queue_->pushBulk(frames_);
+	}
+
+	if (size_ - start > MAX_MESSAGE_SIZE)
+	{
+		// no frame end in sight, drop the garbage rather than grow forever
+		start = size_;
+		framer_->reset();
+	}
+
+	// keep the unterminated tail at the front of the buffer
+	if (start > 0)
+	{
+		std::memmove(&buffer_[0], &buffer_[start], size_ - start);
+		size_ -= start;
+	}
+	return count;
+}
+
+std::size_t FrameAssembler::receive(const char *data, std::size_t size, std::int64_t readTime)
+{
+	std::size_t available;
+	std::memcpy(prepare(size, available), data, size);
+	return commit(size, readTime);
+}
+
+void FrameAssembler::reset()
+{
+	size_ = 0;
+	if (framer_ != nullptr)
+	{
+		framer_->reset();
+	}
+}
+
+void FrameAssembler::setProbe(LatencyProbe *probe)
+{
+	if (probe != nullptr && queue_ != nullptr && queue_->discards())
+	{
+		throw std::invalid_argument("FrameAssembler: a latency probe needs a queue that discards nothing");
+	}
+	probe_ = probe;
+}
+
+LatencyProbe *FrameAssembler::probe() const
+{
+	return probe_;
+}
@@ -0,0 +1,134 @@
+/*****************************************************************************/
+/**
+* \file	FrameAssembler.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "Framer.hpp"
+#include "LatencyProbe.hpp"
+#include "MessageQueue.hpp"
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Receive buffer that turns received data into queued messages.
+*
+* Data is either read straight into the buffer (prepare() and commit()) or
+* copied in (receive()). Each call posts all frames completed by the new data
+* into the message queue and keeps the unterminated tail for the next call.
+*
+* Shared by the serial reader and by replay of captured data, so both go
+* through the same framing and queue path.
+*
+******************************************************************************/
+class FrameAssembler : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param framer Splits the data into messages. Not owned.
+	* \param queue Queue for received messages. Not owned. Frames it discards are
+	* not deleted here, so a discarding queue needs a drop function that deletes
+	* them; ThreadSafeQueue insists on one, SpscQueue and MpmcQueue wait without.
+	*
+	******************************************************************************/
+	FrameAssembler(Framer *framer, MessageQueue<std::string *> *queue);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Make room for new data at the end of the buffer.
+	*
+	* \param minFree Min nr of free bytes.
+	* \param[out] available Nr of free bytes.
+	*
+	* \return Where to put the new data.
+	*
+	******************************************************************************/
+	char *prepare(std::size_t minFree, std::size_t& available);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Add data put in the buffer after prepare() and post the completed messages.
+	*
+	* \param size Nr of new bytes.
+	* \param readTime When the data was received, for the latency probe.
+	*
+	* \return Nr of messages posted.
+	*
+	******************************************************************************/
+	std::size_t commit(std::size_t size, std::int64_t readTime = 0);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Copy data into the buffer and post the completed messages.
+	*
+	* \param data Received data.
+	* \param size Nr of bytes.
+	* \param readTime When the data was received, for the latency probe.
+	*
+	* \return Nr of messages posted.
+	*
+	******************************************************************************/
+	std::size_t receive(const char *data, std::size_t size, std::int64_t readTime = 0);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Discard buffered data and framer state.
+	*
+	******************************************************************************/
+	void reset();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Stamp each posted message for latency measurement.
+	*
+	* \param probe Probe of the message queue. Not owned. nullptr disables stamping.
+	*
+	* \throws std::invalid_argument if the queue may discard messages. The
+	* probe pairs pushes with pops by position, so one discarded message
+	* would shift every later pairing.
+	*
+	******************************************************************************/
+	void setProbe(LatencyProbe *probe);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the latency probe, nullptr if none.
+	*
+	******************************************************************************/
+	LatencyProbe *probe() const;
+
+	/**
+	* Buffer limits
+	*/
+	enum Limits
+	{
+		MAX_MESSAGE_SIZE = 1 << 20,	///< Unterminated data beyond this size is discarded.
+	};
+
+private:
+
+	Framer *framer_;							///< Splits buffer_ into messages.
+	MessageQueue<std::string *> *queue_;		///< Queue for received messages.
+	std::vector<char> buffer_;					///< Holds eventual received but not consumed data.
+	std::size_t size_;							///< Nr of valid bytes in buffer_.
+	std::vector<std::string *> frames_;			///< Frames extracted by one commit, pushed together.
+	LatencyProbe *probe_;						///< Stamps posted messages. May be nullptr.
+};
@@ -0,0 +1,146 @@
+/*****************************************************************************/
+/**
+* \file	Framer.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "Framer.hpp"
+#include "Crc.hpp"
+
+
+Framer::Framer(Checksum checksum) :
+	checksum_(checksum),
+	dropped_(0)
+{
+}
+
+Framer::~Framer()
+{
+}
+
+void Framer::reset()
+{
+}
+
+std::uint64_t Framer::droppedFrames() const
+{
+	return dropped_.load(std::memory_order_relaxed);
+}
+
+Framer::Checksum Framer::checksum() const
+{
+	return checksum_;
+}
+
+std::size_t Framer::checksumSize(Checksum checksum)
+{
+	switch (checksum)
+	{
+	case checksumCrc16:
+		return 2;
+	case checksumCrc32:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+/**
+* Checksum of a payload, regardless of type.
+*/
+static std::uint32_t calculate(Framer::Checksum checksum, const char *data, std::size_t size)
+{
+	switch (checksum)
+	{
+	case Framer::checksumCrc16:
+		return crc16(data, size);
+	case Framer::checksumCrc32:
+		return crc32(data, size);
+	default:
+		return 0;
+	}
+}
+
+static int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+bool Framer::verify(const char *data, std::size_t size, bool hex) const
+{
+	const std::size_t bytes = checksumSize(checksum_);
+	const std::size_t trailer = hex ? bytes * 2 : bytes;
+	if (size < trailer)
+	{
+		return false;
+	}
+
+	const std::size_t payloadSize = size - trailer;
+	std::uint32_t received = 0;
+	for (std::size_t i = 0; i < trailer; ++i)
+	{
+		if (hex)
+		{
+			const int v = hexValue(data[payloadSize + i]);
+			if (v < 0)
+			{
+				return false;
+			}
+			received = (received << 4) | static_cast<std::uint32_t>(v);
+		}
+		else
+		{
+			received = (received << 8) | static_cast<std::uint8_t>(data[payloadSize + i]);
+		}
+	}
+	return bytes == 0 || received == calculate(checksum_, data, payloadSize);
+}
+
+std::string *Framer::accept(const char *data, std::size_t size, bool hex)
+{
+	if (!verify(data, size, hex))
+	{
+		drop();
+		return nullptr;
+	}
+
+	const std::size_t trailer = hex ? checksumSize(checksum_) * 2 : checksumSize(checksum_);
+	return new std::string(data, size - trailer);
+}
+
+void Framer::appendChecksum(std::string& body, bool hex) const
+{
+	static const char digits[] = "0123456789ABCDEF";
+	const std::size_t bytes = checksumSize(checksum_);
+	const std::uint32_t crc = calculate(checksum_, body.data(), body.size());
+	for (std::size_t i = bytes; i > 0; --i)
+	{
+		const std::uint8_t b = static_cast<std::uint8_t>(crc >> (8 * (i - 1)));
+		if (hex)
+		{
+			body += digits[b >> 4];
+			body += digits[b & 0x0F];
+		}
+		else
+		{
+			body += static_cast<char>(b);
+		}
+	}
+}
+
+void Framer::drop()
+{
+	dropped_.fetch_add(1, std::memory_order_relaxed);
+}
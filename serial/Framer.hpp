@@ -0,0 +1,177 @@
+/*****************************************************************************/
+/**
+* \file	Framer.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Splits received serial data into frames.
+*
+* A framer is fed the unconsumed data of the read buffer and returns one frame
+* at a time. Frames failing their checksum are dropped and counted, so only
+* valid payloads reach the message queue.
+*
+* The checksum, if any, is calculated over the payload and sent after it,
+* most significant byte first.
+*
+******************************************************************************/
+class Framer
+{
+public:
+
+	/**
+	* Frame checksum.
+	*/
+	enum Checksum
+	{
+		checksumNone,	///< No checksum.
+		checksumCrc16,	///< CRC-16/CCITT-FALSE, 2 bytes.
+		checksumCrc32	///< CRC-32, 4 bytes.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param checksum Frame checksum.
+	*
+	******************************************************************************/
+	explicit Framer(Checksum checksum);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor
+	*
+	*****************************************************************************/
+	virtual ~Framer();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Extract the next frame.
+	*
+	* \param data Unconsumed data. Must start with the data given to the previous
+	* call unless that call consumed data or reset() was called.
+	* \param size Nr of bytes in data.
+	* \param[out] frame New string holding the payload, or nullptr if the
+	* consumed data did not hold a valid frame. The caller owns the string.
+	*
+	* \return Nr of bytes consumed from data. 0 if more data is needed.
+	*
+	******************************************************************************/
+	virtual std::size_t extract(const char *data, std::size_t size, std::string *&frame) = 0;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Encode a payload into a frame, e.g. for sending.
+	*
+	* \param payload Payload.
+	*
+	* \return The frame.
+	*
+	******************************************************************************/
+	virtual std::string encode(const std::string& payload) const = 0;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Forget any partial frame state. Called when the read buffer is discarded.
+	*
+	******************************************************************************/
+	virtual void reset();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of frames dropped because of checksum or format errors.
+	*
+	******************************************************************************/
+	std::uint64_t droppedFrames() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the frame checksum.
+	*
+	******************************************************************************/
+	Checksum checksum() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of bytes of a binary checksum.
+	*
+	* \param checksum Frame checksum.
+	*
+	******************************************************************************/
+	static std::size_t checksumSize(Checksum checksum);
+
+protected:
+
+	/*****************************************************************************/
+	/**
+	* \brief Verify the checksum at the end of a frame body.
+	*
+	* \param data Frame body, payload followed by checksum.
+	* \param size Nr of bytes in data.
+	* \param hex True if the checksum is sent as upper case hex digits.
+	*
+	* \return true if the checksum matches.
+	*
+	******************************************************************************/
+	bool verify(const char *data, std::size_t size, bool hex = false) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Verify the checksum at the end of a frame body and make the payload string.
+	*
+	* Counts the frame as dropped if the checksum does not match.
+	*
+	* \param data Frame body, payload followed by checksum.
+	* \param size Nr of bytes in data.
+	* \param hex True if the checksum is sent as upper case hex digits.
+	*
+	* \return New string holding the payload, or nullptr.
+	*
+	******************************************************************************/
+	std::string *accept(const char *data, std::size_t size, bool hex = false);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Append the checksum of a payload.
+	*
+	* \param[in,out] body Payload to append the checksum to.
+	* \param hex True to append the checksum as upper case hex digits.
+	*
+	******************************************************************************/
+	void appendChecksum(std::string& body, bool hex = false) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Count a dropped frame.
+	*
+	******************************************************************************/
+	void drop();
+
+private:
+
+	Checksum checksum_;			///< Frame checksum.
+	std::atomic<std::uint64_t> dropped_;	///< Nr of dropped frames. Read by other threads.
+};
@@ -0,0 +1,110 @@
+/*****************************************************************************/
+/**
+* \file	LatencyProbe.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "LatencyProbe.hpp"
+#include <chrono>
+
+
+LatencyProbe::LatencyProbe(const std::string& name, std::ostream *dumpAtExit) :
+	name_(name),
+	dumpAtExit_(dumpAtExit),
+	pushSeq_(0),
+	popSeq_(0),
+	unmatched_(0)
+{
+	for (Stamps& s : ring_)
+	{
+		s.seq.store(0, std::memory_order_relaxed);
+		s.read.store(0, std::memory_order_relaxed);
+		s.push.store(0, std::memory_order_relaxed);
+	}
+}
+
+LatencyProbe::~LatencyProbe()
+{
+	if (dumpAtExit_ != nullptr)
+	{
+		dump(*dumpAtExit_);
+	}
+}
+
+std::int64_t LatencyProbe::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyProbe::pushing(std::int64_t readTime, std::int64_t extractTime)
+{
+	const std::int64_t pushTime = now();
+	histograms_[readToExtract].record(extractTime - readTime);
+	histograms_[extractToPush].record(pushTime - extractTime);
+
+	// the queue push that follows publishes the slot to the consumer
+	Stamps& s = ring_[pushSeq_ & (RING_SIZE - 1)];
+	s.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	s.read.store(readTime, std::memory_order_relaxed);
+	s.push.store(pushTime, std::memory_order_relaxed);
+	s.seq.store(++pushSeq_, std::memory_order_release);
+}
+
+void LatencyProbe::popped()
+{
+	const std::int64_t popTime = now();
+	const std::uint64_t seq = ++popSeq_;
+	Stamps& s = ring_[(seq - 1) & (RING_SIZE - 1)];
+
+	if (s.seq.load(std::memory_order_acquire) == seq)
+	{
+		const std::int64_t readTime = s.read.load(std::memory_order_relaxed);
+		const std::int64_t pushTime = s.push.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (s.seq.load(std::memory_order_relaxed) == seq)
+		{
+			histograms_[pushToPop].record(popTime - pushTime);
+			histograms_[readToPop].record(popTime - readTime);
+			return;
+		}
+	}
+	unmatched_.fetch_add(1, std::memory_order_relaxed);
+}
+
+const LatencyHistogram& LatencyProbe::histogram(Interval interval) const
+{
+	return histograms_[interval];
+}
+
+std::uint64_t LatencyProbe::unmatched() const
+{
+	return unmatched_.load(std::memory_order_relaxed);
+}
+
+void LatencyProbe::dump(std::ostream& out) const
+{
+	static const char *const names[INTERVALS] = { "read->extract", "extract->push", "push->pop", "read->pop" };
+	for (int i = 0; i < INTERVALS; ++i)
+	{
+		histograms_[i].print(out, name_ + " " + names[i]);
+	}
+	if (unmatched() > 0)
+	{
+		out << name_ << " unmatched: " << unmatched() << std::endl;
+	}
+}
+
+void LatencyProbe::reset()
+{
+	for (LatencyHistogram& h : histograms_)
+	{
+		h.reset();
+	}
+	unmatched_.store(0, std::memory_order_relaxed);
+}
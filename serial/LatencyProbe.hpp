@@ -0,0 +1,159 @@
+/*****************************************************************************/
+/**
+* \file	LatencyProbe.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "LatencyHistogram.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Per message latency through the serial receive path of one port.
+*
+* Each message is stamped when its read completed, when the framer returned
+* it, when it was pushed and when the consumer popped it. The stamps travel
+* alongside the message in a fixed ring indexed by queue position, so the
+* queue element type stays std::string * and nothing is allocated. This
+* relies on one consumer popping every message of the queue in order and
+* calling popped() for each. Messages the ring overran are counted as
+* unmatched.
+*
+* The intervals go into lock-free histograms, see dump().
+*
+******************************************************************************/
+class LatencyProbe : private boost::noncopyable
+{
+public:
+
+	/**
+	* Measured intervals
+	*/
+	enum Interval
+	{
+		readToExtract,		///< Read completion to framer.
+		extractToPush,		///< Framer to queue push.
+		pushToPop,			///< Time in queue.
+		readToPop,			///< Total.
+		INTERVALS
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param name Port name, used by dump().
+	* \param dumpAtExit Stream to dump on when destroyed. Default: none.
+	*
+	******************************************************************************/
+	explicit LatencyProbe(const std::string& name, std::ostream *dumpAtExit = nullptr);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Dumps if requested.
+	*
+	*****************************************************************************/
+	~LatencyProbe();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the current time, steady clock nanoseconds.
+	*
+	******************************************************************************/
+	static std::int64_t now();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Stamp the next message, just before it is pushed. Reader thread only.
+	*
+	* \param readTime When the read holding the end of the message completed.
+	* \param extractTime When the framer returned the message.
+	*
+	******************************************************************************/
+	void pushing(std::int64_t readTime, std::int64_t extractTime);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Stamp the message just popped. Consumer thread only.
+	*
+	******************************************************************************/
+	void popped();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the histogram of an interval.
+	*
+	******************************************************************************/
+	const LatencyHistogram& histogram(Interval interval) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of popped messages whose stamps were overwritten.
+	*
+	******************************************************************************/
+	std::uint64_t unmatched() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Print all histograms, one line each.
+	*
+	* \param out Stream to print on.
+	*
+	******************************************************************************/
+	void dump(std::ostream& out) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Clear the histograms.
+	*
+	******************************************************************************/
+	void reset();
+
+private:
+
+	/**
+	* Probe settings
+	*/
+	enum Settings
+	{
+		RING_SIZE = 4096,	///< Max nr of stamped messages in the queue. Power of two.
+	};
+
+	/**
+	* Stamps of a queued message. seq is written last, so a consumer can tell
+	* a complete slot of its message from one being overwritten.
+	*/
+	struct Stamps
+	{
+		std::atomic<std::uint64_t> seq;		///< Queue position + 1, 0 while being written.
+		std::atomic<std::int64_t> read;		///< Read completion time.
+		std::atomic<std::int64_t> push;		///< Push time.
+	};
+
+
+	std::string name_;								///< Port name.
+	std::ostream *dumpAtExit_;						///< Dump on destruction. May be nullptr.
+	Stamps ring_[RING_SIZE];						///< Stamps by queue position.
+	std::uint64_t pushSeq_;							///< Nr of pushed messages. Reader thread only.
+	std::uint64_t popSeq_;							///< Nr of popped messages. Consumer thread only.
+	LatencyHistogram histograms_[INTERVALS];		///< Histogram per interval.
+	std::atomic<std::uint64_t> unmatched_;			///< Popped messages without stamps.
+};
@@ -0,0 +1,80 @@
+/*****************************************************************************/
+/**
+* \file	LengthPrefixFramer.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "LengthPrefixFramer.hpp"
+#include <stdexcept>
+
+
+LengthPrefixFramer::LengthPrefixFramer(std::size_t lengthSize, Checksum checksum, std::size_t maxPayload) :
+	Framer(checksum),
+	lengthSize_(lengthSize),
+	maxPayload_(maxPayload),
+	resync_(false)
+{
+	if (lengthSize != 1 && lengthSize != 2 && lengthSize != 4)
+	{
+		throw std::invalid_argument("LengthPrefixFramer: length field must be 1, 2 or 4 bytes");
+	}
+}
+
+std::size_t LengthPrefixFramer::extract(const char *data, std::size_t size, std::string *&frame)
+{
+	frame = nullptr;
+	if (size < lengthSize_)
+	{
+		return 0;
+	}
+
+	std::size_t length = 0;
+	for (std::size_t i = 0; i < lengthSize_; ++i)
+	{
+		length = (length << 8) | static_cast<std::uint8_t>(data[i]);
+	}
+	const std::size_t frameSize = lengthSize_ + length + checksumSize(checksum());
+	if (length <= maxPayload_ && size < frameSize)
+	{
+		return 0;
+	}
+
+	if (length > maxPayload_ || !verify(data + lengthSize_, frameSize - lengthSize_))
+	{
+		if (!resync_)
+		{
+			drop();
+			resync_ = true;
+		}
+		return 1;	// try the next byte as a length
+	}
+
+	// verified above, so not through accept(), which would compute the checksum again
+	resync_ = false;
+	frame = new std::string(data + lengthSize_, length);
+	return frameSize;
+}
+
+void LengthPrefixFramer::reset()
+{
+	resync_ = false;
+}
+
+std::string LengthPrefixFramer::encode(const std::string& payload) const
+{
+	std::string frame;
+	frame.reserve(lengthSize_ + payload.size() + checksumSize(checksum()));
+	for (std::size_t i = lengthSize_; i > 0; --i)
+	{
+		frame += static_cast<char>(static_cast<std::uint64_t>(payload.size()) >> (8 * (i - 1)));
+	}
+
+	std::string body(payload);
+	appendChecksum(body);
+	frame += body;
+	return frame;
+}
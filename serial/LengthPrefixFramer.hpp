@@ -0,0 +1,53 @@
+/*****************************************************************************/
+/**
+* \file	LengthPrefixFramer.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "Framer.hpp"
+
+/*****************************************************************************/
+/**
+* \brief Binary frames preceded by their length.
+*
+* Frame: payload length (1, 2 or 4 bytes, most significant byte first),
+* payload, checksum. The length does not include itself or the checksum.
+* A length above the max payload size or a checksum error is taken as a lost
+* frame boundary; one byte is skipped and the next byte is tried as a length
+* until a frame passes the checksum again. Each such loss counts as one
+* dropped frame. Keep the max payload size as tight as the protocol allows,
+* since a bogus length below it stalls the resynchronization until that many
+* bytes have arrived.
+*
+******************************************************************************/
+class LengthPrefixFramer : public Framer
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param lengthSize Nr of bytes of the length field: 1, 2 or 4. Default: 2.
+	* \param checksum Frame checksum. Default: CRC-16.
+	* \param maxPayload Max payload size. Default: 65535.
+	*
+	******************************************************************************/
+	explicit LengthPrefixFramer(std::size_t lengthSize = 2, Checksum checksum = checksumCrc16,
+		std::size_t maxPayload = 65535);
+
+	std::size_t extract(const char *data, std::size_t size, std::string *&frame) override;
+	std::string encode(const std::string& payload) const override;
+	void reset() override;
+
+private:
+
+	std::size_t lengthSize_;	///< Nr of bytes of the length field.
+	std::size_t maxPayload_;	///< Max payload size.
+	bool resync_;				///< True while searching for a frame boundary.
+};
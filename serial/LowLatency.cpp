@@ -0,0 +1,117 @@
+/*****************************************************************************/
+/**
+* \file	LowLatency.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "LowLatency.hpp"
+#include <cerrno>
+#include <cstring>
+#include <linux/serial.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+
+/**
+* Appends "<setting>: applied" or "<setting>: not applied, <reason>" to the report.
+*/
+static bool addReport(std::vector<std::string>& report, const std::string& setting, int error)
+{
+	report.push_back(setting + (error == 0 ? ": applied" : ": not applied, " + std::string(std::strerror(error))));
+	return error == 0;
+}
+
+LowLatencyProfile LowLatencyProfile::defaults()
+{
+	LowLatencyProfile profile;
+	profile.asyncLowLatency = true;
+	profile.vmin = 1;
+	profile.vtime = 0;
+	profile.cpu = -1;
+	profile.fifoPriority = 0;
+	return profile;
+}
+
+bool applyPortTuning(int fd, const LowLatencyProfile& profile, std::vector<std::string>& report)
+{
+	bool success = true;
+
+	if (profile.asyncLowLatency)
+	{
+		struct serial_struct serial;
+		int error = 0;
+		if (ioctl(fd, TIOCGSERIAL, &serial) != 0)
+		{
+			error = errno;
+		}
+		else if (!(serial.flags & ASYNC_LOW_LATENCY))
+		{
+			serial.flags |= ASYNC_LOW_LATENCY;
+			if (ioctl(fd, TIOCSSERIAL, &serial) != 0)
+			{
+				error = errno;
+			}
+		}
+		success &= addReport(report, "ASYNC_LOW_LATENCY", error);
+	}
+
+	if (profile.vmin >= 0 || profile.vtime >= 0)
+	{
+		struct termios tio;
+		int error = 0;
+		if (tcgetattr(fd, &tio) != 0)
+		{
+			error = errno;
+		}
+		else
+		{
+			if (profile.vmin >= 0)
+			{
+				tio.c_cc[VMIN] = static_cast<cc_t>(profile.vmin);
+			}
+			if (profile.vtime >= 0)
+			{
+				tio.c_cc[VTIME] = static_cast<cc_t>(profile.vtime);
+			}
+			if (tcsetattr(fd, TCSANOW, &tio) != 0)
+			{
+				error = errno;
+			}
+		}
+		success &= addReport(report, "VMIN " + std::to_string(profile.vmin) + " VTIME " + std::to_string(profile.vtime), error);
+	}
+	return success;
+}
+
+bool applyThreadTuning(const LowLatencyProfile& profile, std::vector<std::string>& report)
+{
+	bool success = true;
+
+	if (profile.cpu >= 0)
+	{
+		int error = EINVAL;
+		if (profile.cpu < CPU_SETSIZE)
+		{
+			cpu_set_t cpus;
+			CPU_ZERO(&cpus);
+			CPU_SET(profile.cpu, &cpus);
+			error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		}
+		success &= addReport(report, "CPU " + std::to_string(profile.cpu), error);
+	}
+
+	if (profile.fifoPriority > 0)
+	{
+		struct sched_param param = sched_param();
+		param.sched_priority = profile.fifoPriority;
+		success &= addReport(report, "SCHED_FIFO " + std::to_string(profile.fifoPriority),
+			pthread_setschedparam(pthread_self(), SCHED_FIFO, &param));
+	}
+	return success;
+}
@@ -0,0 +1,66 @@
+/*****************************************************************************/
+/**
+* \file	LowLatency.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Low latency tuning of a serial port and of the thread reading it.
+*
+* Every setting is best effort: one that cannot be applied, e.g.
+* ASYNC_LOW_LATENCY on a USB adapter or pseudo-terminal, or SCHED_FIFO
+* without privileges, is reported and the rest still apply.
+*
+******************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+* Low latency settings. Negative values leave a setting as it is.
+*/
+struct LowLatencyProfile
+{
+	bool asyncLowLatency;	///< Set ASYNC_LOW_LATENCY with TIOCSSERIAL, i.e. no receive FIFO batching in the driver.
+	int vmin;				///< termios VMIN, min nr of bytes per read.
+	int vtime;				///< termios VTIME, inter-byte timeout in tenths of a second.
+	int cpu;				///< CPU to pin the Serial thread to.
+	int fifoPriority;		///< SCHED_FIFO priority of the Serial thread, 1 - 99. 0 leaves the policy.
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the recommended profile: ASYNC_LOW_LATENCY, VMIN 1,
+	* VTIME 0, no pinning and no real-time priority.
+	*
+	******************************************************************************/
+	static LowLatencyProfile defaults();
+};
+
+
+/*****************************************************************************/
+/**
+* \brief Apply the port settings of a profile.
+*
+* \param fd Open serial port.
+* \param profile Settings.
+* \param[out] report One line per setting, appended.
+*
+* \return true if all settings were applied.
+*
+******************************************************************************/
+bool applyPortTuning(int fd, const LowLatencyProfile& profile, std::vector<std::string>& report);
+
+
+/*****************************************************************************/
+/**
+* \brief Apply the thread settings of a profile to the calling thread.
+*
+* \param profile Settings.
+* \param[out] report One line per setting, appended.
+*
+* \return true if all settings were applied.
+*
+******************************************************************************/
+bool applyThreadTuning(const LowLatencyProfile& profile, std::vector<std::string>& report);
@@ -0,0 +1,77 @@
+/*****************************************************************************/
+/**
+* \file	PseudoTerminal.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "PseudoTerminal.hpp"
+#include <boost/system/system_error.hpp>
+#include <cerrno>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+PseudoTerminal::PseudoTerminal() :
+	master_(-1),
+	slave_(-1),
+	slaveName_()
+{
+	struct termios raw = termios();
+	cfmakeraw(&raw);
+	raw.c_cflag |= CREAD | CLOCAL;
+	char name[256];
+	if (openpty(&master_, &slave_, name, &raw, nullptr) != 0)
+	{
+		throw boost::system::system_error(errno, boost::system::system_category(), "openpty");
+	}
+	slaveName_ = name;
+}
+
+PseudoTerminal::~PseudoTerminal()
+{
+	if (master_ >= 0)
+	{
+		::close(master_);
+	}
+	::close(slave_);
+}
+
+int PseudoTerminal::master() const
+{
+	return master_;
+}
+
+int PseudoTerminal::releaseMaster()
+{
+	const int fd = master_;
+	master_ = -1;
+	return fd;
+}
+
+const std::string& PseudoTerminal::slaveName() const
+{
+	return slaveName_;
+}
+
+void PseudoTerminal::write(const char *data, std::size_t size)
+{
+	while (size > 0)
+	{
+		const ssize_t n = ::write(master_, data, size);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw boost::system::system_error(errno, boost::system::system_category(), "write");
+		}
+		data += n;
+		size -= static_cast<std::size_t>(n);
+	}
+}
@@ -0,0 +1,93 @@
+/*****************************************************************************/
+/**
+* \file	PseudoTerminal.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief A pseudo-terminal pair standing in for a serial line.
+*
+* The slave device is opened by name like a serial port, e.g. by
+* TimeoutSerialThread. The master side plays the serial device. Both sides
+* are put in raw mode. The slave is kept open as well, so the master does not
+* see a hangup while the user of the slave device reopens it.
+*
+******************************************************************************/
+class PseudoTerminal : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Opens the pair.
+	*
+	* \throws boost::system::system_error if any error
+	*
+	******************************************************************************/
+	PseudoTerminal();
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Closes both sides.
+	*
+	*****************************************************************************/
+	~PseudoTerminal();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the descriptor of the master side.
+	*
+	******************************************************************************/
+	int master() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Take over the master descriptor, e.g. to assign it to a TimeoutSerialThread.
+	*
+	* The destructor no longer closes it.
+	*
+	* \return The master descriptor.
+	*
+	******************************************************************************/
+	int releaseMaster();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the name of the slave device, e.g. /dev/pts/3.
+	*
+	******************************************************************************/
+	const std::string& slaveName() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Write all data to the master side.
+	*
+	* \param data Data.
+	* \param size Nr of bytes.
+	*
+	* \throws boost::system::system_error if any error
+	*
+	******************************************************************************/
+	void write(const char *data, std::size_t size);
+
+private:
+
+	int master_;				///< Master descriptor.
+	int slave_;					///< Slave descriptor, held open.
+	std::string slaveName_;		///< Slave device name.
+};
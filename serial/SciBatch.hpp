@@ -0,0 +1,66 @@
+/*****************************************************************************/
+/**
+* \file	SciBatch.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief One field of a parameter set, for all rows of a batch.
+*
+* Only the vector matching the type is used.
+*
+******************************************************************************/
+struct SciColumn
+{
+	/**
+	* Field types
+	*/
+	enum Type
+	{
+		typeInteger,	///< Decimal integer.
+		typeReal,		///< Decimal with fraction or exponent.
+		typeText		///< Anything else.
+	};
+
+	Type type;							///< Field type.
+	std::vector<std::int64_t> integers;	///< Values of an integer field.
+	std::vector<double> reals;			///< Values of a real field.
+	std::vector<std::string> texts;		///< Values of a text field.
+};
+
+/*****************************************************************************/
+/**
+* \brief Parsed SCI responses of one parameter set, struct-of-arrays.
+*
+* A parameter set is identified by the first token of the response, its tag,
+* and has the same nr and types of fields in every row. Passed by pointer
+* through a ThreadSafeQueue; the consumer deletes it.
+*
+******************************************************************************/
+struct SciBatch
+{
+	std::string tag;					///< First token of the responses.
+	std::vector<std::int64_t> times;	///< Receive time per row, steady clock nanoseconds.
+	std::vector<SciColumn> columns;		///< One column per field after the tag.
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of rows.
+	*
+	******************************************************************************/
+	std::size_t rows() const
+	{
+		return times.size();
+	}
+};
@@ -0,0 +1,267 @@
+/*****************************************************************************/
+/**
+* \file	SciClient.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "SciClient.hpp"
+#include <algorithm>
+
+
+SciClient::SciClient(TimeoutSerialThread& port, MessageQueue<std::string *>& responses,
+	const std::string& terminator, std::size_t window) :
+	port_(port),
+	responses_(responses),
+	terminator_(terminator),
+	window_(std::max<std::size_t>(window, 1)),
+	matcher_(),
+	probe_(nullptr),
+	inFlight_(),
+	nextId_(0),
+	statistics_(),
+	latency_(),
+	isAlive_(true),
+	stopRequested_(false)
+{
+}
+
+SciClient::~SciClient()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	for (Request& r : inFlight_)
+	{
+		if (!r.timedOut)
+		{
+			r.promise.set_exception(std::make_exception_ptr(
+				boost::system::system_error(boost::asio::error::operation_aborted)));
+		}
+	}
+	inFlight_.clear();
+}
+
+std::future<std::string> SciClient::send(const std::string& command, std::uint32_t milliSeconds)
+{
+	const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(milliSeconds);
+
+	std::unique_lock<std::mutex> lock{ mutex_ };
+	Request request;
+	request.id = nextId_++;
+	request.command = command;
+	request.deadline = deadline;
+	request.expiry = deadline + std::chrono::milliseconds(milliSeconds);
+	request.timedOut = false;
+	std::future<std::string> result = request.promise.get_future();
+
+	if (!windowSpace_.wait_until(lock, deadline, [this]() {return !isAlive_ || inFlight_.size() < window_;}))
+	{
+		++statistics_.timedOut;
+		request.promise.set_exception(std::make_exception_ptr(timeout_exception("SciClient: window full")));
+		return result;
+	}
+	if (!isAlive_)
+	{
+		++statistics_.failed;
+		request.promise.set_exception(std::make_exception_ptr(
+			boost::system::system_error(boost::asio::error::operation_aborted)));
+		return result;
+	}
+
+	// queue the request before writing, the response may arrive before asyncWrite returns
+	const std::uint64_t id = request.id;
+	request.sent = Clock::now();
+	inFlight_.push_back(std::move(request));
+
+	// writing under the lock keeps the write order equal to the window order
+	bool queued = port_.asyncWrite(command + terminator_,
+		[this, id](const boost::system::error_code& error, std::size_t)
+	{
+		if (error)
+		{
+			writeFailed(id, error);
+		}
+	});
+
+	if (queued)
+	{
+		++statistics_.sent;
+	}
+	else
+	{
+		lock.unlock();
+		writeFailed(id, boost::asio::error::no_buffer_space);
+	}
+	return result;
+}
+
+void SciClient::setWindow(std::size_t window)
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	window_ = std::max<std::size_t>(window, 1);
+	windowSpace_.notify_all();
+}
+
+void SciClient::setMatcher(const Matcher& matcher)
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	matcher_ = matcher;
+}
+
+void SciClient::setLatencyProbe(LatencyProbe *probe)
+{
+	probe_ = probe;
+}
+
+std::size_t SciClient::outstanding() const
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return inFlight_.size();
+}
+
+SciClient::Statistics SciClient::statistics() const
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return statistics_;
+}
+
+const LatencyHistogram& SciClient::latency() const
+{
+	return latency_;
+}
+
+void SciClient::operator()()
+{
+	while (!stopRequested_)
+	{
+		std::string *response = nullptr;
+		if (responses_.waitPop(response, POLL_TIMEOUT))
+		{
+			if (probe_ != nullptr)
+			{
+				probe_->popped();
+			}
+			dispatch(*response);
+			delete response;
+		}
+		expire();
+	}
+
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	isAlive_ = false;
+	for (Request& r : inFlight_)
+	{
+		if (!r.timedOut)
+		{
+			++statistics_.failed;
+			r.promise.set_exception(std::make_exception_ptr(
+				boost::system::system_error(boost::asio::error::operation_aborted)));
+		}
+	}
+	inFlight_.clear();
+	windowSpace_.notify_all();
+}
+
+bool SciClient::isAlive()
+{
+	return isAlive_;
+}
+
+void SciClient::requestStop()
+{
+	stopRequested_ = true;
+}
+
+void SciClient::dispatch(std::string& response)
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	if (inFlight_.empty())
+	{
+		++statistics_.unsolicited;
+		return;
+	}
+
+	std::deque<Request>::iterator match = inFlight_.begin();
+	if (matcher_)
+	{
+		match = std::find_if(inFlight_.begin(), inFlight_.end(),
+			[this, &response](const Request& r) {return matcher_(r.command, response);});
+		if (match == inFlight_.end())
+		{
+			++statistics_.unsolicited;
+			return;
+		}
+	}
+
+	// commands before the match will never be answered
+	for (std::deque<Request>::iterator it = inFlight_.begin(); it != match; ++it)
+	{
+		if (!it->timedOut)
+		{
+			++statistics_.timedOut;
+			it->promise.set_exception(std::make_exception_ptr(timeout_exception("SciClient: no response")));
+		}
+	}
+
+	if (match->timedOut)
+	{
+		++statistics_.late;
+	}
+	else
+	{
+		++statistics_.completed;
+		latency_.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - match->sent).count());
+		match->promise.set_value(std::move(response));
+	}
+	inFlight_.erase(inFlight_.begin(), match + 1);
+	windowSpace_.notify_all();
+}
+
+void SciClient::expire()
+{
+	const Clock::time_point now = Clock::now();
+	std::lock_guard<std::mutex> lock{ mutex_ };
+
+	for (Request& r : inFlight_)
+	{
+		if (!r.timedOut && r.deadline <= now)
+		{
+			++statistics_.timedOut;
+			r.timedOut = true;
+			r.promise.set_exception(std::make_exception_ptr(timeout_exception("SciClient: no response")));
+		}
+	}
+
+	// only the oldest can be dropped without breaking the order of the others
+	bool dropped = false;
+	while (!inFlight_.empty() && inFlight_.front().timedOut && inFlight_.front().expiry <= now)
+	{
+		inFlight_.pop_front();
+		dropped = true;
+	}
+	if (dropped)
+	{
+		windowSpace_.notify_all();
+	}
+}
+
+void SciClient::writeFailed(std::uint64_t id, const boost::system::error_code& error)
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	std::deque<Request>::iterator it = std::find_if(inFlight_.begin(), inFlight_.end(),
+		[id](const Request& r) {return r.id == id;});
+	if (it == inFlight_.end())
+	{
+		return;
+	}
+
+	++statistics_.failed;
+	if (!it->timedOut)
+	{
+		it->promise.set_exception(std::make_exception_ptr(boost::system::system_error(error)));
+	}
+	inFlight_.erase(it);
+	windowSpace_.notify_all();
+}
@@ -0,0 +1,270 @@
+/*****************************************************************************/
+/**
+* \file	SciClient.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "TimeoutSerialThread.hpp"
+#include "MessageQueue.hpp"
+#include "LatencyHistogram.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Pipelined SCI command/response client.
+*
+* Sends commands through the asynchronous write queue of a TimeoutSerialThread
+* and keeps up to a window of commands in flight. The device answers SCI
+* commands in order, so each delimited response popped from the reader queue
+* completes the oldest outstanding command.
+*
+* A command that is not answered in time completes with timeout_exception but
+* stays in the window, so its late response is discarded instead of being
+* matched to the next command. A late response that has not arrived within
+* twice the command timeout is considered lost.
+*
+* A command the device drops silently shifts the in-order matching. If the
+* responses identify their command, set a matcher with setMatcher(); the
+* oldest command accepted by the matcher is then completed and the commands
+* skipped before it fail with timeout_exception.
+*
+* The response dispatch runs in operator(), which must be run in a thread of
+* its own. The client must be the only consumer of the response queue, and
+* the Serial thread of the port must be stopped before the client is destroyed.
+*
+******************************************************************************/
+class SciClient : private boost::noncopyable
+{
+public:
+
+	/**
+	* Returns true if the response (second argument) answers the command (first argument).
+	*/
+	typedef std::function<bool(const std::string&, const std::string&)> Matcher;
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param port Serial device used to send the commands. Its Serial thread must be running.
+	* \param responses Queue the reader posts the responses into.
+	* \param terminator Appended to each command. Default: carriage return.
+	* \param window Max nr of commands in flight. Default: DEFAULT_WINDOW.
+	*
+	******************************************************************************/
+	SciClient(TimeoutSerialThread& port, MessageQueue<std::string *>& responses,
+		const std::string& terminator = "\r", std::size_t window = DEFAULT_WINDOW);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Fails all commands still in flight.
+	*
+	*****************************************************************************/
+	~SciClient();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Send a command.
+	*
+	* Blocks while the window is full, at most for the command timeout.
+	*
+	* \param command SCI command, without terminator.
+	* \param milliSeconds Command timeout, from the call until the response is received.
+	*
+	* \return Future holding the response. Throws timeout_exception if the
+	* command timed out and boost::system::system_error if it could not be sent.
+	*
+	******************************************************************************/
+	std::future<std::string> send(const std::string& command, std::uint32_t milliSeconds = DEFAULT_COMMAND_TIMEOUT);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set the max nr of commands in flight.
+	*
+	* \param window Window size. 1 gives one round trip per command.
+	*
+	******************************************************************************/
+	void setWindow(std::size_t window);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set the response matcher. An empty matcher gives strict in-order matching.
+	*
+	* \param matcher Response matcher.
+	*
+	******************************************************************************/
+	void setMatcher(const Matcher& matcher);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Report each popped response to a latency probe.
+	*
+	* Set before the dispatch thread is started, to the probe set on the port.
+	*
+	* \param probe Latency probe. Not owned. nullptr for none.
+	*
+	******************************************************************************/
+	void setLatencyProbe(LatencyProbe *probe);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of commands in flight, including timed out commands
+	* still waiting for their late response.
+	*
+	******************************************************************************/
+	std::size_t outstanding() const;
+
+
+	/**
+	* Client counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t sent;			///< Commands written.
+		std::uint64_t completed;	///< Commands answered in time.
+		std::uint64_t timedOut;		///< Commands not answered in time.
+		std::uint64_t failed;		///< Commands that could not be written.
+		std::uint64_t late;			///< Responses discarded because their command timed out.
+		std::uint64_t unsolicited;	///< Responses received with no command in flight.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the client counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the latency of the commands answered in time, from queueing
+	* the write until the response is matched.
+	*
+	* Recorded by the dispatch thread, so it leaves out the wait for a window slot
+	* and how late the caller collects the future.
+	*
+	******************************************************************************/
+	const LatencyHistogram& latency() const;
+
+
+	/****************************************************************************/
+	/**
+	* \brief Response dispatch thread.
+	*
+	* Pops responses, completes the matching commands and expires commands
+	* whose timeout passed. Fails all commands in flight when stopped.
+	*
+	*****************************************************************************/
+	void operator()();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the dispatch thread is alive.
+	*
+	******************************************************************************/
+	bool isAlive();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set stop flag for the dispatch thread.
+	*
+	******************************************************************************/
+	void requestStop();
+
+	/**
+	* Client settings
+	*/
+	enum Settings
+	{
+		DEFAULT_WINDOW = 8,				///< Default max nr of commands in flight.
+		DEFAULT_COMMAND_TIMEOUT = 1000,	///< Default command timeout in milliseconds.
+		POLL_TIMEOUT = 10,				///< Max time in milliseconds between timeout checks.
+	};
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	/**
+	* A command in flight.
+	*/
+	struct Request
+	{
+		std::uint64_t id;					///< Sequence nr, used to find the request on write errors.
+		std::string command;				///< Command, without terminator.
+		std::promise<std::string> promise;	///< Completed with the response.
+		Clock::time_point sent;				///< Time the command was queued for writing.
+		Clock::time_point deadline;			///< Time the response is due.
+		Clock::time_point expiry;			///< Time a late response is considered lost.
+		bool timedOut;						///< True if the promise already holds timeout_exception.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Complete the oldest command with a response.
+	*
+	* \param response Received response.
+	*
+	******************************************************************************/
+	void dispatch(std::string& response);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Time out commands whose deadline passed and drop lost late responses.
+	*
+	******************************************************************************/
+	void expire();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Remove a command whose write failed.
+	*
+	* \param id Sequence nr of the command.
+	* \param error Write error.
+	*
+	******************************************************************************/
+	void writeFailed(std::uint64_t id, const boost::system::error_code& error);
+
+
+	TimeoutSerialThread& port_;				///< Serial device used to send commands.
+	MessageQueue<std::string *>& responses_;	///< Queue of received responses.
+	std::string terminator_;				///< Command terminator.
+	std::size_t window_;					///< Max nr of commands in flight.
+	Matcher matcher_;						///< Response matcher. May be empty.
+	LatencyProbe *probe_;					///< Latency probe of the responses. May be nullptr.
+	std::deque<Request> inFlight_;			///< Commands in flight, oldest first.
+	std::uint64_t nextId_;					///< Sequence nr of the next command.
+	Statistics statistics_;					///< Client counters.
+	mutable std::mutex mutex_;				///< Guards the members above.
+	std::condition_variable windowSpace_;	///< Signaled when a command leaves the window.
+	LatencyHistogram latency_;				///< Write to response latency. Lock-free.
+	std::atomic<bool> isAlive_;				///< True if the dispatch thread is alive.
+	std::atomic<bool> stopRequested_;		///< Request to terminate the dispatch thread.
+};
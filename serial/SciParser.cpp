@@ -0,0 +1,305 @@
+/*****************************************************************************/
+/**
+* \file	SciParser.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "SciParser.hpp"
+#include "FromChars.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+
+static std::int64_t nowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SciParser::SciParser(MessageQueue<std::string *>& input, ThreadSafeQueue<SciBatch *>& output, std::size_t batchRows) :
+	input_(input),
+	output_(output),
+	batchRows_(std::max<std::size_t>(batchRows, 1)),
+	open_(),
+	fields_(),
+	popped_(),
+	oldest_(0),
+	last_(0),
+	idleTimeout_(static_cast<std::int64_t>(IDLE_TIMEOUT) * 1000000),
+	maxAge_(static_cast<std::int64_t>(MAX_BATCH_AGE) * 1000000),
+	isAlive_(true),
+	stopRequested_(false),
+	responses_(0),
+	batches_(0),
+	empty_(0)
+{
+}
+
+SciParser::~SciParser()
+{
+	for (std::map<std::string, SciBatch *>::value_type& b : open_)
+	{
+		delete b.second;
+	}
+}
+
+void SciParser::setFlushTimeouts(std::uint32_t idleTimeout, std::uint32_t maxAge)
+{
+	idleTimeout_ = static_cast<std::int64_t>(idleTimeout) * 1000000;
+	maxAge_ = static_cast<std::int64_t>(maxAge) * 1000000;
+}
+
+void SciParser::parse(const std::string& response, std::int64_t time)
+{
+	last_ = time;
+	const char *p = response.data();
+	const char *const end = p + response.size();
+
+	// tag
+	while (p != end && *p == ' ')
+	{
+		++p;
+	}
+	const char *tag = p;
+	while (p != end && *p != ' ')
+	{
+		++p;
+	}
+	if (p == tag)
+	{
+		++empty_;
+		return;
+	}
+	const std::string tagName(tag, p);
+
+	// fields, typed by what parses the whole token
+	fields_.clear();
+	for (;;)
+	{
+		while (p != end && *p == ' ')
+		{
+			++p;
+		}
+		if (p == end)
+		{
+			break;
+		}
+		const char *token = p;
+		while (p != end && *p != ' ')
+		{
+			++p;
+		}
+
+		Field f;
+		f.text = token;
+		f.size = static_cast<std::size_t>(p - token);
+		f.integer = 0;
+		f.real = 0;
+		// out of range is no number, an integer too long for 64 bits may still be a real
+		const FromCharsResult integer = fromChars(token, p, f.integer);
+		if (integer.ok && integer.ptr == p)
+		{
+			f.type = SciColumn::typeInteger;
+		}
+		else
+		{
+			f.integer = 0;
+			const FromCharsResult real = fromChars(token, p, f.real);
+			if (real.ok && real.ptr == p)
+			{
+				f.type = SciColumn::typeReal;
+			}
+			else
+			{
+				f.real = 0;
+				f.type = SciColumn::typeText;
+			}
+		}
+		fields_.push_back(f);
+	}
+
+	std::map<std::string, SciBatch *>::iterator batch = open_.find(tagName);
+	if (batch != open_.end() && !fits(*batch->second))
+	{
+		post(batch);
+		batch = open_.end();
+	}
+	if (batch == open_.end())
+	{
+		if (open_.size() >= MAX_OPEN_BATCHES)
+		{
+			flush();
+		}
+		if (open_.empty())
+		{
+			oldest_ = time;
+		}
+
+		SciBatch *b = new SciBatch;
+		b->tag = tagName;
+		b->times.reserve(batchRows_);
+		b->columns.resize(fields_.size());
+		for (std::size_t i = 0; i < fields_.size(); ++i)
+		{
+			b->columns[i].type = fields_[i].type;
+		}
+		batch = open_.insert(std::make_pair(tagName, b)).first;
+	}
+
+	SciBatch& b = *batch->second;
+	b.times.push_back(time);
+	for (std::size_t i = 0; i < fields_.size(); ++i)
+	{
+		const Field& f = fields_[i];
+		SciColumn& column = b.columns[i];
+		if (column.type == SciColumn::typeInteger && f.type == SciColumn::typeReal)
+		{
+			column.reals.assign(column.integers.begin(), column.integers.end());
+			column.integers.clear();
+			column.integers.shrink_to_fit();
+			column.type = SciColumn::typeReal;
+		}
+
+		switch (column.type)
+		{
+		case SciColumn::typeInteger:
+			column.integers.push_back(f.integer);
+			break;
+		case SciColumn::typeReal:
+			column.reals.push_back(f.type == SciColumn::typeInteger ? static_cast<double>(f.integer) : f.real);
+			break;
+		case SciColumn::typeText:
+			column.texts.push_back(std::string(f.text, f.size));
+			break;
+		}
+	}
+	++responses_;
+
+	if (b.rows() >= batchRows_)
+	{
+		post(batch);
+	}
+}
+
+void SciParser::flush()
+{
+	while (!open_.empty())
+	{
+		post(open_.begin());
+	}
+}
+
+void SciParser::operator()()
+{
+	while (!stopRequested_)
+	{
+		if (input_.waitPopBulk(popped_, POP_BULK, POLL_TIMEOUT) > 0)
+		{
+			for (std::string *response : popped_)
+			{
+				parse(*response, nowNs());
+				delete response;
+			}
+			popped_.clear();
+		}
+
+		// a quiet port does not hold its rows back, nor a slow parameter set for long
+		const std::int64_t now = nowNs();
+		if (!open_.empty() && now - last_ >= idleTimeout_)
+		{
+			flush();
+		}
+		else if (!open_.empty() && now - oldest_ >= maxAge_)
+		{
+			postOlderThan(now - maxAge_);
+		}
+	}
+
+	flush();
+	isAlive_ = false;
+}
+
+bool SciParser::isAlive()
+{
+	return isAlive_;
+}
+
+void SciParser::requestStop()
+{
+	stopRequested_ = true;
+}
+
+SciParser::Statistics SciParser::statistics() const
+{
+	Statistics s;
+	s.responses = responses_;
+	s.batches = batches_;
+	s.empty = empty_;
+	return s;
+}
+
+bool SciParser::fits(const SciBatch& batch) const
+{
+	if (batch.columns.size() != fields_.size())
+	{
+		return false;
+	}
+	for (std::size_t i = 0; i < fields_.size(); ++i)
+	{
+		const SciColumn::Type column = batch.columns[i].type;
+		const SciColumn::Type field = fields_[i].type;
+		const bool numeric = (column != SciColumn::typeText) && (field != SciColumn::typeText);
+		if (column != field && !numeric)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void SciParser::post(std::map<std::string, SciBatch *>::iterator batch)
+{
+	const bool oldest = batch->second->times.front() == oldest_;
+	output_.push(batch->second);
+	open_.erase(batch);
+	++batches_;
+
+	// the remaining batches keep their own age
+	if (oldest && !open_.empty())
+	{
+		oldest_ = open_.begin()->second->times.front();
+		for (std::map<std::string, SciBatch *>::value_type& b : open_)
+		{
+			oldest_ = std::min(oldest_, b.second->times.front());
+		}
+	}
+}
+
+void SciParser::postOlderThan(std::int64_t time)
+{
+	std::map<std::string, SciBatch *>::iterator batch = open_.begin();
+	while (batch != open_.end())
+	{
+		std::map<std::string, SciBatch *>::iterator next = std::next(batch);
+		if (batch->second->times.front() <= time)
+		{
+			post(batch);
+		}
+		batch = next;
+	}
+}
+
+std::string SciParser::tagOf(std::string *const& response)
+{
+	const std::string::size_type first = response->find_first_not_of(' ');
+	if (first == std::string::npos)
+	{
+		return std::string();
+	}
+	return response->substr(first, response->find(' ', first) - first);
+}
@@ -0,0 +1,217 @@
+/*****************************************************************************/
+/**
+* \file	SciParser.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "SciBatch.hpp"
+#include "ThreadSafeQueue.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Streaming parser of SCI responses into columnar batches.
+*
+* Runs as a stage after framing: pops response lines from the reader queue,
+* splits them on spaces into a tag and typed fields, and appends each to the
+* open batch of its parameter set. A batch is posted to the output queue when
+* it is full, when its parameter set changes shape, or when its first row is
+* older than the max batch age. All open batches are posted once no response
+* has arrived for the idle timeout, so a quiet port does not hold data back.
+*
+* A field is an integer if it fits 64 bits, else a real if it is in range
+* of a double, else text. An integer field that later holds a real makes
+* the column real. Any other change in the nr or types of fields starts a
+* new batch.
+*
+******************************************************************************/
+class SciParser : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param input Queue of response lines, e.g. of a TimeoutSerialThread.
+	* \param output Queue for the batches.
+	* \param batchRows Max nr of rows per batch.
+	*
+	******************************************************************************/
+	SciParser(MessageQueue<std::string *>& input, ThreadSafeQueue<SciBatch *>& output, std::size_t batchRows = BATCH_ROWS);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Discards open batches.
+	*
+	*****************************************************************************/
+	~SciParser();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set when the parser thread posts batches that are not full. Set before use.
+	*
+	* \param idleTimeout Time in milliseconds without responses before all open batches are posted.
+	* \param maxAge Max time in milliseconds from the first row of a batch until it is posted.
+	*
+	******************************************************************************/
+	void setFlushTimeouts(std::uint32_t idleTimeout = IDLE_TIMEOUT, std::uint32_t maxAge = MAX_BATCH_AGE);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Parse one response without the thread, e.g. from a replay consumer.
+	*
+	* \param response Response line, without delimiter.
+	* \param time Receive time, steady clock nanoseconds.
+	*
+	******************************************************************************/
+	void parse(const std::string& response, std::int64_t time);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Post all open batches.
+	*
+	******************************************************************************/
+	void flush();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Parser thread. Parses the input queue until stopped, then flushes.
+	*
+	******************************************************************************/
+	void operator()();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the parser thread is alive.
+	*
+	******************************************************************************/
+	bool isAlive();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set stop flag for the parser thread.
+	*
+	******************************************************************************/
+	void requestStop();
+
+
+	/**
+	* Parser counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t responses;	///< Responses parsed.
+		std::uint64_t batches;		///< Batches posted.
+		std::uint64_t empty;		///< Empty responses skipped.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the parser counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the tag of a response, its first token.
+	*
+	* Usable as the coalescing key of a bounded response queue, so only the
+	* latest response of each parameter set waits for the consumer:
+	*
+	*   queue.setCapacity(256, ThreadSafeQueue<std::string *>::overflowCoalesce,
+	*       [](std::string *& r) { delete r; }, &SciParser::tagOf);
+	*
+	******************************************************************************/
+	static std::string tagOf(std::string *const& response);
+
+	/**
+	* Parser settings
+	*/
+	enum Settings
+	{
+		BATCH_ROWS = 256,		///< Default max nr of rows per batch.
+		MAX_OPEN_BATCHES = 64,	///< Open batches beyond this are all posted.
+		POLL_TIMEOUT = 10,		///< Max time in milliseconds between flush and stop checks.
+		IDLE_TIMEOUT = 100,		///< Default time in milliseconds without responses before open batches are posted.
+		MAX_BATCH_AGE = 2000,	///< Default max age in milliseconds of the first row of an open batch.
+		POP_BULK = 64,			///< Max responses popped from the input at once.
+	};
+
+private:
+
+	/**
+	* A field of the response being parsed.
+	*/
+	struct Field
+	{
+		SciColumn::Type type;		///< Field type.
+		std::int64_t integer;		///< Value of an integer field.
+		double real;				///< Value of a real field.
+		const char *text;			///< Start of the field.
+		std::size_t size;			///< Nr of characters.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if fields_ can be appended to a batch.
+	*
+	******************************************************************************/
+	bool fits(const SciBatch& batch) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Post a batch and forget it.
+	*
+	******************************************************************************/
+	void post(std::map<std::string, SciBatch *>::iterator batch);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Post the open batches whose first row is older than a time.
+	*
+	* \param time Steady clock nanoseconds.
+	*
+	******************************************************************************/
+	void postOlderThan(std::int64_t time);
+
+
+	MessageQueue<std::string *>& input_;		///< Queue of response lines.
+	ThreadSafeQueue<SciBatch *>& output_;		///< Queue for the batches.
+	std::size_t batchRows_;						///< Max nr of rows per batch.
+	std::map<std::string, SciBatch *> open_;	///< Open batch per tag. Parser thread only.
+	std::vector<Field> fields_;					///< Fields of the response being parsed.
+	std::vector<std::string *> popped_;			///< Responses popped from the input at once.
+	std::int64_t oldest_;						///< First row time of the oldest open batch.
+	std::int64_t last_;							///< Time of the last response.
+	std::int64_t idleTimeout_;					///< Idle time in nanoseconds before open batches are posted.
+	std::int64_t maxAge_;						///< Max age in nanoseconds of an open batch.
+	std::atomic<bool> isAlive_;					///< True if the parser thread is alive.
+	std::atomic<bool> stopRequested_;			///< Request to terminate the parser thread.
+	std::atomic<std::uint64_t> responses_;		///< Responses parsed.
+	std::atomic<std::uint64_t> batches_;		///< Batches posted.
+	std::atomic<std::uint64_t> empty_;			///< Empty responses skipped.
+};
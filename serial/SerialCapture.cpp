@@ -0,0 +1,133 @@
+/*****************************************************************************/
+/**
+* \file	SerialCapture.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "SerialCapture.hpp"
+#include <chrono>
+
+
+const char SerialCapture::HEADER[HEADER_SIZE] = { 'S', 'C', 'I', 'C', 'A', 'P', 0x00, 0x01 };
+
+SerialCapture::SerialCapture(const std::string& path) :
+	file_(path.c_str(), std::ios::binary | std::ios::trunc),
+	chunks_(),
+	isAlive_(true),
+	stopRequested_(false),
+	bytesWritten_(0)
+{
+	file_.write(HEADER, HEADER_SIZE);
+}
+
+SerialCapture::~SerialCapture()
+{
+	Chunk *chunk = nullptr;
+	while (chunks_.tryPop(chunk))
+	{
+		delete chunk;
+	}
+}
+
+bool SerialCapture::isOpen() const
+{
+	return file_.good();
+}
+
+void SerialCapture::record(std::uint16_t port, const char *data, std::size_t size)
+{
+	record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count(), port, data, size);
+}
+
+void SerialCapture::record(std::int64_t time, std::uint16_t port, const char *data, std::size_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+
+	Chunk *chunk = new Chunk;
+	chunk->time = time;
+	chunk->port = port;
+	chunk->data.assign(data, size);
+	chunks_.push(chunk);
+}
+
+void SerialCapture::operator()()
+{
+	Chunk *chunk = nullptr;
+	for (;;)
+	{
+		if (chunks_.waitPop(chunk, POLL_TIMEOUT))
+		{
+			write(chunk);
+			while (chunks_.tryPop(chunk))
+			{
+				write(chunk);
+			}
+			file_.flush();
+		}
+		else
+		{
+			std::lock_guard<std::mutex> lock{ mutex_ };
+			if (stopRequested_)
+			{
+				break;
+			}
+		}
+	}
+
+	// the readers may still record, whatever is queued by now is written
+	while (chunks_.tryPop(chunk))
+	{
+		write(chunk);
+	}
+	file_.flush();
+
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	isAlive_ = false;
+}
+
+bool SerialCapture::isAlive()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return isAlive_;
+}
+
+void SerialCapture::requestStop()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	stopRequested_ = true;
+}
+
+std::uint64_t SerialCapture::bytesWritten() const
+{
+	return bytesWritten_;
+}
+
+void SerialCapture::write(Chunk *chunk)
+{
+	char header[RECORD_HEADER_SIZE];
+	const std::uint64_t time = static_cast<std::uint64_t>(chunk->time);
+	const std::uint32_t size = static_cast<std::uint32_t>(chunk->data.size());
+	for (int i = 0; i < 8; ++i)
+	{
+		header[i] = static_cast<char>(time >> (8 * i));
+	}
+	header[8] = static_cast<char>(chunk->port);
+	header[9] = static_cast<char>(chunk->port >> 8);
+	for (int i = 0; i < 4; ++i)
+	{
+		header[10 + i] = static_cast<char>(size >> (8 * i));
+	}
+
+	file_.write(header, RECORD_HEADER_SIZE);
+	file_.write(chunk->data.data(), size);
+	bytesWritten_ += size;
+	delete chunk;
+}
@@ -0,0 +1,171 @@
+/*****************************************************************************/
+/**
+* \file	SerialCapture.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "ThreadSafeQueue.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Timestamped recording of raw serial data.
+*
+* Serial threads call record() with each chunk of received data. The chunk is
+* queued and written to file by the capture thread (operator()), so the
+* reader never waits for the disk.
+*
+* File format, all integers little endian:
+*
+*   header  "SCICAP" 0x00 0x01
+*   record  u64 time, steady clock nanoseconds
+*           u16 port id
+*           u32 size
+*           size bytes of data
+*
+* Replay with SerialReplay.
+*
+******************************************************************************/
+class SerialCapture : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Creates the capture file.
+	*
+	* \param path Capture file. Truncated if it exists.
+	*
+	******************************************************************************/
+	explicit SerialCapture(const std::string& path);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Discards data not yet written.
+	*
+	*****************************************************************************/
+	~SerialCapture();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the capture file could be created.
+	*
+	******************************************************************************/
+	bool isOpen() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue received data for the capture file, stamped with the current time.
+	*
+	* \param port Port id.
+	* \param data Received data.
+	* \param size Nr of bytes.
+	*
+	******************************************************************************/
+	void record(std::uint16_t port, const char *data, std::size_t size);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue received data for the capture file.
+	*
+	* \param time Receive time, steady clock nanoseconds.
+	* \param port Port id.
+	* \param data Received data.
+	* \param size Nr of bytes.
+	*
+	******************************************************************************/
+	void record(std::int64_t time, std::uint16_t port, const char *data, std::size_t size);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Capture thread. Writes the queued data until stopped, then the rest.
+	*
+	******************************************************************************/
+	void operator()();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the capture thread is alive.
+	*
+	******************************************************************************/
+	bool isAlive();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set stop flag for the capture thread.
+	*
+	******************************************************************************/
+	void requestStop();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of data bytes written to file.
+	*
+	******************************************************************************/
+	std::uint64_t bytesWritten() const;
+
+	/**
+	* File format constants
+	*/
+	enum Format
+	{
+		HEADER_SIZE = 8,		///< Size of the file header.
+		RECORD_HEADER_SIZE = 14,	///< Size of a record before its data.
+	};
+
+	static const char HEADER[HEADER_SIZE];	///< File header.
+
+private:
+
+	/**
+	* Received data waiting to be written.
+	*/
+	struct Chunk
+	{
+		std::int64_t time;		///< Receive time, steady clock nanoseconds.
+		std::uint16_t port;		///< Port id.
+		std::string data;		///< Received data.
+	};
+
+	/**
+	* Capture thread settings
+	*/
+	enum Settings
+	{
+		POLL_TIMEOUT = 100,		///< Max time in milliseconds between stop checks.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Write one chunk to file and delete it.
+	*
+	******************************************************************************/
+	void write(Chunk *chunk);
+
+
+	std::ofstream file_;						///< Capture file. Only used by the capture thread.
+	ThreadSafeQueue<Chunk *> chunks_;			///< Data waiting to be written.
+	std::mutex mutex_;							///< Guards isAlive_ and stopRequested_.
+	bool isAlive_;								///< True if the capture thread is alive.
+	bool stopRequested_;						///< Request to terminate the capture thread.
+	std::atomic<std::uint64_t> bytesWritten_;	///< Data bytes written to file.
+};
@@ -0,0 +1,156 @@
+/*****************************************************************************/
+/**
+* \file	SerialReplay.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "SerialReplay.hpp"
+#include "SerialCapture.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+
+SerialReplay::SerialReplay(const std::string& path) :
+	file_(path.c_str(), std::ios::binary),
+	valid_(false),
+	routes_(),
+	speed_(1),
+	isAlive_(true),
+	stopRequested_(false),
+	chunks_(0),
+	bytes_(0),
+	messages_(0),
+	corrupt_(false)
+{
+	char header[SerialCapture::HEADER_SIZE];
+	valid_ = file_.read(header, sizeof(header)) &&
+		std::memcmp(header, SerialCapture::HEADER, sizeof(header)) == 0;
+}
+
+bool SerialReplay::isOpen() const
+{
+	return valid_;
+}
+
+void SerialReplay::route(std::uint16_t port, Framer *framer, MessageQueue<std::string *> *queue)
+{
+	routes_[port].reset(new FrameAssembler(framer, queue));
+}
+
+void SerialReplay::setSpeed(double speed)
+{
+	speed_ = std::max(speed, 0.0);
+}
+
+void SerialReplay::operator()()
+{
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point start;
+	std::int64_t firstTime = 0;
+	bool first = true;
+
+	std::int64_t time;
+	std::uint16_t port;
+	std::string data;
+	while (valid_ && !isStopRequested() && readRecord(time, port, data))
+	{
+		std::map<std::uint16_t, std::unique_ptr<FrameAssembler>>::iterator route = routes_.find(port);
+		if (route == routes_.end())
+		{
+			continue;
+		}
+
+		if (first)
+		{
+			start = Clock::now();
+			firstTime = time;
+			first = false;
+		}
+
+		if (speed_ > 0)
+		{
+			// due times are relative to the first record, so sleep overshoot does not accumulate
+			const Clock::time_point due = start + std::chrono::nanoseconds(
+				static_cast<std::int64_t>((time - firstTime) / speed_));
+			while (Clock::now() < due && !isStopRequested())
+			{
+				std::this_thread::sleep_until(std::min(due, Clock::now() + std::chrono::milliseconds(POLL_TIMEOUT)));
+			}
+		}
+
+		messages_ += route->second->receive(data.data(), data.size());
+		bytes_ += data.size();
+		++chunks_;
+	}
+
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	isAlive_ = false;
+}
+
+bool SerialReplay::isAlive()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return isAlive_;
+}
+
+void SerialReplay::requestStop()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	stopRequested_ = true;
+}
+
+bool SerialReplay::isStopRequested()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return stopRequested_;
+}
+
+SerialReplay::Statistics SerialReplay::statistics() const
+{
+	Statistics s;
+	s.chunks = chunks_;
+	s.bytes = bytes_;
+	s.messages = messages_;
+	s.corrupt = corrupt_;
+	return s;
+}
+
+bool SerialReplay::readRecord(std::int64_t& time, std::uint16_t& port, std::string& data)
+{
+	unsigned char header[SerialCapture::RECORD_HEADER_SIZE];
+	if (!file_.read(reinterpret_cast<char *>(header), sizeof(header)))
+	{
+		corrupt_ = file_.gcount() > 0;
+		return false;
+	}
+
+	std::uint64_t t = 0;
+	for (int i = 7; i >= 0; --i)
+	{
+		t = (t << 8) | header[i];
+	}
+	time = static_cast<std::int64_t>(t);
+	port = static_cast<std::uint16_t>(header[8] | (header[9] << 8));
+	const std::uint32_t size = header[10] | (header[11] << 8) | (header[12] << 16) | (static_cast<std::uint32_t>(header[13]) << 24);
+
+	// a corrupt size field must not allocate up to 4 GB before the read fails
+	if (size > FrameAssembler::MAX_MESSAGE_SIZE)
+	{
+		corrupt_ = true;
+		return false;
+	}
+	data.resize(size);
+	if (size > 0 && !file_.read(&data[0], size))
+	{
+		corrupt_ = true;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,164 @@
+/*****************************************************************************/
+/**
+* \file	SerialReplay.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "FrameAssembler.hpp"
+#include "MessageQueue.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Replay of a file recorded by SerialCapture.
+*
+* The recorded data of each routed port is fed through a framer into a
+* message queue, exactly as TimeoutSerialThread does with data read from the
+* serial device, so consumers cannot tell a replay from live data. Ports that
+* are not routed are skipped.
+*
+* Runs at the recorded pace, a multiple of it, or as fast as possible. The
+* last is a repeatable throughput benchmark of the framing and queue path.
+*
+******************************************************************************/
+class SerialReplay : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Opens the capture file.
+	*
+	* \param path Capture file.
+	*
+	******************************************************************************/
+	explicit SerialReplay(const std::string& path);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the file could be opened and is a capture.
+	*
+	******************************************************************************/
+	bool isOpen() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Replay the data of a port. Set before the replay is started.
+	*
+	* \param port Port id in the capture.
+	* \param framer Splits the data into messages. Not owned.
+	* \param queue Queue for the messages. Not owned.
+	*
+	******************************************************************************/
+	void route(std::uint16_t port, Framer *framer, MessageQueue<std::string *> *queue);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set the replay speed.
+	*
+	* \param speed 1 for the recorded pace, N for N times faster, 0 for as fast as possible.
+	*
+	******************************************************************************/
+	void setSpeed(double speed);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Replay thread. Replays the file once, or until stopped.
+	*
+	******************************************************************************/
+	void operator()();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the replay thread is alive.
+	*
+	******************************************************************************/
+	bool isAlive();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set stop flag for the replay thread.
+	*
+	******************************************************************************/
+	void requestStop();
+
+
+	/**
+	* Replay counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t chunks;		///< Records replayed.
+		std::uint64_t bytes;		///< Data bytes replayed.
+		std::uint64_t messages;		///< Messages posted.
+		bool corrupt;				///< Stopped at a truncated or oversized record.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the replay counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+private:
+
+	/**
+	* Replay thread settings
+	*/
+	enum Settings
+	{
+		POLL_TIMEOUT = 100,		///< Max time in milliseconds between stop checks.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Read the next record.
+	*
+	* \return false at end of file, or on a truncated record or one larger
+	* than FrameAssembler::MAX_MESSAGE_SIZE, which mark the file corrupt.
+	*
+	******************************************************************************/
+	bool readRecord(std::int64_t& time, std::uint16_t& port, std::string& data);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the replay thread is to be stopped.
+	*
+	******************************************************************************/
+	bool isStopRequested();
+
+
+	std::ifstream file_;											///< Capture file.
+	bool valid_;													///< True if file_ has a capture header.
+	std::map<std::uint16_t, std::unique_ptr<FrameAssembler>> routes_;	///< Assembler per replayed port.
+	double speed_;													///< Replay speed, 0 for max.
+	std::mutex mutex_;												///< Guards isAlive_ and stopRequested_.
+	bool isAlive_;													///< True if the replay thread is alive.
+	bool stopRequested_;											///< Request to terminate the replay thread.
+	std::atomic<std::uint64_t> chunks_;								///< Records replayed.
+	std::atomic<std::uint64_t> bytes_;								///< Data bytes replayed.
+	std::atomic<std::uint64_t> messages_;							///< Messages posted.
+	std::atomic<bool> corrupt_;										///< Stopped at a bad record.
+};
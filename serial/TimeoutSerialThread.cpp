@@ -9,10 +9,14 @@
 ******************************************************************************/
 
 #include "TimeoutSerialThread.hpp"
+#include "DelimiterFramer.hpp"
 #include <string>
 #include <algorithm>
+#include <iterator>
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#include <thread>
 #include <boost/bind.hpp>
 #include <boost/exception/exception.hpp>
 #include <boost/exception/diagnostic_information.hpp>
@@ -35,15 +39,43 @@ TimeoutSerialThread::TimeoutSerialThread(const std::string& devname, std::uint32
 	timeout_(boost::posix_time::seconds(0)),
 	result_(resultInProgress),
 	bytesTransferred_(0),
-	delim_(""),
+	ownFramer_(),
+	framer_(nullptr),
+	assembler_(nullptr, nullptr),
+	readData_(nullptr),
+	readTime_(0),
+	capture_(nullptr),
+	capturePort_(0),
 	queue_(nullptr),
 	isAlive_(true),
-	stopRequested_(false)
+	stopRequested_(false),
+	writeTimer_(io_),
+	writeTimeout_(boost::posix_time::seconds(0)),
+	writeQueueDepth_(WRITE_QUEUE_DEPTH),
+	writeInProgress_(false),
+	writeCanceled_(false),
+	writeGeneration_(0),
+	messageTimeout_(MESSAGE_TIMEOUT),
+	readRestart_(false),
+	reconnectTimer_(io_),
+	reconnect_(false),
+	reconnectMinDelay_(RECONNECT_MIN_DELAY),
+	reconnectMaxDelay_(RECONNECT_MAX_DELAY),
+	reconnectDelay_(0),
+	connected_(true),
+	readGeneration_(0),
+	downSince_(),
+	linkHandler_(),
+	linkStatistics_(),
+	tuned_(false),
+	profile_(LowLatencyProfile::defaults()),
+	portReport_(),
+	threadReport_()
 {
 }
 
 
-TimeoutSerialThread::TimeoutSerialThread(const char *delim, ThreadSafeQueue<std::string *> *queue, const std::string& devname, std::uint32_t baudrate,
+TimeoutSerialThread::TimeoutSerialThread(const char *delim, MessageQueue<std::string *> *queue, const std::string& devname, std::uint32_t baudrate,
 	boost::asio::serial_port_base::parity opt_parity,
 	boost::asio::serial_port_base::character_size opt_csize,
 	boost::asio::serial_port_base::flow_control opt_flow,
@@ -60,10 +92,90 @@ TimeoutSerialThread::TimeoutSerialThread(const char *delim, ThreadSafeQueue<std:
 	timeout_(boost::posix_time::seconds(1)),
 	result_(resultInProgress),
 	bytesTransferred_(0),
-	delim_(delim),
+	ownFramer_(new DelimiterFramer(delim)),
+	framer_(ownFramer_.get()),
+	assembler_(framer_, queue),
+	readData_(nullptr),
+	readTime_(0),
+	capture_(nullptr),
+	capturePort_(0),
 	queue_(queue),
 	isAlive_(true),
-	stopRequested_(false)
+	stopRequested_(false),
+	writeTimer_(io_),
+	writeTimeout_(boost::posix_time::seconds(0)),
+	writeQueueDepth_(WRITE_QUEUE_DEPTH),
+	writeInProgress_(false),
+	writeCanceled_(false),
+	writeGeneration_(0),
+	messageTimeout_(MESSAGE_TIMEOUT),
+	readRestart_(false),
+	reconnectTimer_(io_),
+	reconnect_(false),
+	reconnectMinDelay_(RECONNECT_MIN_DELAY),
+	reconnectMaxDelay_(RECONNECT_MAX_DELAY),
+	reconnectDelay_(0),
+	connected_(true),
+	readGeneration_(0),
+	downSince_(),
+	linkHandler_(),
+	linkStatistics_(),
+	tuned_(false),
+	profile_(LowLatencyProfile::defaults()),
+	portReport_(),
+	threadReport_()
+{
+}
+
+TimeoutSerialThread::TimeoutSerialThread(Framer *framer, MessageQueue<std::string *> *queue, const std::string& devname, std::uint32_t baudrate,
+	boost::asio::serial_port_base::parity opt_parity,
+	boost::asio::serial_port_base::character_size opt_csize,
+	boost::asio::serial_port_base::flow_control opt_flow,
+	boost::asio::serial_port_base::stop_bits opt_stop) :
+	io_(),
+	port_(io_),
+	devname_(devname),
+	baudrate_(baudrate),
+	opt_parity_(opt_parity),
+	opt_csize_(opt_csize),
+	opt_flow_(opt_flow),
+	opt_stop_(opt_stop),
+	timer_(io_),
+	timeout_(boost::posix_time::seconds(1)),
+	result_(resultInProgress),
+	bytesTransferred_(0),
+	ownFramer_(),
+	framer_(framer),
+	assembler_(framer, queue),
+	readData_(nullptr),
+	readTime_(0),
+	capture_(nullptr),
+	capturePort_(0),
+	queue_(queue),
+	isAlive_(true),
+	stopRequested_(false),
+	writeTimer_(io_),
+	writeTimeout_(boost::posix_time::seconds(0)),
+	writeQueueDepth_(WRITE_QUEUE_DEPTH),
+	writeInProgress_(false),
+	writeCanceled_(false),
+	writeGeneration_(0),
+	messageTimeout_(MESSAGE_TIMEOUT),
+	readRestart_(false),
+	reconnectTimer_(io_),
+	reconnect_(false),
+	reconnectMinDelay_(RECONNECT_MIN_DELAY),
+	reconnectMaxDelay_(RECONNECT_MAX_DELAY),
+	reconnectDelay_(0),
+	connected_(true),
+	readGeneration_(0),
+	downSince_(),
+	linkHandler_(),
+	linkStatistics_(),
+	tuned_(false),
+	profile_(LowLatencyProfile::defaults()),
+	portReport_(),
+	threadReport_()
 {
 }
 
@@ -79,36 +191,77 @@ bool TimeoutSerialThread::open()
 		close();
 	}
 
+	// with reconnect, further attempts back off in the Serial thread. Without,
 	// workaround since open() needs extra time, or to be called twice when
-	// the com port is opened a seccond time (after a communication timeout)
-	bool success = false;
-	int retries = 3;
-	do
+	// the com port is opened a second time (after a communication timeout)
+	bool success = openDevice();
+	for (int retry = 0; !success && !canReconnect() && retry < OPEN_RETRIES; ++retry)
 	{
-		try
-		{
-			port_.open(devname_);
-			success = true;
-		}
-		catch (boost::system::system_error&)
-		{
-			--retries;
-		}
-	} while (!success && retries > 0);
+		std::this_thread::sleep_for(std::chrono::milliseconds(OPEN_RETRY_DELAY));
+		success = openDevice();
+	}
+	connected_ = success;
+	if (!success)
+	{
+		downSince_ = std::chrono::steady_clock::now();
+	}
+	return success;
+}
 
-	if (success)
+bool TimeoutSerialThread::openDevice()
+{
+	boost::system::error_code error;
+	port_.open(devname_, error);
+	if (error)
 	{
-		port_.set_option(boost::asio::serial_port_base::baud_rate(baudrate_));
-		port_.set_option(opt_parity_);
-		port_.set_option(opt_csize_);
-		port_.set_option(opt_flow_);
-		port_.set_option(opt_stop_);
-		return true;
+		return false;
 	}
-	else
+
+	port_.set_option(boost::asio::serial_port_base::baud_rate(baudrate_), error);
+	if (!error)
+	{
+		port_.set_option(opt_parity_, error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_csize_, error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_flow_, error);
+	}
+	if (!error)
+	{
+		port_.set_option(opt_stop_, error);
+	}
+	if (error)
+	{
+		boost::system::error_code ignored;
+		port_.close(ignored);
+		throw boost::system::system_error(error, "set_option " + devname_);
+	}
+
+	tunePort();
+	return true;
+}
+
+bool TimeoutSerialThread::assign(int nativeHandle)
+{
+	if (isOpen())
+	{
+		close();
+	}
+
+	boost::system::error_code error;
+	port_.assign(nativeHandle, error);
+	if (error)
 	{
 		return false;
 	}
+
+	tunePort();
+	connected_ = true;
+	return true;
 }
 
 bool TimeoutSerialThread::isOpen() const
@@ -127,6 +280,90 @@ void TimeoutSerialThread::close()
 void TimeoutSerialThread::setTimeout(const boost::posix_time::time_duration& t)
 {
 	timeout_ = t;
+	setWriteTimeout(t);
+}
+
+void TimeoutSerialThread::setWriteTimeout(const boost::posix_time::time_duration& t)
+{
+	std::lock_guard<std::mutex> lock{ writeMutex_ };
+	writeTimeout_ = t;
+}
+
+void TimeoutSerialThread::setMessageTimeout(std::uint32_t seconds)
+{
+	messageTimeout_ = seconds;
+}
+
+void TimeoutSerialThread::setCapture(SerialCapture *capture, std::uint16_t port)
+{
+	capture_ = capture;
+	capturePort_ = port;
+}
+
+void TimeoutSerialThread::setLatencyProbe(LatencyProbe *probe)
+{
+	assembler_.setProbe(probe);
+}
+
+void TimeoutSerialThread::setLowLatency(const LowLatencyProfile& profile)
+{
+	tuned_ = true;
+	profile_ = profile;
+	if (isOpen())
+	{
+		tunePort();
+	}
+}
+
+std::vector<std::string> TimeoutSerialThread::tuningReport()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	std::vector<std::string> report(portReport_);
+	report.insert(report.end(), threadReport_.begin(), threadReport_.end());
+	return report;
+}
+
+void TimeoutSerialThread::tunePort()
+{
+	if (!tuned_)
+	{
+		return;
+	}
+
+	std::vector<std::string> report;
+	applyPortTuning(port_.native_handle(), profile_, report);
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	portReport_.swap(report);
+}
+
+void TimeoutSerialThread::setReconnect(bool enable, std::uint32_t minDelay, std::uint32_t maxDelay)
+{
+	reconnect_ = enable;
+	reconnectMinDelay_ = std::max<std::uint32_t>(minDelay, 1);
+	reconnectMaxDelay_ = std::max(maxDelay, reconnectMinDelay_);
+}
+
+void TimeoutSerialThread::setLinkHandler(const LinkHandler& handler)
+{
+	linkHandler_ = handler;
+}
+
+bool TimeoutSerialThread::isConnected() const
+{
+	return connected_;
+}
+
+TimeoutSerialThread::LinkStatistics TimeoutSerialThread::linkStatistics()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return linkStatistics_;
+}
+
+void TimeoutSerialThread::setWriteQueueDepth(std::size_t depth)
+{
+	std::lock_guard<std::mutex> lock{ writeMutex_ };
+	writeQueueDepth_ = std::max<std::size_t>(depth, 1);
+	writeSpace_.notify_all();
 }
 
 void TimeoutSerialThread::write(const char *data, size_t size)
@@ -144,8 +381,77 @@ void TimeoutSerialThread::writeString(const std::string& s)
 	boost::asio::write(port_, boost::asio::buffer(s.c_str(), s.size()));
 }
 
+bool TimeoutSerialThread::asyncWrite(const std::string& data, const WriteHandler& handler, std::uint32_t milliSeconds)
+{
+	std::unique_lock<std::mutex> lock{ writeMutex_ };
+	writeSpace_.wait_for(lock, std::chrono::milliseconds(milliSeconds),
+		[this]() {return !isAlive_ || writeQueue_.size() < writeQueueDepth_;});
+	if (!isAlive() || writeQueue_.size() >= writeQueueDepth_)
+	{
+		return false;
+	}
+
+	PendingWrite pending;
+	pending.data = data;
+	pending.handler = handler;
+	if (writeTimeout_ != boost::posix_time::seconds(0))
+	{
+		pending.deadline = boost::asio::deadline_timer::traits_type::now() + writeTimeout_;
+	}
+	else
+	{
+		pending.deadline = boost::posix_time::pos_infin;
+	}
+	writeQueue_.push_back(std::move(pending));
+
+	// the batch in flight picks up the new write when it completes
+	if (!writeInProgress_)
+	{
+		writeInProgress_ = true;
+		io_.post(boost::bind(&TimeoutSerialThread::startWrite, this));
+	}
+	return true;
+}
+
+std::future<std::size_t> TimeoutSerialThread::asyncWrite(const std::string& data, std::uint32_t milliSeconds)
+{
+	std::shared_ptr<std::promise<std::size_t>> promise = std::make_shared<std::promise<std::size_t>>();
+	std::future<std::size_t> result = promise->get_future();
+
+	bool queued = asyncWrite(data, [promise](const boost::system::error_code& error, std::size_t bytesTransferred)
+	{
+		if (!error)
+		{
+			promise->set_value(bytesTransferred);
+		}
+		else if (error == boost::asio::error::timed_out)
+		{
+			promise->set_exception(std::make_exception_ptr(timeout_exception("asyncWrite: write deadline expired")));
+		}
+		else
+		{
+			promise->set_exception(std::make_exception_ptr(boost::system::system_error(error)));
+		}
+	}, milliSeconds);
+
+	if (!queued)
+	{
+		promise->set_exception(std::make_exception_ptr(
+			boost::system::system_error(boost::asio::error::no_buffer_space)));
+	}
+	return result;
+}
+
 void TimeoutSerialThread::operator()()
 {
+	if (tuned_)
+	{
+		std::vector<std::string> report;
+		applyThreadTuning(profile_, report);
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		threadReport_.swap(report);
+	}
+
 	//For this code to work, there should always be a timeout, so the
 	//request for no timeout is translated into a very long timeout
 	if (timeout_ != boost::posix_time::seconds(0))
@@ -162,9 +468,25 @@ void TimeoutSerialThread::operator()()
 	// initiate lastMessageTime with current time...just to get started
 	std::int64_t lastMessageTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 
+	// an instance without a queue only runs the asynchronous writes
+	const bool reading = (queue_ != nullptr);
+
 	result_ = resultInProgress;	// initial state
 	bytesTransferred_ = 0;
-	asyncReadUntil(delim_);	// wait for next message
+	if (reading)
+	{
+		assembler_.reset();
+		if (connected_ || !canReconnect())
+		{
+			asyncRead();	// wait for next message
+		}
+		else
+		{
+			// open() failed, keep trying with the reconnect backoff
+			reconnectDelay_ = reconnectMinDelay_;
+			scheduleReconnect();
+		}
+	}
 
 	for (;;)
 	{
@@ -173,40 +495,63 @@ void TimeoutSerialThread::operator()()
 		{
 		case resultSuccess:
 		{
-			port_.cancel();
-
-			bytesTransferred_ -= delim_.size();	//Don't count delim
-			std::istream is(&readData_);
-			std::string *resultStr = new std::string(bytesTransferred_, '\0');	//Alloc string
-			is.read(&(*resultStr)[0], bytesTransferred_);	//Fill values
-			is.ignore(delim_.size());	//Remove delimiter from stream
-			queue_->push(resultStr);
-
-			// reset lastMessage timer
-			lastMessageTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			if (capture_ != nullptr)
+			{
+				capture_->record(capturePort_, readData_, bytesTransferred_);
+			}
+			if (assembler_.commit(bytesTransferred_, readTime_) > 0)
+			{
+				// reset lastMessage timer
+				lastMessageTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			}
 
 			result_ = resultInProgress;
 			bytesTransferred_ = 0;
-			asyncReadUntil(delim_);	// wait for next message
+			asyncRead();	// wait for next message
 			break;
 		}
 
+		case resultReconnect:
+			result_ = resultInProgress;
+			if (reconnect())
+			{
+				// the message timeout starts over on the new port
+				lastMessageTime = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+			}
+			break;
+
 		case resultTimeoutExpired:
 			timer_.cancel();
 
-			if (isStopRequested() ||
-				std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() - lastMessageTime >= MESSAGE_TIMEOUT)
+			if (isStopRequested())
 			{
 				cleanup();		// ready to die...
 				return;			// ...terminate thread
 			}
 
+			if (reading && connected_ && messageTimeout_ != 0 &&
+				std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() - lastMessageTime >= messageTimeout_)
+			{
+				if (!canReconnect())
+				{
+					cleanup();		// ready to die...
+					return;			// ...terminate thread
+				}
+				disconnect();	// a silent port may be a dead port
+			}
+
 			result_ = resultInProgress;	// continue reading/waiting for data
 			timer_.expires_from_now(timeout_);	// restart timer
 			timer_.async_wait(boost::bind(&TimeoutSerialThread::timeoutExpired, this, boost::asio::placeholders::error));
 			break;
 
 		case resultError:
+			if (canReconnect())
+			{
+				result_ = resultInProgress;
+				disconnect();	// keep the thread, reopen the port
+				break;
+			}
 			timer_.cancel();
 			cleanup();		// ready to die...
 			return;					// ...terminate thread
@@ -249,11 +594,97 @@ void TimeoutSerialThread::setAlive(const bool isAlive)
 }
 
 
-void TimeoutSerialThread::asyncReadUntil(const std::string& delim)
+void TimeoutSerialThread::asyncRead()
 {
-	boost::asio::async_read_until(port_, readData_, delim, boost::bind(
+	std::size_t available;
+	readData_ = assembler_.prepare(READ_BUFFER_SIZE, available);
+	port_.async_read_some(boost::asio::buffer(readData_, available), boost::bind(
 		&TimeoutSerialThread::readCompleted, this, boost::asio::placeholders::error,
-		boost::asio::placeholders::bytes_transferred));
+		boost::asio::placeholders::bytes_transferred, readGeneration_));
+}
+
+bool TimeoutSerialThread::canReconnect() const
+{
+	return reconnect_ && !devname_.empty() && !stopRequested_;
+}
+
+void TimeoutSerialThread::disconnect()
+{
+	// completions of the old port are ignored from now on
+	++readGeneration_;
+	readRestart_ = false;
+	connected_ = false;
+	boost::system::error_code error;
+	port_.close(error);
+	assembler_.reset();
+
+	downSince_ = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		++linkStatistics_.disconnects;
+	}
+	if (linkHandler_)
+	{
+		linkHandler_(false);
+	}
+
+	reconnectDelay_ = 0;	// first attempt at once
+	scheduleReconnect();
+}
+
+bool TimeoutSerialThread::reconnect()
+{
+	bool success = false;
+	try
+	{
+		success = openDevice();
+	}
+	catch (boost::system::system_error&)
+	{
+		// line settings refused, e.g. another device at the same path
+	}
+	{
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		++linkStatistics_.attempts;
+		if (success)
+		{
+			const std::uint64_t downtime = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - downSince_).count();
+			++linkStatistics_.reconnects;
+			linkStatistics_.downtime += downtime;
+			linkStatistics_.lastDowntime = downtime;
+			linkStatistics_.maxDowntime = std::max(linkStatistics_.maxDowntime, downtime);
+		}
+	}
+
+	if (!success)
+	{
+		reconnectDelay_ = (reconnectDelay_ == 0) ? reconnectMinDelay_ : std::min(2 * reconnectDelay_, reconnectMaxDelay_);
+		scheduleReconnect();
+		return false;
+	}
+
+	connected_ = true;
+	if (linkHandler_)
+	{
+		linkHandler_(true);
+	}
+	asyncRead();
+	return true;
+}
+
+void TimeoutSerialThread::scheduleReconnect()
+{
+	reconnectTimer_.expires_from_now(boost::posix_time::milliseconds(reconnectDelay_));
+	reconnectTimer_.async_wait(boost::bind(&TimeoutSerialThread::reconnectExpired, this, boost::asio::placeholders::error));
+}
+
+void TimeoutSerialThread::reconnectExpired(const boost::system::error_code& error)
+{
+	if (!error)
+	{
+		result_ = resultReconnect;
+	}
 }
 
 void TimeoutSerialThread::timeoutExpired(const boost::system::error_code& error)
@@ -270,23 +701,164 @@ void TimeoutSerialThread::timeoutExpired(const boost::system::error_code& error)
 }
 
 void TimeoutSerialThread::readCompleted(const boost::system::error_code& error,
-	const size_t bytesTransferred)
+	const size_t bytesTransferred, std::uint64_t generation)
 {
+	if (generation != readGeneration_)
+	{
+		return;	// read of a lost port, aborted by the close
+	}
+
 	if (!error)
 	{
+		if (assembler_.probe() != nullptr)
+		{
+			readTime_ = LatencyProbe::now();
+		}
 		result_ = resultSuccess;
 		this->bytesTransferred_ = bytesTransferred;
 	}
+	else if (error == boost::asio::error::operation_aborted && readRestart_)
+	{
+		// canceled because a write missed its deadline, not a read error
+		readRestart_ = false;
+		asyncRead();
+	}
 	else
 	{
 		result_ = resultError;
 	}
 }
 
+void TimeoutSerialThread::startWrite()
+{
+	std::vector<PendingWrite> expired;
+	const boost::posix_time::ptime now = boost::asio::deadline_timer::traits_type::now();
+	{
+		std::lock_guard<std::mutex> lock{ writeMutex_ };
+		while (!writeQueue_.empty() && writeBatch_.size() < WRITE_BATCH_SIZE)
+		{
+			if (writeQueue_.front().deadline <= now)
+			{
+				expired.push_back(std::move(writeQueue_.front()));
+			}
+			else
+			{
+				writeBatch_.push_back(std::move(writeQueue_.front()));
+			}
+			writeQueue_.pop_front();
+		}
+		if (writeBatch_.empty())
+		{
+			writeInProgress_ = false;
+		}
+	}
+	writeSpace_.notify_all();
+
+	for (PendingWrite& w : expired)
+	{
+		if (w.handler)
+		{
+			w.handler(boost::asio::error::timed_out, 0);
+		}
+	}
+
+	if (writeBatch_.empty())
+	{
+		return;
+	}
+
+	std::vector<boost::asio::const_buffer> buffers;
+	buffers.reserve(writeBatch_.size());
+	boost::posix_time::ptime deadline(boost::posix_time::pos_infin);
+	for (const PendingWrite& w : writeBatch_)
+	{
+		buffers.push_back(boost::asio::buffer(w.data));
+		deadline = std::min(deadline, w.deadline);
+	}
+
+	// an expiry of the previous batch may already be queued past cancel()
+	++writeGeneration_;
+	if (!deadline.is_pos_infinity())
+	{
+		writeTimer_.expires_at(deadline);
+		writeTimer_.async_wait(boost::bind(&TimeoutSerialThread::writeTimeoutExpired, this,
+			boost::asio::placeholders::error, writeGeneration_));
+	}
+
+	boost::asio::async_write(port_, buffers, boost::bind(
+		&TimeoutSerialThread::writeCompleted, this, boost::asio::placeholders::error,
+		boost::asio::placeholders::bytes_transferred));
+}
+
+void TimeoutSerialThread::writeCompleted(const boost::system::error_code& error,
+	const size_t bytesTransferred)
+{
+	writeTimer_.cancel();
+
+	boost::system::error_code result = error;
+	if (error == boost::asio::error::operation_aborted && writeCanceled_)
+	{
+		result = boost::asio::error::timed_out;
+	}
+	writeCanceled_ = false;
+
+	std::vector<PendingWrite> batch;
+	batch.swap(writeBatch_);
+
+	// writes sent in full before an error still count as successful
+	size_t remaining = bytesTransferred;
+	for (PendingWrite& w : batch)
+	{
+		const size_t sent = std::min(remaining, w.data.size());
+		remaining -= sent;
+		if (w.handler)
+		{
+			w.handler(sent == w.data.size() ? boost::system::error_code() : result, sent);
+		}
+	}
+
+	startWrite();
+}
+
+void TimeoutSerialThread::writeTimeoutExpired(const boost::system::error_code& error, std::uint64_t generation)
+{
+	if (!error && generation == writeGeneration_ && !writeBatch_.empty())
+	{
+		// serial_port can only cancel all operations, so the read is restarted
+		writeCanceled_ = true;
+		readRestart_ = (queue_ != nullptr);
+		port_.cancel();
+	}
+}
+
+void TimeoutSerialThread::failWrites(const boost::system::error_code& error)
+{
+	std::vector<PendingWrite> writes;
+	writes.swap(writeBatch_);
+	{
+		std::lock_guard<std::mutex> lock{ writeMutex_ };
+		std::move(writeQueue_.begin(), writeQueue_.end(), std::back_inserter(writes));
+		writeQueue_.clear();
+		writeInProgress_ = false;
+	}
+	writeSpace_.notify_all();
+
+	for (PendingWrite& w : writes)
+	{
+		if (w.handler)
+		{
+			w.handler(error, 0);
+		}
+	}
+}
+
 void TimeoutSerialThread::cleanup()
 {
+	reconnectTimer_.cancel();
 	io_.stop();
-	port_.cancel();
+	boost::system::error_code error;
+	port_.cancel(error);	// the port is closed if lost
 	close();
 	setAlive(false);	// ready to die...
+	failWrites(boost::asio::error::operation_aborted);
 }
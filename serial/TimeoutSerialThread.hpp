@@ -13,7 +13,17 @@
 #include <boost/utility.hpp>
 #include <boost/asio.hpp>
 #include "ThreadSafeQueue.hpp"
+#include "FrameAssembler.hpp"
+#include "SerialCapture.hpp"
+#include "LowLatency.hpp"
 #include <atomic>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <future>
+#include <condition_variable>
+#include <chrono>
 
 /****************************************************************************/
 /**
@@ -44,6 +54,31 @@ class TimeoutSerialThread : private boost::noncopyable
 {
 public:
 
+	/**
+	* Completion handler for asynchronous writes. Called from the Serial thread
+	* with the outcome of the write and the nr of bytes written.
+	*/
+	typedef std::function<void(const boost::system::error_code&, std::size_t)> WriteHandler;
+
+	/**
+	* Link event handler. Called from the Serial thread with false when the port
+	* was lost and with true when it was reopened, see setReconnect().
+	*/
+	typedef std::function<void(bool up)> LinkHandler;
+
+	/**
+	* Reconnect counters. Times in microseconds.
+	*/
+	struct LinkStatistics
+	{
+		std::uint64_t disconnects;		///< Times the port was lost.
+		std::uint64_t attempts;			///< Reopen attempts.
+		std::uint64_t reconnects;		///< Successful reopens.
+		std::uint64_t downtime;			///< Total time without port.
+		std::uint64_t lastDowntime;		///< Duration of the last outage.
+		std::uint64_t maxDowntime;		///< Longest outage.
+	};
+
 	/****************************************************************************/
 	/**
 	* \brief Constructor, used when writing to serial device.
@@ -81,7 +116,32 @@ public:
 	* \param opt_stop Nr of stopbits. Default: 1.
 	*
 	******************************************************************************/
-	TimeoutSerialThread(const char *delim, ThreadSafeQueue<std::string *> *queue, const std::string& devname, std::uint32_t baudrate,
+	TimeoutSerialThread(const char *delim, MessageQueue<std::string *> *queue, const std::string& devname, std::uint32_t baudrate,
+		boost::asio::serial_port_base::parity opt_parity =
+		boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none),
+		boost::asio::serial_port_base::character_size opt_csize =
+		boost::asio::serial_port_base::character_size(8),
+		boost::asio::serial_port_base::flow_control opt_flow =
+		boost::asio::serial_port_base::flow_control(boost::asio::serial_port_base::flow_control::none),
+		boost::asio::serial_port_base::stop_bits opt_stop =
+		boost::asio::serial_port_base::stop_bits(boost::asio::serial_port_base::stop_bits::one));
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor, used when reading framed binary or text data from serial device.
+	*
+	* \param framer Splits the received data into messages. Not owned, must outlive the object.
+	* \param queue Queue for received messages.
+	* \param devname Serial device.
+	* \param baudrate Baudrate.
+	* \param opt_parity Parity. Default: none.
+	* \param opt_csize Nr of databits. Default: 8.
+	* \param opt_flow Flow control. Default: none.
+	* \param opt_stop Nr of stopbits. Default: 1.
+	*
+	******************************************************************************/
+	TimeoutSerialThread(Framer *framer, MessageQueue<std::string *> *queue, const std::string& devname, std::uint32_t baudrate,
 		boost::asio::serial_port_base::parity opt_parity =
 		boost::asio::serial_port_base::parity(boost::asio::serial_port_base::parity::none),
 		boost::asio::serial_port_base::character_size opt_csize =
@@ -104,12 +164,36 @@ public:
 	/**
 	* \brief Open the serial device.
 	*
+	* Without reconnect, makes up to OPEN_RETRIES more attempts OPEN_RETRY_DELAY
+	* apart, since a port opened a second time may need them. With reconnect
+	* enabled by setReconnect() before, makes one attempt; if it fails, the
+	* Serial thread may still be started; it then reopens the port with the
+	* backoff of setReconnect() and reports link up to the link handler once
+	* it succeeds.
+	*
 	* \return true upon success.
 	*
+	* \throws boost::system::system_error if the line settings cannot be applied
+	*
 	*****************************************************************************/
 	bool open();
 
 
+	/****************************************************************************/
+	/**
+	* \brief Use an already open descriptor instead of opening the serial device.
+	*
+	* E.g. the master side of a pseudo-terminal, which has no device name.
+	* The line settings are left as they are. Takes ownership of the descriptor.
+	*
+	* \param nativeHandle Open descriptor.
+	*
+	* \return true upon success.
+	*
+	*****************************************************************************/
+	bool assign(int nativeHandle);
+
+
 	/****************************************************************************/
 	/**
 	* \brief Check if serial device is open.
@@ -135,6 +219,7 @@ public:
 	* \brief Set the timeout on read/write operations.
 	*
 	* To disable the timeout, call setTimeout(boost::posix_time::seconds(0)).
+	* Also sets the deadline of asynchronous writes, see setWriteTimeout().
 	*
 	* \param t Timeout in seconds.
 	*
@@ -142,6 +227,140 @@ public:
 	void setTimeout(const boost::posix_time::time_duration& t);
 
 
+	/****************************************************************************/
+	/**
+	* \brief Set the deadline of asynchronous writes.
+	*
+	* A write that has not been sent within this time from when it was queued
+	* completes with boost::asio::error::timed_out. Zero disables the deadline.
+	*
+	* \param t Write deadline.
+	*
+	*****************************************************************************/
+	void setWriteTimeout(const boost::posix_time::time_duration& t);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Set the max nr of asynchronous writes waiting to be sent.
+	*
+	* \param depth Write queue depth. Default: WRITE_QUEUE_DEPTH.
+	*
+	*****************************************************************************/
+	void setWriteQueueDepth(std::size_t depth);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Set how long the Serial thread waits for a message before it terminates.
+	*
+	* \param seconds Message timeout. Default: MESSAGE_TIMEOUT. 0 waits forever.
+	*
+	*****************************************************************************/
+	void setMessageTimeout(std::uint32_t seconds);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Opt in to low latency tuning.
+	*
+	* The port settings are applied when the port is opened or assigned, also
+	* on reconnect; the thread settings when the Serial thread starts. Settings
+	* that cannot be applied are listed by tuningReport() and do not fail the open.
+	*
+	* \param profile Settings, e.g. LowLatencyProfile::defaults().
+	*
+	*****************************************************************************/
+	void setLowLatency(const LowLatencyProfile& profile);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Returns one line per low latency setting, telling if it was applied.
+	*
+	*****************************************************************************/
+	std::vector<std::string> tuningReport();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Keep the Serial thread alive when the port is lost, and reopen it.
+	*
+	* Without reconnect, a read error or the message timeout terminates the
+	* Serial thread. With reconnect, the port is closed and reopened in place
+	* instead: first at once, then with exponential backoff from minDelay up to
+	* maxDelay between attempts. The message queue, read buffer and write queue
+	* survive; data of an unterminated message is discarded, and writes issued
+	* while the port is down fail. Only for ports opened by device name.
+	*
+	* Nothing is pushed into the message queue on link down or up, so a
+	* consumer that needs to know registers a handler with setLinkHandler().
+	*
+	* \param enable true to reconnect.
+	* \param minDelay Delay in milliseconds before the second attempt.
+	* \param maxDelay Max delay in milliseconds between attempts.
+	*
+	*****************************************************************************/
+	void setReconnect(bool enable, std::uint32_t minDelay = RECONNECT_MIN_DELAY, std::uint32_t maxDelay = RECONNECT_MAX_DELAY);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Set the handler of link down/up events. Set before the Serial thread is started.
+	*
+	* \param handler Link event handler. May be empty.
+	*
+	*****************************************************************************/
+	void setLinkHandler(const LinkHandler& handler);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Returns true unless the port was lost and not yet reopened.
+	*
+	*****************************************************************************/
+	bool isConnected() const;
+
+
+	/****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the reconnect counters.
+	*
+	*****************************************************************************/
+	LinkStatistics linkStatistics();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Record all received data, as read from the serial device.
+	*
+	* Set before the Serial thread is started. Recording only queues the data,
+	* the capture writes it to file in its own thread.
+	*
+	* \param capture Capture to record into. Not owned. nullptr stops recording.
+	* \param port Port id in the capture, to tell ports sharing a capture apart.
+	*
+	*****************************************************************************/
+	void setCapture(SerialCapture *capture, std::uint16_t port = 0);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Stamp each received message for latency measurement.
+	*
+	* Set before the Serial thread is started, after the bounds of the
+	* message queue. The consumer of the message queue calls probe->popped()
+	* after each pop.
+	*
+	* \param probe Probe of this port. Not owned. nullptr disables stamping.
+	*
+	* \throws std::invalid_argument if the message queue may discard messages,
+	* see MessageQueue::discards().
+	*
+	*****************************************************************************/
+	void setLatencyProbe(LatencyProbe *probe);
+
+
 	/****************************************************************************/
 	/**
 	* \brief Write data
@@ -181,15 +400,60 @@ public:
 	void writeString(const std::string& s);
 
 
+	/****************************************************************************/
+	/**
+	* \brief Queue data to be written by the Serial thread.
+	*
+	* Returns without waiting for the write. Queued writes are coalesced into
+	* scatter-gather batches and sent on the io_service of the Serial thread,
+	* so the thread (operator()) must be running. The handler is called from
+	* the Serial thread when the write completed, failed or missed its deadline.
+	*
+	* \param data Data to send.
+	* \param handler Completion handler. May be empty.
+	* \param milliSeconds Max time to wait for room in a full write queue.
+	*
+	* \return false if the write queue stayed full or the Serial thread is dead.
+	*
+	*****************************************************************************/
+	bool asyncWrite(const std::string& data, const WriteHandler& handler, std::uint32_t milliSeconds = 0);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Queue data to be written by the Serial thread.
+	*
+	* As above, but the outcome is delivered through a future. The future throws
+	* timeout_exception if the write deadline expired and
+	* boost::system::system_error on any other error, including a full queue.
+	*
+	* \param data Data to send.
+	* \param milliSeconds Max time to wait for room in a full write queue.
+	*
+	* \return Future holding the nr of bytes written.
+	*
+	*****************************************************************************/
+	std::future<std::size_t> asyncWrite(const std::string& data, std::uint32_t milliSeconds = 0);
+
+
 	/****************************************************************************/
 	/**
 	* \brief Serial device read thread.
 	*
 	* Read lines/messages from serial device, post a string with the received data
 	* into the message queue. The line delimiter is removed from the string.
+	* All messages completed by one read are posted before the next read.
+	*
+	* With a delimiter, can only be used if the user is sure that the serial
+	* device will not send binary data. For binary data, construct with a
+	* LengthPrefixFramer or an EscapedFramer; frames failing their checksum
+	* are dropped and never posted.
+	*
+	* Also runs the asynchronous writes. An instance created with the writer
+	* constructor only runs the writes, and is not subject to the message timeout.
 	*
-	* Can only be used if the user is sure that the serial device will not
-	* send binary data.
+	* A read error or the message timeout terminates the thread, unless
+	* setReconnect() is enabled; then the port is reopened in place.
 	*
 	* \throw boost::system::system_error if any error
 	* \throw timeout_exception in case of timeout
@@ -215,16 +479,104 @@ public:
 	******************************************************************************/
 	void requestStop();
 
+	/**
+	* Serial thread settings
+	*/
+	enum Settings
+	{
+		MESSAGE_TIMEOUT = 360,	///< Default message timeout in seconds.
+		WRITE_QUEUE_DEPTH = 64,	///< Default max nr of queued asynchronous writes.
+		WRITE_BATCH_SIZE = 16,	///< Max nr of writes coalesced into one scatter-gather write.
+		READ_BUFFER_SIZE = 4096,	///< Min free space in the read buffer per read.
+		RECONNECT_MIN_DELAY = 10,	///< Default delay in milliseconds before the second reopen attempt.
+		RECONNECT_MAX_DELAY = 5000,	///< Default max delay in milliseconds between reopen attempts.
+		OPEN_RETRIES = 2,			///< Extra open() attempts without reconnect.
+		OPEN_RETRY_DELAY = 100,		///< Delay in milliseconds between open() attempts without reconnect.
+	};
+
 private:
 
+	/**
+	* An asynchronous write, queued or in flight.
+	*/
+	struct PendingWrite
+	{
+		std::string data;						///< Data to send.
+		WriteHandler handler;					///< Completion handler. May be empty.
+		boost::posix_time::ptime deadline;		///< Latest time to send the data.
+	};
+
+
 	/*****************************************************************************/
 	/**
-	* \brief Asynchronous read.
-	*
-	* \param delim Message delimiter.
+	* \brief Asynchronous read of whatever is available into the read buffer.
 	*
 	******************************************************************************/
-	void asyncReadUntil(const std::string& delim);
+	void asyncRead();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Open the serial device once and apply the line settings.
+	*
+	* \return true upon success, false if the device could not be opened.
+	*
+	* \throws boost::system::system_error if the line settings cannot be applied
+	*
+	*****************************************************************************/
+	bool openDevice();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Apply the port settings of the low latency profile, if any.
+	*
+	*****************************************************************************/
+	void tunePort();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Returns true if a lost port is to be reopened.
+	*
+	*****************************************************************************/
+	bool canReconnect() const;
+
+
+	/****************************************************************************/
+	/**
+	* \brief Close the lost port, report link down and schedule the first reopen.
+	*
+	*****************************************************************************/
+	void disconnect();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Try to reopen the port. Schedules the next attempt on failure.
+	*
+	* \return true if reopened.
+	*
+	*****************************************************************************/
+	bool reconnect();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Wait the current backoff delay, then set result to resultReconnect.
+	*
+	*****************************************************************************/
+	void scheduleReconnect();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Callback called when the backoff delay expired or was canceled.
+	*
+	* \param error Boost error code.
+	*
+	*****************************************************************************/
+	void reconnectExpired(const boost::system::error_code& error);
 
 
 	/*****************************************************************************/
@@ -268,12 +620,60 @@ private:
 	*
 	* \param error Boost error code.
 	* \param bytesTransferred Nr of bytes read from serial device.
+	* \param generation Port generation the read was started on. Reads of a
+	* lost port are ignored.
 	*
 	*****************************************************************************/
 	void readCompleted(const boost::system::error_code& error,
+		const size_t bytesTransferred, std::uint64_t generation);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Start sending the next batch of queued writes. Serial thread only.
+	*
+	* Writes whose deadline already expired are completed without being sent.
+	*
+	*****************************************************************************/
+	void startWrite();
+
+
+	/****************************************************************************/
+	/**
+	* \brief Callback called when a batch of writes completed or failed.
+	*
+	* \param error Boost error code.
+	* \param bytesTransferred Nr of bytes written to serial device.
+	*
+	*****************************************************************************/
+	void writeCompleted(const boost::system::error_code& error,
 		const size_t bytesTransferred);
 
 
+	/****************************************************************************/
+	/**
+	* \brief Callback called when the deadline of the current batch expired or was canceled.
+	*
+	* If expired, cancels the pending operations on the port. An interrupted read
+	* is restarted by readCompleted(). Ignored if the batch is no longer in flight.
+	*
+	* \param error Boost error code.
+	* \param generation writeGeneration_ of the batch the deadline was set for.
+	*
+	*****************************************************************************/
+	void writeTimeoutExpired(const boost::system::error_code& error, std::uint64_t generation);
+
+
+	/****************************************************************************/
+	/**
+	* \brief Complete all queued and in flight writes with an error.
+	*
+	* \param error Error passed to the completion handlers.
+	*
+	*****************************************************************************/
+	void failWrites(const boost::system::error_code& error);
+
+
 	/*****************************************************************************/
 	/**
 	* \brief Terminate Serial thread.
@@ -282,14 +682,6 @@ private:
 	void cleanup();
 
 
-	/**
-	* Message timeout settings
-	*/
-	enum Settings
-	{
-		MESSAGE_TIMEOUT = 360,	///< Timeout in seconds.
-	};
-
 	/**
 	* Possible outcome of a read. Set by callbacks, read from main code
 	*/
@@ -297,8 +689,9 @@ private:
 	{
 		resultInProgress,		///< Waiting for data.
 		resultSuccess,			///< Writing data to queue.
-		resultError,			///< Error. Terminate thread.
-		resultTimeoutExpired	///< Check for stopRequested or message timeout.
+		resultError,			///< Error. Reconnect or terminate thread.
+		resultTimeoutExpired,	///< Check for stopRequested or message timeout.
+		resultReconnect			///< Backoff delay expired. Try to reopen the port.
 	};
 
 	boost::asio::io_service io_;					///< Io service object.
@@ -311,13 +704,44 @@ private:
 	boost::asio::serial_port_base::stop_bits opt_stop_;			///< Nr of stopbits.
 	boost::asio::deadline_timer timer_;							///< Timer for timeout.
 	boost::posix_time::time_duration timeout_;					///< Read/write timeout.
-	boost::asio::streambuf readData_;				///< Holds eventual read but not consumed data.
 	enum ReadResult result_;						///< Read status. Used by read with timeout.
 	size_t bytesTransferred_;						///< Nr of bytes read from serial device.
-	std::string delim_;								///< Message delimiter.
-	ThreadSafeQueue<std::string *> *queue_;			///< Queue for received messages.
+	std::unique_ptr<Framer> ownFramer_;				///< Framer created from a delimiter.
+	Framer *framer_;								///< Splits the received data into messages.
+	FrameAssembler assembler_;						///< Read buffer. Posts the received messages.
+	char *readData_;								///< Where the read in progress puts its data.
+	std::int64_t readTime_;							///< Completion time of the last read, if probed.
+	SerialCapture *capture_;						///< Records the received data. May be nullptr.
+	std::uint16_t capturePort_;						///< Port id in the capture.
+	MessageQueue<std::string *> *queue_;			///< Queue for received messages.
 	std::mutex mutex_;								///< Handles synchronization with DataSource thread.
 	std::atomic<bool> isAlive_;						///< True if the Serial thread is alive.
 	std::atomic<bool> stopRequested_;				///< Request to terminate Serial thread.
+	boost::asio::deadline_timer writeTimer_;		///< Deadline of the write batch in flight.
+	boost::posix_time::time_duration writeTimeout_;	///< Deadline of asynchronous writes.
+	std::deque<PendingWrite> writeQueue_;			///< Writes waiting to be sent. Guarded by writeMutex_.
+	std::vector<PendingWrite> writeBatch_;			///< Writes in flight. Only used by the Serial thread.
+	std::size_t writeQueueDepth_;					///< Max nr of queued writes.
+	bool writeInProgress_;							///< True if a batch is in flight or posted. Guarded by writeMutex_.
+	bool writeCanceled_;							///< True if the batch in flight was canceled by its deadline.
+	std::uint64_t writeGeneration_;					///< Incremented per batch, so a stale deadline is ignored.
+	std::uint32_t messageTimeout_;					///< Message timeout in seconds, 0 for none.
+	bool readRestart_;								///< True if the read was canceled by an expired write.
+	std::mutex writeMutex_;							///< Guards the write queue.
+	std::condition_variable writeSpace_;			///< Signaled when the write queue has room.
+	boost::asio::deadline_timer reconnectTimer_;	///< Backoff delay between reopen attempts.
+	bool reconnect_;								///< True to reopen a lost port.
+	std::uint32_t reconnectMinDelay_;				///< Delay in milliseconds before the second attempt.
+	std::uint32_t reconnectMaxDelay_;				///< Max delay in milliseconds between attempts.
+	std::uint32_t reconnectDelay_;					///< Delay before the next attempt.
+	std::atomic<bool> connected_;					///< False while the port is lost.
+	std::uint64_t readGeneration_;					///< Incremented when the port is lost.
+	std::chrono::steady_clock::time_point downSince_;	///< When the port was lost.
+	LinkHandler linkHandler_;						///< Link event handler. May be empty.
+	LinkStatistics linkStatistics_;					///< Reconnect counters. Guarded by mutex_.
+	bool tuned_;									///< True if profile_ is to be applied.
+	LowLatencyProfile profile_;						///< Low latency settings.
+	std::vector<std::string> portReport_;			///< Outcome of the port settings. Guarded by mutex_.
+	std::vector<std::string> threadReport_;			///< Outcome of the thread settings. Guarded by mutex_.
 };
 
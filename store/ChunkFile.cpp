@@ -0,0 +1,295 @@
+/*****************************************************************************/
+/**
+* \file	ChunkFile.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "ChunkFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char MAGIC[8] = { 'S', 'C', 'I', 'T', 'S', '\0', '\0', '\x01' };
+
+ChunkFile::ChunkFile() :
+	base_(nullptr),
+	size_(0),
+	header_(nullptr),
+	times_(nullptr),
+	values_(nullptr),
+	tiers_(nullptr),
+	writable_(false)
+{
+	static_assert(sizeof(Header) <= HEADER_SIZE, "Chunk header exceeds its page");
+}
+
+ChunkFile::~ChunkFile()
+{
+	close();
+}
+
+bool ChunkFile::create(const std::string& path, std::size_t columns, std::size_t capacity)
+{
+	close();
+
+	capacity = (capacity + TIER1_FACTOR - 1) / TIER1_FACTOR * TIER1_FACTOR;
+	if (columns == 0 || capacity == 0 || capacity > static_cast<std::size_t>(INDEX_SIZE) * INDEX_STRIDE)
+	{
+		return false;
+	}
+
+	const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	const std::size_t size = fileSize(columns, capacity);
+	if (::ftruncate(fd, static_cast<off_t>(size)) != 0 || !map(fd, size, capacity, true))
+	{
+		::close(fd);
+		return false;
+	}
+	::close(fd);
+
+	// the rest of the file reads as zero; the sums of the tiers start there
+	std::memcpy(header_->magic, MAGIC, sizeof(MAGIC));
+	header_->columns = static_cast<std::uint32_t>(columns);
+	header_->capacity = static_cast<std::uint32_t>(capacity);
+	header_->rows = 0;
+	header_->firstTime = 0;
+	header_->lastTime = 0;
+	tiers_ = reinterpret_cast<Aggregate*>(values_ + columns * capacity);
+	return true;
+}
+
+bool ChunkFile::open(const std::string& path)
+{
+	close();
+
+	const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	Header header;
+	struct stat st;
+	bool valid = ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header))
+		&& std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+		&& header.columns > 0
+		&& header.capacity > 0
+		&& header.capacity <= static_cast<std::uint32_t>(INDEX_SIZE) * INDEX_STRIDE
+		&& header.capacity % TIER1_FACTOR == 0
+		&& header.rows <= header.capacity
+		&& ::fstat(fd, &st) == 0
+		&& static_cast<std::size_t>(st.st_size) == fileSize(header.columns, header.capacity);
+	valid = valid && map(fd, static_cast<std::size_t>(st.st_size), header.capacity, false);
+	::close(fd);
+	if (!valid)
+	{
+		return false;
+	}
+
+	tiers_ = reinterpret_cast<Aggregate*>(values_ + columns() * capacity());
+	return true;
+}
+
+void ChunkFile::close()
+{
+	if (base_)
+	{
+		if (writable_)
+		{
+			::msync(base_, size_, MS_ASYNC);
+		}
+		::munmap(base_, size_);
+	}
+	base_ = nullptr;
+	size_ = 0;
+	header_ = nullptr;
+	times_ = nullptr;
+	values_ = nullptr;
+	tiers_ = nullptr;
+	writable_ = false;
+}
+
+bool ChunkFile::append(std::int64_t time, const double *values)
+{
+	if (!writable_ || full())
+	{
+		return false;
+	}
+
+	const std::size_t row = rows();
+	const std::size_t n = columns();
+	const std::size_t cap = capacity();
+	if (row == 0)
+	{
+		header_->firstTime = time;
+	}
+	else
+	{
+		time = std::max(time, header_->lastTime);
+	}
+
+	times_[row] = time;
+	for (std::size_t c = 0; c < n; ++c)
+	{
+		values_[c * cap + row] = values[c];
+	}
+
+	for (std::size_t t = 0; t < TIERS; ++t)
+	{
+		const std::size_t factor = tierFactor(t);
+		const std::size_t bucket = row / factor;
+		Aggregate *tier = tiers_ + t * n * (cap / TIER0_FACTOR);
+		for (std::size_t c = 0; c < n; ++c)
+		{
+			Aggregate& a = tier[c * (cap / factor) + bucket];
+			if (row % factor == 0)
+			{
+				a.min = values[c];
+				a.max = values[c];
+				a.sum = values[c];
+			}
+			else
+			{
+				a.min = std::min(a.min, values[c]);
+				a.max = std::max(a.max, values[c]);
+				a.sum += values[c];
+			}
+		}
+	}
+
+	if (row % INDEX_STRIDE == 0)
+	{
+		header_->index[row / INDEX_STRIDE] = time;
+	}
+	header_->lastTime = time;
+
+	// publish the row last, a concurrent reader only sees complete rows
+	__atomic_store_n(&header_->rows, row + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+void ChunkFile::sync()
+{
+	if (base_ && writable_)
+	{
+		::msync(base_, size_, MS_SYNC);
+	}
+}
+
+bool ChunkFile::isOpen() const
+{
+	return base_ != nullptr;
+}
+
+bool ChunkFile::full() const
+{
+	return rows() >= capacity();
+}
+
+std::size_t ChunkFile::columns() const
+{
+	return header_ ? header_->columns : 0;
+}
+
+std::size_t ChunkFile::capacity() const
+{
+	return header_ ? header_->capacity : 0;
+}
+
+std::size_t ChunkFile::rows() const
+{
+	return header_ ? static_cast<std::size_t>(__atomic_load_n(&header_->rows, __ATOMIC_ACQUIRE)) : 0;
+}
+
+std::int64_t ChunkFile::firstTime() const
+{
+	return header_ ? header_->firstTime : 0;
+}
+
+std::int64_t ChunkFile::lastTime() const
+{
+	return header_ ? header_->lastTime : 0;
+}
+
+std::size_t ChunkFile::lowerBound(std::int64_t time) const
+{
+	const std::size_t n = rows();
+	if (n == 0)
+	{
+		return 0;
+	}
+
+	// last index entry before the time, the row lies within its stride
+	const std::size_t entries = (n + INDEX_STRIDE - 1) / INDEX_STRIDE;
+	const std::int64_t *index = header_->index;
+	const std::size_t entry = std::lower_bound(index, index + entries, time) - index;
+	const std::size_t first = (entry == 0) ? 0 : (entry - 1) * INDEX_STRIDE;
+	const std::size_t last = std::min(n, entry * INDEX_STRIDE + 1);
+	return std::lower_bound(times_ + first, times_ + last, time) - times_;
+}
+
+const std::int64_t *ChunkFile::times() const
+{
+	return times_;
+}
+
+const double *ChunkFile::values(std::size_t column) const
+{
+	return values_ + column * capacity();
+}
+
+const ChunkFile::Aggregate *ChunkFile::tier(std::size_t tier, std::size_t column) const
+{
+	const std::size_t cap = capacity();
+	return tiers_ + tier * columns() * (cap / TIER0_FACTOR) + column * (cap / tierFactor(tier));
+}
+
+std::size_t ChunkFile::tierFactor(std::size_t tier)
+{
+	return (tier == 0) ? TIER0_FACTOR : TIER1_FACTOR;
+}
+
+std::size_t ChunkFile::tierBuckets(std::size_t tier) const
+{
+	const std::size_t factor = tierFactor(tier);
+	return (rows() + factor - 1) / factor;
+}
+
+std::size_t ChunkFile::fileSize(std::size_t columns, std::size_t capacity)
+{
+	// every tier gets room for the buckets of tier 0, which keeps the offsets simple
+	return HEADER_SIZE
+		+ capacity * sizeof(std::int64_t)
+		+ columns * capacity * sizeof(double)
+		+ TIERS * columns * (capacity / TIER0_FACTOR) * sizeof(Aggregate);
+}
+
+bool ChunkFile::map(int fd, std::size_t size, std::size_t capacity, bool writable)
+{
+	void *base = ::mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+	{
+		return false;
+	}
+
+	base_ = base;
+	size_ = size;
+	header_ = static_cast<Header*>(base);
+	times_ = reinterpret_cast<std::int64_t*>(static_cast<char*>(base) + HEADER_SIZE);
+	values_ = reinterpret_cast<double*>(times_ + capacity);
+	writable_ = writable;
+	return true;
+}
@@ -0,0 +1,244 @@
+/*****************************************************************************/
+/**
+* \file	ChunkFile.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief One fixed-size, memory-mapped chunk of a time series.
+*
+* Rows of a time and a fixed nr of values are stored by column, so a range
+* of one column is contiguous. Layout, native byte order:
+*
+*   header   HEADER_SIZE bytes: magic, nr of columns, capacity, nr of rows,
+*            first and last time, and the time of every INDEX_STRIDE'th row
+*   times    capacity x int64
+*   values   capacity x double, per column
+*   tiers    per tier and column, capacity / factor x { min, max, sum }
+*
+* The tiers are maintained while appending, so downsampled reads never touch
+* the rows. The nr of rows in the header is updated after each row, so a
+* reader only ever sees complete rows. Times must not decrease.
+*
+******************************************************************************/
+class ChunkFile : private boost::noncopyable
+{
+public:
+
+	/**
+	* Layout constants
+	*/
+	enum Layout
+	{
+		HEADER_SIZE = 4096,		///< Size of the header, one page.
+		INDEX_STRIDE = 1024,	///< Rows between time index entries.
+		INDEX_SIZE = 496,		///< Max nr of time index entries, i.e. capacity <= INDEX_SIZE * INDEX_STRIDE.
+		TIERS = 2,				///< Nr of downsampling tiers.
+		TIER0_FACTOR = 64,		///< Rows per bucket of tier 0.
+		TIER1_FACTOR = 4096,	///< Rows per bucket of tier 1.
+	};
+
+	/**
+	* Downsampled values of one bucket.
+	*/
+	struct Aggregate
+	{
+		double min;		///< Smallest value.
+		double max;		///< Largest value.
+		double sum;		///< Sum of the values, for the mean.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. No file.
+	*
+	******************************************************************************/
+	ChunkFile();
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Closes the file.
+	*
+	*****************************************************************************/
+	~ChunkFile();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Create an empty chunk for writing. The file is sparse until written.
+	*
+	* \param path Chunk file. Truncated if it exists.
+	* \param columns Nr of values per row.
+	* \param capacity Max nr of rows. Rounded up to a multiple of TIER1_FACTOR.
+	*
+	* \return true upon success.
+	*
+	******************************************************************************/
+	bool create(const std::string& path, std::size_t columns, std::size_t capacity);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Open a chunk for reading.
+	*
+	* \param path Chunk file.
+	*
+	* \return false if missing or not a chunk.
+	*
+	******************************************************************************/
+	bool open(const std::string& path);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Unmap and close the file.
+	*
+	******************************************************************************/
+	void close();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Append a row. Writable chunks only.
+	*
+	* \param time Row time. Raised to the last time if smaller.
+	* \param values One value per column.
+	*
+	* \return false if full.
+	*
+	******************************************************************************/
+	bool append(std::int64_t time, const double *values);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Flush the written rows to disk.
+	*
+	******************************************************************************/
+	void sync();
+
+
+	bool isOpen() const;				///< Returns true if a file is mapped.
+	bool full() const;					///< Returns true if no row fits.
+	std::size_t columns() const;		///< Returns the nr of values per row.
+	std::size_t capacity() const;		///< Returns the max nr of rows.
+	std::size_t rows() const;			///< Returns the nr of rows.
+	std::int64_t firstTime() const;		///< Returns the time of the first row.
+	std::int64_t lastTime() const;		///< Returns the time of the last row.
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the first row with a time not before the given time.
+	*
+	* Uses the time index, then a binary search within one stride.
+	*
+	* \param time Time to find.
+	*
+	* \return Row, rows() if all rows are earlier.
+	*
+	******************************************************************************/
+	std::size_t lowerBound(std::int64_t time) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the time column.
+	*
+	******************************************************************************/
+	const std::int64_t *times() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a value column.
+	*
+	* \param column Column, less than columns().
+	*
+	******************************************************************************/
+	const double *values(std::size_t column) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the buckets of a downsampling tier.
+	*
+	* Bucket b covers rows b * factor up to (b + 1) * factor; the last one may
+	* be partial, see tierBuckets().
+	*
+	* \param tier Tier, less than TIERS.
+	* \param column Column, less than columns().
+	*
+	******************************************************************************/
+	const Aggregate *tier(std::size_t tier, std::size_t column) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of rows per bucket of a tier.
+	*
+	******************************************************************************/
+	static std::size_t tierFactor(std::size_t tier);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of buckets of a tier holding rows.
+	*
+	******************************************************************************/
+	std::size_t tierBuckets(std::size_t tier) const;
+
+private:
+
+	/**
+	* File header, at offset 0.
+	*/
+	struct Header
+	{
+		char magic[8];						///< "SCITS", 0, 0, 1.
+		std::uint32_t columns;				///< Nr of values per row.
+		std::uint32_t capacity;				///< Max nr of rows.
+		std::uint64_t rows;					///< Nr of complete rows.
+		std::int64_t firstTime;				///< Time of the first row.
+		std::int64_t lastTime;				///< Time of the last row.
+		std::int64_t index[INDEX_SIZE];		///< Time of row i * INDEX_STRIDE.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the file size of a chunk.
+	*
+	******************************************************************************/
+	static std::size_t fileSize(std::size_t columns, std::size_t capacity);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Map the file and point the columns into it.
+	*
+	******************************************************************************/
+	bool map(int fd, std::size_t size, std::size_t capacity, bool writable);
+
+
+	void *base_;				///< Mapping of the whole file.
+	std::size_t size_;			///< Size of the mapping.
+	Header *header_;			///< Header in the mapping.
+	std::int64_t *times_;		///< Time column in the mapping.
+	double *values_;			///< First value column in the mapping.
+	Aggregate *tiers_;			///< First tier in the mapping.
+	bool writable_;				///< True if created for writing.
+};
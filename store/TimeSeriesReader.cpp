@@ -0,0 +1,201 @@
+/*****************************************************************************/
+/**
+* \file	TimeSeriesReader.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "TimeSeriesReader.hpp"
+#include "TimeSeriesStore.hpp"
+#include "ChunkFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <limits>
+
+
+static const double MISSING = std::numeric_limits<double>::quiet_NaN();
+
+TimeSeriesReader::TimeSeriesReader(const std::string& root) :
+	root_(root)
+{
+}
+
+std::vector<std::string> TimeSeriesReader::series() const
+{
+	std::vector<std::string> tags;
+	if (DIR *dir = ::opendir(root_.c_str()))
+	{
+		while (dirent *entry = ::readdir(dir))
+		{
+			if (entry->d_name[0] != '.')
+			{
+				tags.push_back(entry->d_name);
+			}
+		}
+		::closedir(dir);
+	}
+	std::sort(tags.begin(), tags.end());
+	return tags;
+}
+
+bool TimeSeriesReader::query(const std::string& tag, std::int64_t from, std::int64_t to, Range& range) const
+{
+	range.times.clear();
+	range.columns.clear();
+
+	std::vector<std::string> paths;
+	if (!chunks(tag, paths))
+	{
+		return false;
+	}
+
+	ChunkFile chunk;
+	for (const std::string& path : paths)
+	{
+		if (!chunk.open(path) || chunk.rows() == 0 || chunk.lastTime() < from)
+		{
+			continue;
+		}
+		if (chunk.firstTime() >= to)
+		{
+			break;
+		}
+
+		const std::size_t first = chunk.lowerBound(from);
+		const std::size_t last = chunk.lowerBound(to);
+		const std::size_t before = range.times.size();
+		range.times.insert(range.times.end(), chunk.times() + first, chunk.times() + last);
+
+		// rows before hold NaN in columns this chunk adds, rows here in columns it lacks
+		if (range.columns.size() < chunk.columns())
+		{
+			range.columns.resize(chunk.columns(), std::vector<double>(before, MISSING));
+		}
+		for (std::size_t c = 0; c < range.columns.size(); ++c)
+		{
+			if (c < chunk.columns())
+			{
+				range.columns[c].insert(range.columns[c].end(), chunk.values(c) + first, chunk.values(c) + last);
+			}
+			else
+			{
+				range.columns[c].resize(range.times.size(), MISSING);
+			}
+		}
+	}
+	return true;
+}
+
+bool TimeSeriesReader::summarize(const std::string& tag, std::int64_t from, std::int64_t to, std::size_t tier, Summary& summary) const
+{
+	summary.times.clear();
+	summary.counts.clear();
+	summary.min.clear();
+	summary.max.clear();
+	summary.mean.clear();
+
+	std::vector<std::string> paths;
+	if (tier >= ChunkFile::TIERS || !chunks(tag, paths))
+	{
+		return false;
+	}
+
+	const std::size_t factor = ChunkFile::tierFactor(tier);
+	ChunkFile chunk;
+	for (const std::string& path : paths)
+	{
+		if (!chunk.open(path) || chunk.rows() == 0 || chunk.lastTime() < from)
+		{
+			continue;
+		}
+		if (chunk.firstTime() >= to)
+		{
+			break;
+		}
+
+		// the bucket holding the first row at or after from, up to the one starting at to;
+		// a writer may append meanwhile, so all bounds come from one snapshot of the rows
+		const std::size_t rows = chunk.rows();
+		const std::size_t first = std::min(chunk.lowerBound(from), rows - 1) / factor;
+		const std::size_t last = (std::min(chunk.lowerBound(to), rows) + factor - 1) / factor;
+		const std::size_t before = summary.times.size();
+		for (std::size_t b = first; b < last; ++b)
+		{
+			summary.times.push_back(chunk.times()[b * factor]);
+			summary.counts.push_back(static_cast<std::uint32_t>(std::min(factor, rows - b * factor)));
+		}
+
+		if (summary.min.size() < chunk.columns())
+		{
+			summary.min.resize(chunk.columns(), std::vector<double>(before, MISSING));
+			summary.max.resize(chunk.columns(), std::vector<double>(before, MISSING));
+			summary.mean.resize(chunk.columns(), std::vector<double>(before, MISSING));
+		}
+		for (std::size_t c = 0; c < summary.min.size(); ++c)
+		{
+			if (c >= chunk.columns())
+			{
+				summary.min[c].resize(summary.times.size(), MISSING);
+				summary.max[c].resize(summary.times.size(), MISSING);
+				summary.mean[c].resize(summary.times.size(), MISSING);
+				continue;
+			}
+
+			const ChunkFile::Aggregate *buckets = chunk.tier(tier, c);
+			const double *values = chunk.values(c);
+			for (std::size_t b = first; b < last; ++b)
+			{
+				const std::size_t count = summary.counts[before + b - first];
+				if (count == factor)
+				{
+					summary.min[c].push_back(buckets[b].min);
+					summary.max[c].push_back(buckets[b].max);
+					summary.mean[c].push_back(buckets[b].sum / count);
+					continue;
+				}
+
+				// a partial bucket may already aggregate rows past the snapshot
+				double min = values[b * factor];
+				double max = min;
+				double sum = 0;
+				for (std::size_t r = b * factor; r < rows; ++r)
+				{
+					min = std::min(min, values[r]);
+					max = std::max(max, values[r]);
+					sum += values[r];
+				}
+				summary.min[c].push_back(min);
+				summary.max[c].push_back(max);
+				summary.mean[c].push_back(sum / count);
+			}
+		}
+	}
+	return true;
+}
+
+bool TimeSeriesReader::chunks(const std::string& tag, std::vector<std::string>& paths) const
+{
+	const std::string path = TimeSeriesStore::seriesPath(root_, tag);
+	DIR *dir = ::opendir(path.c_str());
+	if (!dir)
+	{
+		return false;
+	}
+
+	// zero padded sequence nrs sort in time order
+	while (dirent *entry = ::readdir(dir))
+	{
+		const std::size_t size = std::strlen(entry->d_name);
+		if (size > 6 && std::strcmp(entry->d_name + size - 6, ".chunk") == 0)
+		{
+			paths.push_back(path + "/" + entry->d_name);
+		}
+	}
+	::closedir(dir);
+	std::sort(paths.begin(), paths.end());
+	return true;
+}
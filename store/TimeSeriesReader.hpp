@@ -0,0 +1,121 @@
+/*****************************************************************************/
+/**
+* \file	TimeSeriesReader.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <boost/utility.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Time range queries on the series of a TimeSeriesStore.
+*
+* Only the chunks overlapping the range are mapped, and of those only the
+* pages holding the range are read, so a query of a few minutes costs the
+* same in a store of a week. Series may be appended while read; a query sees
+* the rows stored when it reached their chunk.
+*
+* Columns are numbered as the numeric fields of the tag. Rows of chunks with
+* fewer columns read as NaN in the missing ones.
+*
+******************************************************************************/
+class TimeSeriesReader : private boost::noncopyable
+{
+public:
+
+	/**
+	* Rows of a range, struct-of-arrays.
+	*/
+	struct Range
+	{
+		std::vector<std::int64_t> times;				///< Row times, system clock nanoseconds.
+		std::vector<std::vector<double>> columns;		///< Values per column.
+	};
+
+	/**
+	* Downsampled rows of a range, one per bucket.
+	*/
+	struct Summary
+	{
+		std::vector<std::int64_t> times;				///< Time of the first row of each bucket.
+		std::vector<std::uint32_t> counts;				///< Nr of rows of each bucket.
+		std::vector<std::vector<double>> min;			///< Smallest value per column.
+		std::vector<std::vector<double>> max;			///< Largest value per column.
+		std::vector<std::vector<double>> mean;			///< Mean value per column.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param root Store directory.
+	*
+	******************************************************************************/
+	explicit TimeSeriesReader(const std::string& root);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the names of the stored series, tags as in
+	* TimeSeriesStore::seriesPath().
+	*
+	******************************************************************************/
+	std::vector<std::string> series() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Read the rows of a time range.
+	*
+	* \param tag Series.
+	* \param from First time, system clock nanoseconds.
+	* \param to Time after the last row.
+	* \param range Rows, replaced.
+	*
+	* \return false if the series does not exist.
+	*
+	******************************************************************************/
+	bool query(const std::string& tag, std::int64_t from, std::int64_t to, Range& range) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Read a time range downsampled to min, max and mean.
+	*
+	* Reads the precomputed buckets of a tier, ChunkFile::TIER0_FACTOR or
+	* TIER1_FACTOR rows each. Buckets holding rows of the range are returned
+	* whole, so the edges of the range are rounded out to bucket boundaries.
+	*
+	* \param tag Series.
+	* \param from First time, system clock nanoseconds.
+	* \param to Time after the last bucket.
+	* \param tier Tier, 0 or 1.
+	* \param summary Buckets, replaced.
+	*
+	* \return false if the series does not exist or the tier is invalid.
+	*
+	******************************************************************************/
+	bool summarize(const std::string& tag, std::int64_t from, std::int64_t to, std::size_t tier, Summary& summary) const;
+
+private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the chunk files of a series in time order.
+	*
+	******************************************************************************/
+	bool chunks(const std::string& tag, std::vector<std::string>& paths) const;
+
+
+	std::string root_;		///< Store directory.
+};
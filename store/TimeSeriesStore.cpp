@@ -0,0 +1,207 @@
+/*****************************************************************************/
+/**
+* \file	TimeSeriesStore.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "TimeSeriesStore.hpp"
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+static bool makeDirectory(const std::string& path)
+{
+	return ::mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+TimeSeriesStore::TimeSeriesStore(const std::string& root, ThreadSafeQueue<SciBatch *>& input, std::size_t chunkRows) :
+	root_(root),
+	input_(input),
+	chunkRows_(chunkRows),
+	isOpen_(makeDirectory(root)),
+	clockOffset_(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch() - std::chrono::steady_clock::now().time_since_epoch()).count()),
+	series_(),
+	numeric_(),
+	row_(),
+	isAlive_(true),
+	stopRequested_(false),
+	batches_(0),
+	rows_(0),
+	chunks_(0),
+	errors_(0)
+{
+}
+
+TimeSeriesStore::~TimeSeriesStore()
+{
+	sync();
+}
+
+bool TimeSeriesStore::isOpen() const
+{
+	return isOpen_;
+}
+
+bool TimeSeriesStore::append(const SciBatch& batch)
+{
+	numeric_.clear();
+	for (std::size_t i = 0; i < batch.columns.size(); ++i)
+	{
+		if (batch.columns[i].type != SciColumn::typeText)
+		{
+			numeric_.push_back(i);
+		}
+	}
+	if (numeric_.empty() || batch.rows() == 0)
+	{
+		return true;
+	}
+
+	std::unique_ptr<Series>& s = series_[batch.tag];
+	if (!s)
+	{
+		s.reset(new Series);
+		s->path = seriesPath(root_, batch.tag);
+		s->next = 0;
+		if (!makeDirectory(s->path))
+		{
+			series_.erase(batch.tag);
+			++errors_;
+			return false;
+		}
+
+		// continue after the chunks of an earlier run
+		if (DIR *dir = ::opendir(s->path.c_str()))
+		{
+			while (dirent *entry = ::readdir(dir))
+			{
+				char *end = nullptr;
+				const unsigned long seq = std::strtoul(entry->d_name, &end, 10);
+				if (end != entry->d_name && std::string(end) == ".chunk" && seq >= s->next)
+				{
+					s->next = static_cast<std::uint32_t>(seq + 1);
+				}
+			}
+			::closedir(dir);
+		}
+	}
+
+	Series& series = *s;
+	if (series.chunk.isOpen() && series.chunk.columns() != numeric_.size())
+	{
+		series.chunk.close();
+	}
+
+	row_.resize(numeric_.size());
+	for (std::size_t r = 0; r < batch.rows(); ++r)
+	{
+		if ((!series.chunk.isOpen() || series.chunk.full()) && !roll(series, numeric_.size()))
+		{
+			++errors_;
+			return false;
+		}
+
+		for (std::size_t i = 0; i < numeric_.size(); ++i)
+		{
+			const SciColumn& column = batch.columns[numeric_[i]];
+			row_[i] = (column.type == SciColumn::typeInteger) ? static_cast<double>(column.integers[r]) : column.reals[r];
+		}
+		series.chunk.append(batch.times[r] + clockOffset_, row_.data());
+	}
+
+	++batches_;
+	rows_ += batch.rows();
+	return true;
+}
+
+void TimeSeriesStore::sync()
+{
+	for (std::map<std::string, std::unique_ptr<Series>>::value_type& s : series_)
+	{
+		s.second->chunk.sync();
+	}
+}
+
+void TimeSeriesStore::operator()()
+{
+	while (!stopRequested_)
+	{
+		SciBatch *batch = nullptr;
+		if (input_.waitPop(batch, POLL_TIMEOUT))
+		{
+			append(*batch);
+			delete batch;
+		}
+	}
+
+	// what the parser flushed on its way out
+	SciBatch *batch = nullptr;
+	while (input_.tryPop(batch))
+	{
+		append(*batch);
+		delete batch;
+	}
+
+	sync();
+	isAlive_ = false;
+}
+
+bool TimeSeriesStore::isAlive()
+{
+	return isAlive_;
+}
+
+void TimeSeriesStore::requestStop()
+{
+	stopRequested_ = true;
+}
+
+TimeSeriesStore::Statistics TimeSeriesStore::statistics() const
+{
+	Statistics s;
+	s.batches = batches_;
+	s.rows = rows_;
+	s.chunks = chunks_;
+	s.errors = errors_;
+	return s;
+}
+
+std::string TimeSeriesStore::seriesPath(const std::string& root, const std::string& tag)
+{
+	std::string name = tag;
+	for (char& c : name)
+	{
+		if (c == '/' || c == '.')
+		{
+			c = '_';
+		}
+	}
+	return root + "/" + name;
+}
+
+bool TimeSeriesStore::roll(Series& series, std::size_t columns)
+{
+	if (series.chunk.isOpen())
+	{
+		series.chunk.sync();
+	}
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "/%08u.chunk", static_cast<unsigned>(series.next));
+	if (!series.chunk.create(series.path + name, columns, chunkRows_))
+	{
+		return false;
+	}
+	++series.next;
+	++chunks_;
+	return true;
+}
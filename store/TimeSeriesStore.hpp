@@ -0,0 +1,184 @@
+/*****************************************************************************/
+/**
+* \file	TimeSeriesStore.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "ChunkFile.hpp"
+#include "SciBatch.hpp"
+#include "ThreadSafeQueue.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Append-only on-disk store of parsed parameters.
+*
+* Runs as a stage after the SciParser: pops batches and appends their numeric
+* columns to one series per tag. A series is a directory of fixed-size chunk
+* files, root/tag/00000000.chunk and up, see ChunkFile. A new chunk is started
+* when the current one is full, when the nr of numeric columns of the tag
+* changes, and when the store is reopened. Text columns are not stored.
+*
+* Times are stored as system clock nanoseconds, so series outlive the process.
+* Read the series with a TimeSeriesReader, also while they are written.
+*
+******************************************************************************/
+class TimeSeriesStore : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Creates the root directory if missing.
+	*
+	* \param root Store directory.
+	* \param input Queue of batches, e.g. the output of a SciParser.
+	* \param chunkRows Rows per chunk file.
+	*
+	******************************************************************************/
+	TimeSeriesStore(const std::string& root, ThreadSafeQueue<SciBatch *>& input, std::size_t chunkRows = CHUNK_ROWS);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Flushes and closes the chunks.
+	*
+	*****************************************************************************/
+	~TimeSeriesStore();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the root directory is usable.
+	*
+	******************************************************************************/
+	bool isOpen() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Append a batch without the thread.
+	*
+	* \param batch Parsed rows, times in steady clock nanoseconds.
+	*
+	* \return false if a chunk could not be created. The rows are lost.
+	*
+	******************************************************************************/
+	bool append(const SciBatch& batch);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Flush the written rows of all series to disk.
+	*
+	******************************************************************************/
+	void sync();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Store thread. Appends the input queue until stopped, then syncs.
+	*
+	******************************************************************************/
+	void operator()();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the store thread is alive.
+	*
+	******************************************************************************/
+	bool isAlive();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set stop flag for the store thread.
+	*
+	******************************************************************************/
+	void requestStop();
+
+
+	/**
+	* Store counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t batches;		///< Batches appended.
+		std::uint64_t rows;			///< Rows appended.
+		std::uint64_t chunks;		///< Chunk files created.
+		std::uint64_t errors;		///< Batches lost on file errors.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the store counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the directory of a series, the tag with '/' and '.' replaced.
+	*
+	******************************************************************************/
+	static std::string seriesPath(const std::string& root, const std::string& tag);
+
+	/**
+	* Store settings
+	*/
+	enum Settings
+	{
+		CHUNK_ROWS = 65536,		///< Default rows per chunk file.
+		POLL_TIMEOUT = 100,		///< Wait for batches in milliseconds.
+	};
+
+private:
+
+	/**
+	* The chunk being written of a series.
+	*/
+	struct Series
+	{
+		std::string path;				///< Series directory.
+		std::uint32_t next;				///< Sequence nr of the next chunk.
+		ChunkFile chunk;				///< Current chunk, closed if none.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Start the next chunk of a series.
+	*
+	******************************************************************************/
+	bool roll(Series& series, std::size_t columns);
+
+
+	std::string root_;								///< Store directory.
+	ThreadSafeQueue<SciBatch *>& input_;			///< Queue of batches.
+	std::size_t chunkRows_;							///< Rows per chunk file.
+	bool isOpen_;									///< True if the root directory exists.
+	std::int64_t clockOffset_;						///< System minus steady clock, nanoseconds.
+	std::map<std::string, std::unique_ptr<Series>> series_;	///< Series per tag.
+	std::vector<std::size_t> numeric_;				///< Numeric columns of the batch being appended.
+	std::vector<double> row_;						///< Values of the row being appended.
+	std::atomic<bool> isAlive_;						///< True if the store thread is alive.
+	std::atomic<bool> stopRequested_;				///< Request to terminate the store thread.
+	std::atomic<std::uint64_t> batches_;			///< Batches appended.
+	std::atomic<std::uint64_t> rows_;				///< Rows appended.
+	std::atomic<std::uint64_t> chunks_;				///< Chunk files created.
+	std::atomic<std::uint64_t> errors_;				///< Batches lost on file errors.
+};
@@ -0,0 +1,82 @@
+/*****************************************************************************/
+/**
+* \file	Crc.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "Crc.hpp"
+
+
+/**
+* Lookup tables, built once on first use.
+*/
+struct CrcTables
+{
+	std::uint16_t crc16[256];		///< One byte per step, MSB first.
+	std::uint32_t crc32[4][256];	///< Slicing-by-4, LSB first.
+
+	CrcTables()
+	{
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			std::uint16_t c16 = static_cast<std::uint16_t>(i << 8);
+			std::uint32_t c32 = i;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				c16 = static_cast<std::uint16_t>((c16 & 0x8000) ? (c16 << 1) ^ 0x1021 : (c16 << 1));
+				c32 = (c32 & 1) ? (c32 >> 1) ^ 0xEDB88320u : (c32 >> 1);
+			}
+			crc16[i] = c16;
+			crc32[0][i] = c32;
+		}
+		for (std::uint32_t i = 0; i < 256; ++i)
+		{
+			for (int slice = 1; slice < 4; ++slice)
+			{
+				const std::uint32_t prev = crc32[slice - 1][i];
+				crc32[slice][i] = (prev >> 8) ^ crc32[0][prev & 0xFF];
+			}
+		}
+	}
+};
+
+static const CrcTables& tables()
+{
+	static const CrcTables t;
+	return t;
+}
+
+std::uint16_t crc16(const void *data, std::size_t size, std::uint16_t crc)
+{
+	const std::uint16_t *table = tables().crc16;
+	const std::uint8_t *p = static_cast<const std::uint8_t *>(data);
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		crc = static_cast<std::uint16_t>((crc << 8) ^ table[((crc >> 8) ^ p[i]) & 0xFF]);
+	}
+	return crc;
+}
+
+std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t crc)
+{
+	const CrcTables& t = tables();
+	const std::uint8_t *p = static_cast<const std::uint8_t *>(data);
+	crc = ~crc;
+
+	for (; size >= 4; size -= 4, p += 4)
+	{
+		crc ^= static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+			(static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+		crc = t.crc32[3][crc & 0xFF] ^ t.crc32[2][(crc >> 8) & 0xFF] ^
+			t.crc32[1][(crc >> 16) & 0xFF] ^ t.crc32[0][crc >> 24];
+	}
+	for (; size > 0; --size, ++p)
+	{
+		crc = (crc >> 8) ^ t.crc32[0][(crc ^ *p) & 0xFF];
+	}
+	return ~crc;
+}
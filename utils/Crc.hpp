@@ -0,0 +1,48 @@
+/*****************************************************************************/
+/**
+* \file	Crc.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Table driven CRC calculation.
+*
+* crc16: CRC-16/CCITT-FALSE. Polynomial 0x1021, initial value 0xFFFF, not reflected.
+* crc32: CRC-32 (IEEE 802.3). Reflected polynomial 0xEDB88320, initial value and
+* final xor 0xFFFFFFFF. Processes four bytes per step (slicing-by-4).
+*
+* To checksum data in pieces, pass the result of the previous piece as crc.
+*
+******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*****************************************************************************/
+/**
+* \brief Calculate CRC-16/CCITT-FALSE.
+*
+* \param data Data.
+* \param size Nr of bytes.
+* \param crc Result of the previous piece, or the initial value.
+*
+* \return The CRC.
+*
+******************************************************************************/
+std::uint16_t crc16(const void *data, std::size_t size, std::uint16_t crc = 0xFFFF);
+
+
+/*****************************************************************************/
+/**
+* \brief Calculate CRC-32.
+*
+* \param data Data.
+* \param size Nr of bytes.
+* \param crc Result of the previous piece, or 0 for the first piece.
+*
+* \return The CRC.
+*
+******************************************************************************/
+std::uint32_t crc32(const void *data, std::size_t size, std::uint32_t crc = 0);
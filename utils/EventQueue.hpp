@@ -0,0 +1,314 @@
+/*****************************************************************************/
+/**
+* \file	EventQueue.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "ThreadSafeQueue.hpp"
+#include <boost/system/system_error.hpp>
+#include <boost/utility.hpp>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief ThreadSafeQueue that signals readiness through an eventfd.
+*
+* The descriptor turns readable when the queue goes from drained to holding
+* an element, so an event loop waits on the queue together with sockets,
+* timers and serial ports instead of a thread blocking in waitPop(). Only
+* the first push after a drain writes the eventfd; a burst of pushes costs
+* one wake-up.
+*
+* Register fd() with epoll for EPOLLIN, or wrap a dup() of it in an asio
+* posix::stream_descriptor and async_wait(wait_read). When it turns
+* readable, call drain() until it returns less than asked for. drain()
+* re-arms the descriptor when it leaves elements behind, so edge-triggered
+* epoll does not lose them.
+*
+* The MessageQueue pops work as well, but leave the descriptor readable:
+* the next drain() then finds the queue empty and returns 0.
+*
+******************************************************************************/
+template <typename T>
+class EventQueue : public MessageQueue<T>, private boost::noncopyable
+{
+public:
+
+	/**
+	* Counters
+	*/
+	struct Statistics
+	{
+		std::size_t size;			///< Elements queued.
+		std::uint64_t pushed;		///< Elements pushed.
+		std::uint64_t notified;		///< Writes to the eventfd.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Creates the eventfd.
+	*
+	* \throws boost::system::system_error if any error
+	*
+	******************************************************************************/
+	EventQueue() :
+		fd_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+		signalled_(false),
+		pushed_(0),
+		notified_(0)
+	{
+		if (fd_ < 0)
+		{
+			throw boost::system::system_error(errno, boost::system::system_category(), "eventfd");
+		}
+	}
+
+
+	/****************************************************************************/
+	/**
+	* Destructor
+	*
+	*****************************************************************************/
+	~EventQueue()
+	{
+		::close(fd_);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the descriptor to wait on for readable. Owned by the queue.
+	*
+	******************************************************************************/
+	int fd() const
+	{
+		return fd_;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Bound the queue, see ThreadSafeQueue::setCapacity(). Set before use.
+	*
+	* A blocking push stalls the producer until the event loop drains, so a
+	* producer that must not stall wants one of the dropping policies.
+	*
+	* \throws std::invalid_argument if pointers may be discarded without a drop function
+	*
+	******************************************************************************/
+	void setCapacity(std::size_t capacity,
+		typename ThreadSafeQueue<T>::Overflow overflow = ThreadSafeQueue<T>::overflowDropOldest,
+		typename ThreadSafeQueue<T>::DropFunction drop = typename ThreadSafeQueue<T>::DropFunction(),
+		typename ThreadSafeQueue<T>::KeyFunction key = typename ThreadSafeQueue<T>::KeyFunction())
+	{
+		queue_.setCapacity(capacity, overflow, drop, key);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set how waitPop() waits, see ThreadSafeQueue. Set before use.
+	*
+	******************************************************************************/
+	void setWaitStrategy(const WaitStrategy& strategy)
+	{
+		queue_.setWaitStrategy(strategy);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element and signal the eventfd if the queue was drained.
+	*
+	* \param value The element.
+	*
+	* \return false if the element was discarded by the overflow policy.
+	*
+	******************************************************************************/
+	bool push(T value) override
+	{
+		if (!queue_.push(std::move(value)))
+		{
+			return false;
+		}
+		++pushed_;
+		notify();
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push several elements, signalling the eventfd once.
+	*
+	* \param values The elements, moved out. Cleared.
+	*
+	* \return Nr of elements not discarded.
+	*
+	******************************************************************************/
+	std::size_t pushBulk(std::vector<T>& values) override
+	{
+		const std::size_t pushed = queue_.pushBulk(values);
+		if (pushed > 0)
+		{
+			pushed_ += pushed;
+			notify();
+		}
+		return pushed;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Acknowledge the eventfd and pop the available elements.
+	*
+	* \param[out] out Popped elements are appended.
+	* \param[in] max Max nr of elements to pop.
+	*
+	* \return Nr of popped elements.
+	*
+	******************************************************************************/
+	std::size_t drain(std::vector<T>& out, std::size_t max = std::numeric_limits<std::size_t>::max())
+	{
+		std::uint64_t count;
+		if (::read(fd_, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		{
+			return 0;
+		}
+
+		// a push from here on signals again, one before is drained below
+		signalled_.store(false);
+		const std::size_t popped = queue_.drainTo(out, max);
+		if (!queue_.empty())
+		{
+			notify();
+		}
+		return popped;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element. Leaves the eventfd as it is.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool tryPop(T& out) override
+	{
+		return queue_.tryPop(out);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element, waiting for one. Leaves the eventfd as it is.
+	*
+	* \param[out] out Reference to popped element.
+	* \param[in] milliSeconds Pop timeout (in milliseconds).
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool waitPop(T& out, std::uint32_t milliSeconds) override
+	{
+		return queue_.waitPop(out, milliSeconds);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait for an element, then pop all available up to a max.
+	* Leaves the eventfd as it is.
+	*
+	* \param[out] out Popped elements are appended.
+	* \param[in] max Max nr of elements to pop.
+	* \param[in] milliSeconds Timeout (in milliseconds) waiting for the first.
+	*
+	* \return Nr of popped elements, 0 upon timeout.
+	*
+	******************************************************************************/
+	std::size_t waitPopBulk(std::vector<T>& out, std::size_t max, std::uint32_t milliSeconds) override
+	{
+		return queue_.waitPopBulk(out, max, milliSeconds);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Check if the queue is empty.
+	*
+	* \return true if the queue is empty, false otherwhise.
+	*
+	******************************************************************************/
+	bool empty() const override
+	{
+		return queue_.empty();
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the overflow policy may discard, see setCapacity().
+	*
+	******************************************************************************/
+	bool discards() const override
+	{
+		return queue_.discards();
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const
+	{
+		Statistics s;
+		s.size = queue_.statistics().size;
+		s.pushed = pushed_;
+		s.notified = notified_;
+		return s;
+	}
+
+private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Make the eventfd readable unless it already is.
+	*
+	******************************************************************************/
+	void notify()
+	{
+		if (!signalled_.exchange(true))
+		{
+			const std::uint64_t one = 1;
+			if (::write(fd_, &one, sizeof(one)) == sizeof(one))
+			{
+				++notified_;
+			}
+		}
+	}
+
+	ThreadSafeQueue<T> queue_;			///< The elements.
+	const int fd_;						///< eventfd, readable while signalled_.
+	std::atomic<bool> signalled_;		///< Written to the eventfd since the last drain().
+	std::atomic<std::uint64_t> pushed_;	///< Elements pushed.
+	std::atomic<std::uint64_t> notified_;	///< Writes to the eventfd.
+};
@@ -0,0 +1,158 @@
+/*****************************************************************************/
+/**
+* \file	FromChars.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "FromChars.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+/**
+* Exact powers of ten in a double.
+*/
+static const double POW10[] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isDigit(char c)
+{
+	return static_cast<unsigned char>(c - '0') < 10;
+}
+
+FromCharsResult fromChars(const char *first, const char *last, std::int64_t& value)
+{
+	FromCharsResult result = { first, false };
+	const char *p = first;
+	bool negative = false;
+	if (p != last && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		++p;
+	}
+
+	const char *digits = p;
+	std::uint64_t magnitude = 0;
+	const std::uint64_t limit = negative ? std::uint64_t(std::numeric_limits<std::int64_t>::max()) + 1 :
+		std::uint64_t(std::numeric_limits<std::int64_t>::max());
+	for (; p != last && isDigit(*p); ++p)
+	{
+		const unsigned d = static_cast<unsigned>(*p - '0');
+		if (magnitude > (limit - d) / 10)
+		{
+			// out of range, consume the rest of the number like from_chars
+			while (p != last && isDigit(*p))
+			{
+				++p;
+			}
+			result.ptr = p;
+			return result;
+		}
+		magnitude = magnitude * 10 + d;
+	}
+	if (p == digits)
+	{
+		return result;
+	}
+
+	value = negative ? static_cast<std::int64_t>(0 - magnitude) : static_cast<std::int64_t>(magnitude);
+	result.ptr = p;
+	result.ok = true;
+	return result;
+}
+
+FromCharsResult fromChars(const char *first, const char *last, double& value)
+{
+	FromCharsResult result = { first, false };
+	const char *p = first;
+	bool negative = false;
+	if (p != last && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		++p;
+	}
+
+	// up to 19 significant digits in the mantissa, the rest only scale
+	std::uint64_t mantissa = 0;
+	int significant = 0;
+	int exponent = 0;
+	bool any = false;
+	for (; p != last && isDigit(*p); ++p)
+	{
+		any = true;
+		if (significant < 19)
+		{
+			mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+			significant += (mantissa != 0);
+		}
+		else
+		{
+			++exponent;
+		}
+	}
+	if (p != last && *p == '.')
+	{
+		++p;
+		for (; p != last && isDigit(*p); ++p)
+		{
+			any = true;
+			if (significant < 19)
+			{
+				mantissa = mantissa * 10 + static_cast<unsigned>(*p - '0');
+				significant += (mantissa != 0);
+				--exponent;
+			}
+		}
+	}
+	if (!any)
+	{
+		return result;
+	}
+
+	if (p != last && (*p == 'e' || *p == 'E'))
+	{
+		// an exponent without digits is not part of the number
+		std::int64_t e = 0;
+		const FromCharsResult r = fromChars(p + 1, last, e);
+		if (r.ok)
+		{
+			p = r.ptr;
+			exponent += static_cast<int>(std::max<std::int64_t>(-100000, std::min<std::int64_t>(e, 100000)));
+		}
+	}
+
+	double v;
+	if (mantissa == 0)
+	{
+		v = 0.0;
+	}
+	else if (mantissa <= (std::uint64_t(1) << 53) && exponent >= -22 && exponent <= 22)
+	{
+		// both operands exact, so the result is correctly rounded
+		v = static_cast<double>(mantissa);
+		v = exponent < 0 ? v / POW10[-exponent] : v * POW10[exponent];
+	}
+	else
+	{
+		v = static_cast<double>(static_cast<long double>(mantissa) * std::pow(10.0L, exponent));
+	}
+
+	// out of range: too large, or a nonzero number too small for a normal double
+	if (std::isinf(v) || (mantissa != 0 && (v == 0.0 || std::fpclassify(v) == FP_SUBNORMAL)))
+	{
+		result.ptr = p;
+		return result;
+	}
+	value = negative ? -v : v;
+	result.ptr = p;
+	result.ok = true;
+	return result;
+}
@@ -0,0 +1,61 @@
+/*****************************************************************************/
+/**
+* \file	FromChars.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Locale independent number parsing in the manner of C++17 std::from_chars,
+* which this C++11 build does not have. No allocation, no streams, no errno.
+*
+* Accepted syntax: an optional sign, digits, and for reals an optional
+* fraction and exponent, e.g. -12, +3.25, .5, 1e-3. No whitespace, no hex,
+* no inf/nan.
+*
+******************************************************************************/
+#pragma once
+
+#include <cstdint>
+
+/**
+* Outcome of a parse.
+*/
+struct FromCharsResult
+{
+	const char *ptr;	///< First character not consumed. first on failure.
+	bool ok;			///< False if no number or out of range.
+};
+
+
+/*****************************************************************************/
+/**
+* \brief Parse a decimal integer.
+*
+* \param first Start of the text.
+* \param last End of the text.
+* \param[out] value Parsed value. Unchanged on failure.
+*
+* \return Where parsing stopped, and if it succeeded.
+*
+******************************************************************************/
+FromCharsResult fromChars(const char *first, const char *last, std::int64_t& value);
+
+
+/*****************************************************************************/
+/**
+* \brief Parse a decimal real.
+*
+* Correctly rounded for up to 15 significant digits and decimal exponents
+* within +-22, which covers all ventilator parameters. Beyond that, within
+* a few ulp. A nonzero value that overflows, or underflows to zero or a
+* subnormal, fails.
+*
+* \param first Start of the text.
+* \param last End of the text.
+* \param[out] value Parsed value. Unchanged on failure.
+*
+* \return Where parsing stopped, and if it succeeded.
+*
+******************************************************************************/
+FromCharsResult fromChars(const char *first, const char *last, double& value);
@@ -0,0 +1,126 @@
+/*****************************************************************************/
+/**
+* \file	LatencyHistogram.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "LatencyHistogram.hpp"
+#include <algorithm>
+#include <iomanip>
+
+
+LatencyHistogram::LatencyHistogram() :
+	count_(0),
+	sum_(0),
+	max_(0)
+{
+	for (std::atomic<std::uint64_t>& b : buckets_)
+	{
+		b.store(0, std::memory_order_relaxed);
+	}
+}
+
+void LatencyHistogram::record(std::int64_t ns)
+{
+	const std::uint64_t value = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+	buckets_[bucket(value)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add(value, std::memory_order_relaxed);
+
+	std::uint64_t max = max_.load(std::memory_order_relaxed);
+	while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed))
+	{
+	}
+}
+
+std::uint64_t LatencyHistogram::count() const
+{
+	return count_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const
+{
+	const std::uint64_t n = count();
+	return n > 0 ? static_cast<double>(sum_.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+std::uint64_t LatencyHistogram::max() const
+{
+	return max_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::percentile(double p) const
+{
+	// the buckets are read one by one, so sum them rather than trust count_
+	std::uint64_t total = 0;
+	for (const std::atomic<std::uint64_t>& b : buckets_)
+	{
+		total += b.load(std::memory_order_relaxed);
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	const std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(p / 100 * total + 0.5));
+	std::uint64_t seen = 0;
+	for (std::size_t i = 0; i < BUCKETS; ++i)
+	{
+		seen += buckets_[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+		{
+			return std::min(upperBound(i), max());
+		}
+	}
+	return max();
+}
+
+void LatencyHistogram::reset()
+{
+	for (std::atomic<std::uint64_t>& b : buckets_)
+	{
+		b.store(0, std::memory_order_relaxed);
+	}
+	count_.store(0, std::memory_order_relaxed);
+	sum_.store(0, std::memory_order_relaxed);
+	max_.store(0, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::print(std::ostream& out, const std::string& name) const
+{
+	const std::ios::fmtflags flags = out.flags();
+	const std::streamsize precision = out.precision();
+	out << std::fixed << std::setprecision(1) << name << ": n=" << count() << " mean=" << mean() / 1e3
+		<< " p50=" << percentile(50) / 1e3 << " p90=" << percentile(90) / 1e3
+		<< " p99=" << percentile(99) / 1e3 << " p99.9=" << percentile(99.9) / 1e3
+		<< " max=" << max() / 1e3 << " us" << std::endl;
+	out.flags(flags);
+	out.precision(precision);
+}
+
+std::size_t LatencyHistogram::bucket(std::uint64_t value)
+{
+	if (value < LINEAR)
+	{
+		return static_cast<std::size_t>(value);
+	}
+	const int exponent = 63 - __builtin_clzll(value);	// >= 4
+	const std::size_t sub = static_cast<std::size_t>(value >> (exponent - SUB_BITS)) & ((1 << SUB_BITS) - 1);
+	return LINEAR + (exponent - 4) * (1 << SUB_BITS) + sub;
+}
+
+std::uint64_t LatencyHistogram::upperBound(std::size_t bucket)
+{
+	if (bucket < LINEAR)
+	{
+		return bucket;
+	}
+	const int exponent = static_cast<int>((bucket - LINEAR) >> SUB_BITS) + 4;
+	const std::uint64_t sub = (bucket - LINEAR) & ((1 << SUB_BITS) - 1);
+	const std::uint64_t lower = (std::uint64_t(1) << exponent) + (sub << (exponent - SUB_BITS));
+	return lower + (std::uint64_t(1) << (exponent - SUB_BITS)) - 1;
+}
@@ -0,0 +1,136 @@
+/*****************************************************************************/
+/**
+* \file	LatencyHistogram.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Lock-free latency histogram. Any number of threads may record while
+* others read percentiles. Buckets are log-linear: exact below 16 ns, then
+* eight buckets per power of two, i.e. within 12.5 % over the full range.
+*
+******************************************************************************/
+#pragma once
+
+#include <boost/utility.hpp>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/*****************************************************************************/
+/**
+* \brief Histogram of latencies in nanoseconds.
+*
+******************************************************************************/
+class LatencyHistogram : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Empty histogram.
+	*
+	******************************************************************************/
+	LatencyHistogram();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Add a latency. Wait-free.
+	*
+	* \param ns Latency in nanoseconds. Negative values count as 0.
+	*
+	******************************************************************************/
+	void record(std::int64_t ns);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of recorded latencies.
+	*
+	******************************************************************************/
+	std::uint64_t count() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the mean latency in nanoseconds, 0 if empty.
+	*
+	******************************************************************************/
+	double mean() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the max latency in nanoseconds.
+	*
+	******************************************************************************/
+	std::uint64_t max() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a percentile in nanoseconds, 0 if empty.
+	*
+	* \param p Percentile, 0 - 100.
+	*
+	* \return Upper bound of the bucket holding the percentile, at most max().
+	*
+	******************************************************************************/
+	std::uint64_t percentile(double p) const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Clear the histogram. Latencies recorded meanwhile may be lost.
+	*
+	******************************************************************************/
+	void reset();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Print count, mean, p50, p90, p99, p99.9 and max in microseconds on one line.
+	*
+	* \param out Stream to print on.
+	* \param name Line prefix.
+	*
+	******************************************************************************/
+	void print(std::ostream& out, const std::string& name) const;
+
+private:
+
+	/**
+	* Bucket layout
+	*/
+	enum Layout
+	{
+		LINEAR = 16,							///< Values below this have a bucket each.
+		SUB_BITS = 3,							///< log2 of the nr of buckets per power of two.
+		BUCKETS = LINEAR + (64 - 4) * (1 << SUB_BITS),	///< Total nr of buckets.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the bucket of a value.
+	*
+	******************************************************************************/
+	static std::size_t bucket(std::uint64_t value);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the largest value in a bucket.
+	*
+	******************************************************************************/
+	static std::uint64_t upperBound(std::size_t bucket);
+
+
+	std::atomic<std::uint64_t> buckets_[BUCKETS];	///< Count per bucket.
+	std::atomic<std::uint64_t> count_;				///< Nr of recorded latencies.
+	std::atomic<std::uint64_t> sum_;				///< Sum of recorded latencies.
+	std::atomic<std::uint64_t> max_;				///< Max recorded latency.
+};
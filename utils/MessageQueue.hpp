@@ -0,0 +1,152 @@
+/*****************************************************************************/
+/**
+* \file	MessageQueue.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Queue interface of the receive path.
+*
+* What a serial reader pushes its messages to and a consumer pops them from,
+* so the queue implementation can be chosen per port, e.g. a ThreadSafeQueue
+* or an SpscQueue.
+*
+******************************************************************************/
+template <typename T>
+class MessageQueue
+{
+public:
+
+	/****************************************************************************/
+	/**
+	* Destructor
+	*
+	*****************************************************************************/
+	virtual ~MessageQueue()
+	{
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element into the queue.
+	*
+	* \param value The element.
+	*
+	* \return false if the element was discarded by the overflow policy, to the
+	* drop function of the queue.
+	*
+	******************************************************************************/
+	virtual bool push(T value) = 0;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push several elements, e.g. the frames of one read.
+	*
+	* \param values The elements, moved out. Cleared.
+	*
+	* \return Nr of elements not discarded by the overflow policy.
+	*
+	******************************************************************************/
+	virtual std::size_t pushBulk(std::vector<T>& values)
+	{
+		std::size_t pushed = 0;
+		for (T& value : values)
+		{
+			if (push(std::move(value)))
+			{
+				++pushed;
+			}
+		}
+		values.clear();
+		return pushed;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element from the queue.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	virtual bool tryPop(T& out) = 0;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element from the queue, waiting for one.
+	*
+	* \param[out] out Reference to popped element.
+	* \param[in] milliSeconds Pop timeout (in milliseconds).
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	virtual bool waitPop(T& out, std::uint32_t milliSeconds) = 0;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait for an element, then pop all available up to a max.
+	*
+	* \param[out] out Popped elements are appended.
+	* \param[in] max Max nr of elements to pop.
+	* \param[in] milliSeconds Timeout (in milliseconds) waiting for the first.
+	*
+	* \return Nr of popped elements, 0 upon timeout.
+	*
+	******************************************************************************/
+	virtual std::size_t waitPopBulk(std::vector<T>& out, std::size_t max, std::uint32_t milliSeconds)
+	{
+		T value;
+		if (max == 0 || !waitPop(value, milliSeconds))
+		{
+			return 0;
+		}
+		out.push_back(std::move(value));
+
+		std::size_t popped = 1;
+		while (popped < max && tryPop(value))
+		{
+			out.push_back(std::move(value));
+			++popped;
+		}
+		return popped;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Check if the queue is empty.
+	*
+	* \return true if the queue is empty, false otherwhise.
+	*
+	******************************************************************************/
+	virtual bool empty() const = 0;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if a push may discard an element, the pushed or a queued one.
+	*
+	******************************************************************************/
+	virtual bool discards() const
+	{
+		return false;
+	}
+};
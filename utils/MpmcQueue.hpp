@@ -0,0 +1,352 @@
+/*****************************************************************************/
+/**
+* \file	MpmcQueue.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "MessageQueue.hpp"
+#include "WaitStrategy.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*****************************************************************************/
+/**
+* \brief Bounded lock-free multi producer, multi consumer queue.
+*
+* For a fan-in point of several readers into a pool of consumers. The ring
+* is allocated once; each slot carries a sequence number telling whether it
+* is free for the push or filled for the pop of a given position (D. Vyukov's
+* bounded MPMC queue), so producers and consumers only contend on their own
+* position counter, one compare-and-swap per operation.
+*
+* Consumers waiting in waitPop() poll according to the WaitStrategy, by
+* default a brief spin, then park on a condition variable; producers take its
+* mutex only when a consumer is parked. A full
+* queue makes push() wait, or discard to the drop function if one is given.
+*
+******************************************************************************/
+template <typename T>
+class MpmcQueue : public MessageQueue<T>, private boost::noncopyable
+{
+public:
+
+	/**
+	* Called for each discarded element, e.g. to delete it.
+	*/
+	typedef std::function<void(T&)> DropFunction;
+
+	/**
+	* Queue counters.
+	*/
+	struct Statistics
+	{
+		std::size_t size;			///< Elements queued, approximate.
+		std::size_t capacity;		///< Ring size.
+		std::uint64_t dropped;		///< Elements discarded when full.
+		std::uint64_t blocked;		///< Pushes that waited for a pop.
+		std::uint64_t parked;		///< Pops that parked a consumer.
+	};
+
+	/**
+	* Queue settings
+	*/
+	enum Settings
+	{
+		CACHE_LINE = 64,		///< Cache line size, the separation of the counters.
+		SPIN_COUNT = 64,		///< Empty polls before a consumer parks, by default.
+		FULL_SLEEP = 50,		///< Producer sleep in microseconds while the ring is full.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param capacity Min nr of elements, rounded up to a power of two.
+	* \param drop Called for a pushed element when full, instead of waiting.
+	*
+	******************************************************************************/
+	explicit MpmcQueue(std::size_t capacity = 1024, DropFunction drop = DropFunction()) :
+		cells_(),
+		mask_(0),
+		drop_(drop),
+		wait_(WaitStrategy::spin(SPIN_COUNT)),
+		pushPos_(0),
+		popPos_(0),
+		waiting_(0),
+		dropped_(0),
+		blocked_(0),
+		parked_(0)
+	{
+		std::size_t size = 2;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		cells_.reset(new Cell[size]);
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		mask_ = size - 1;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set how waitPop() waits for an element. Set before use.
+	*
+	* \param strategy Wait strategy. Default: spin(SPIN_COUNT).
+	*
+	******************************************************************************/
+	void setWaitStrategy(const WaitStrategy& strategy)
+	{
+		wait_ = strategy;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element.
+	*
+	* \param value The element.
+	*
+	* \return false if full and the element went to the drop function.
+	*
+	******************************************************************************/
+	bool push(T value) override
+	{
+		if (!tryPush(value))
+		{
+			if (drop_)
+			{
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				drop_(value);
+				return false;
+			}
+
+			blocked_.fetch_add(1, std::memory_order_relaxed);
+			do
+			{
+				std::this_thread::sleep_for(std::chrono::microseconds(FULL_SLEEP));
+			}
+			while (!tryPush(value));
+		}
+
+		// pairs with the fence in waitPop(): either the consumer sees the element or we see it waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting_.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock{ mutex_ };
+			condition_.notify_one();
+		}
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element from the queue.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool tryPop(T& out) override
+	{
+		std::size_t pos = popPos_.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells_[pos & mask_];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+			if (diff == 0)
+			{
+				if (popPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					out = std::move(cell.data);
+					cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;	// not filled yet
+			}
+			else
+			{
+				pos = popPos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Blocking pop of an element from the queue.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	******************************************************************************/
+	void waitPop(T& out)
+	{
+		while (!waitPop(out, 1000))
+		{
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element from the queue, waiting for one.
+	*
+	* \param[out] out Reference to popped element.
+	* \param[in] milliSeconds Pop timeout (in milliseconds).
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool waitPop(T& out, std::uint32_t milliSeconds) override
+	{
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliSeconds);
+		if (wait_.poll([this, &out]() { return tryPop(out); }, deadline))
+		{
+			return true;
+		}
+		if (!wait_.parks())
+		{
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock{ mutex_ };
+		waiting_.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		parked_.fetch_add(1, std::memory_order_relaxed);
+		const bool popped = condition_.wait_until(lock, deadline, [this, &out]() {
+			return tryPop(out);
+		});
+		waiting_.fetch_sub(1, std::memory_order_relaxed);
+		return popped;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Check if the queue is empty.
+	*
+	* \return true if the queue is empty, false otherwhise.
+	*
+	******************************************************************************/
+	bool empty() const override
+	{
+		return popPos_.load(std::memory_order_acquire) >= pushPos_.load(std::memory_order_acquire);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if a push to a full ring discards, i.e. a drop function was given.
+	*
+	******************************************************************************/
+	bool discards() const override
+	{
+		return static_cast<bool>(drop_);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the queue counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const
+	{
+		const std::size_t popped = popPos_.load(std::memory_order_acquire);
+		const std::size_t pushed = pushPos_.load(std::memory_order_acquire);
+		Statistics s;
+		s.size = pushed > popped ? pushed - popped : 0;
+		s.capacity = mask_ + 1;
+		s.dropped = dropped_.load(std::memory_order_relaxed);
+		s.blocked = blocked_.load(std::memory_order_relaxed);
+		s.parked = parked_.load(std::memory_order_relaxed);
+		return s;
+	}
+
+private:
+
+	/**
+	* A slot of the ring.
+	*/
+	struct Cell
+	{
+		std::atomic<std::size_t> sequence;	///< Position it is free for, or filled for plus one.
+		T data;								///< The element.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element if there is room.
+	*
+	* \param value The element, moved from only upon success.
+	*
+	******************************************************************************/
+	bool tryPush(T& value)
+	{
+		std::size_t pos = pushPos_.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells_[pos & mask_];
+			const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+			if (diff == 0)
+			{
+				if (pushPos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					cell.data = std::move(value);
+					cell.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+			{
+				return false;	// not popped yet, full
+			}
+			else
+			{
+				pos = pushPos_.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+
+	std::unique_ptr<Cell[]> cells_;		///< Slots, a power of two.
+	std::size_t mask_;					///< Ring size minus one.
+	DropFunction drop_;					///< Called for a pushed element when full.
+	WaitStrategy wait_;					///< How consumers wait.
+
+	alignas(CACHE_LINE) std::atomic<std::size_t> pushPos_;	///< Next position to push. Shared by the producers.
+	alignas(CACHE_LINE) std::atomic<std::size_t> popPos_;	///< Next position to pop. Shared by the consumers.
+
+	alignas(CACHE_LINE) std::atomic<int> waiting_;			///< Nr of parked consumers.
+	std::mutex mutex_;										///< Guards parking.
+	std::condition_variable condition_;						///< Parked consumers.
+	std::atomic<std::uint64_t> dropped_;					///< Elements discarded when full.
+	std::atomic<std::uint64_t> blocked_;					///< Pushes that waited for a pop.
+	std::atomic<std::uint64_t> parked_;						///< Pops that parked a consumer.
+};
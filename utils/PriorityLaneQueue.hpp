@@ -0,0 +1,366 @@
+/*****************************************************************************/
+/**
+* \file	PriorityLaneQueue.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "MessageQueue.hpp"
+#include "WaitStrategy.hpp"
+#include <boost/utility.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Queue of several FIFO lanes popped in priority order.
+*
+* A classifier puts each pushed element in a lane, lane 0 first, e.g. alarms
+* in lane 0 and trend data in lane 1. A pop takes the front of the first
+* non-empty lane, so an alarm never waits behind queued readings. Each lane
+* has its own lock, and a lane count read without locking tells which lanes
+* to try, so bulk producers do not contend with alarm producers.
+*
+* The optional starvation guard serves the next non-empty lower lane once
+* after a given nr of consecutive pops passed it by. A lane may be bounded;
+* a push to a full lane waits for room without holding up the other lanes.
+*
+******************************************************************************/
+template <typename T>
+class PriorityLaneQueue : public MessageQueue<T>, private boost::noncopyable
+{
+public:
+
+	/**
+	* Returns the lane of an element, 0 for the highest priority.
+	* Lanes beyond the last go to the last.
+	*/
+	typedef std::function<std::size_t(const T&)> Classifier;
+
+	/**
+	* Counters of one lane.
+	*/
+	struct LaneStatistics
+	{
+		std::size_t size;			///< Elements queued.
+		std::size_t highWater;		///< Most elements ever queued.
+		std::uint64_t pushed;		///< Elements pushed.
+		std::uint64_t guarded;		///< Pops granted by the starvation guard.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param lanes Nr of lanes, at least 1.
+	* \param classify Lane of an element.
+	* \param laneCapacity Max nr of elements per lane, 0 for unbounded.
+	*
+	******************************************************************************/
+	PriorityLaneQueue(std::size_t lanes, Classifier classify, std::size_t laneCapacity = 0) :
+		lanes_(),
+		classify_(classify),
+		laneCapacity_(laneCapacity),
+		starvationLimit_(0),
+		wait_(WaitStrategy::blocking()),
+		streak_(0),
+		waiting_(0)
+	{
+		for (std::size_t i = 0; i < std::max<std::size_t>(lanes, 1); ++i)
+		{
+			lanes_.push_back(std::unique_ptr<Lane>(new Lane));
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Enable the starvation guard. Set before use.
+	*
+	* \param maxConsecutive Pops from higher lanes after which a waiting lower
+	* lane is served once, 0 to disable.
+	*
+	******************************************************************************/
+	void setStarvationGuard(std::size_t maxConsecutive)
+	{
+		starvationLimit_ = maxConsecutive;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set how waitPop() waits for an element. Set before use.
+	*
+	* \param strategy Wait strategy. Default: blocking().
+	*
+	******************************************************************************/
+	void setWaitStrategy(const WaitStrategy& strategy)
+	{
+		wait_ = strategy;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element into its lane.
+	*
+	* \param value The element.
+	*
+	* \return true.
+	*
+	******************************************************************************/
+	bool push(T value) override
+	{
+		Lane& lane = *lanes_[std::min(classify_(value), lanes_.size() - 1)];
+		std::unique_lock<std::mutex> lock{ lane.mutex };
+		if (laneCapacity_ > 0)
+		{
+			lane.space.wait(lock, [this, &lane]() { return lane.queue.size() < laneCapacity_; });
+		}
+		lane.queue.push_back(std::move(value));
+		lane.size.store(lane.queue.size(), std::memory_order_release);
+		lane.highWater = std::max(lane.highWater, lane.queue.size());
+		++lane.pushed;
+		lock.unlock();
+
+		wake();
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop the front of the highest non-empty lane.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool tryPop(T& out) override
+	{
+		for (std::size_t i = 0; i < lanes_.size(); ++i)
+		{
+			if (lanes_[i]->size.load(std::memory_order_acquire) == 0)
+			{
+				continue;
+			}
+
+			if (starvationLimit_ > 0 && streak_.load(std::memory_order_relaxed) >= starvationLimit_)
+			{
+				streak_.store(0, std::memory_order_relaxed);
+				for (std::size_t j = i + 1; j < lanes_.size(); ++j)
+				{
+					if (popLane(*lanes_[j], out))
+					{
+						++lanes_[j]->guarded;
+						return true;
+					}
+				}
+			}
+
+			if (popLane(*lanes_[i], out))
+			{
+				// passing a waiting lower lane by
+				if (starvationLimit_ > 0)
+				{
+					for (std::size_t j = i + 1; j < lanes_.size(); ++j)
+					{
+						if (lanes_[j]->size.load(std::memory_order_relaxed) > 0)
+						{
+							streak_.fetch_add(1, std::memory_order_relaxed);
+							return true;
+						}
+					}
+					streak_.store(0, std::memory_order_relaxed);
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Blocking pop of an element.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	******************************************************************************/
+	void waitPop(T& out)
+	{
+		while (!waitPop(out, 1000))
+		{
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element, waiting for one.
+	*
+	* \param[out] out Reference to popped element.
+	* \param[in] milliSeconds Pop timeout (in milliseconds).
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool waitPop(T& out, std::uint32_t milliSeconds) override
+	{
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliSeconds);
+		if (tryPop(out) || wait_.poll([this, &out]() { return tryPop(out); }, deadline))
+		{
+			return true;
+		}
+		if (!wait_.parks())
+		{
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock{ mutex_ };
+		waiting_.fetch_add(1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		const bool popped = condition_.wait_until(lock, deadline, [this, &out]() {
+			return tryPop(out);
+		});
+		waiting_.fetch_sub(1, std::memory_order_relaxed);
+		return popped;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Check if all lanes are empty.
+	*
+	* \return true if the queue is empty, false otherwhise.
+	*
+	******************************************************************************/
+	bool empty() const override
+	{
+		for (const std::unique_ptr<Lane>& lane : lanes_)
+		{
+			if (lane->size.load(std::memory_order_acquire) > 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of lanes.
+	*
+	******************************************************************************/
+	std::size_t lanes() const
+	{
+		return lanes_.size();
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the counters of a lane.
+	*
+	* \param lane Lane, less than lanes().
+	*
+	******************************************************************************/
+	LaneStatistics statistics(std::size_t lane) const
+	{
+		Lane& l = *lanes_[lane];
+		std::lock_guard<std::mutex> lock{ l.mutex };
+		LaneStatistics s;
+		s.size = l.queue.size();
+		s.highWater = l.highWater;
+		s.pushed = l.pushed;
+		s.guarded = l.guarded;
+		return s;
+	}
+
+private:
+
+	/**
+	* One FIFO lane.
+	*/
+	struct Lane
+	{
+		Lane() : size(0), highWater(0), pushed(0), guarded(0)
+		{
+		}
+
+		mutable std::mutex mutex;			///< Guards the lane.
+		std::deque<T> queue;				///< Elements of the lane.
+		std::atomic<std::size_t> size;		///< Nr of elements, read without the lock.
+		std::size_t highWater;				///< Most elements ever queued.
+		std::uint64_t pushed;				///< Elements pushed.
+		std::atomic<std::uint64_t> guarded;	///< Pops granted by the starvation guard.
+		std::condition_variable space;		///< Signalled when a bounded lane gets room.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Pop the front of a lane if any.
+	*
+	******************************************************************************/
+	bool popLane(Lane& lane, T& out)
+	{
+		std::lock_guard<std::mutex> lock{ lane.mutex };
+		if (lane.queue.empty())
+		{
+			return false;
+		}
+		out = std::move(lane.queue.front());
+		lane.queue.pop_front();
+		lane.size.store(lane.queue.size(), std::memory_order_release);
+		if (laneCapacity_ > 0)
+		{
+			lane.space.notify_one();
+		}
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wake a parked consumer, if any.
+	*
+	******************************************************************************/
+	void wake()
+	{
+		// pairs with the fence in waitPop(): either the consumer sees the element or we see it waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting_.load(std::memory_order_relaxed) > 0)
+		{
+			std::lock_guard<std::mutex> lock{ mutex_ };
+			condition_.notify_one();
+		}
+	}
+
+
+	std::vector<std::unique_ptr<Lane>> lanes_;	///< Lanes, highest priority first.
+	Classifier classify_;						///< Lane of an element.
+	std::size_t laneCapacity_;					///< Max nr of elements per lane, 0 for unbounded.
+	std::size_t starvationLimit_;				///< Pops passing a waiting lower lane by before it is served, 0 for none.
+	WaitStrategy wait_;							///< How consumers wait.
+	std::atomic<std::size_t> streak_;			///< Consecutive pops passing a waiting lower lane by.
+	std::atomic<int> waiting_;					///< Nr of parked consumers.
+	std::mutex mutex_;							///< Guards parking.
+	std::condition_variable condition_;			///< Parked consumers.
+};
@@ -0,0 +1,205 @@
+/*****************************************************************************/
+/**
+* \file	QueueMetrics.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+* Optional instrumentation of a ThreadSafeQueue, compiled in with
+* -DQUEUE_METRICS (make QUEUE_METRICS=1). Without it the queue keeps no
+* timestamps and its metrics() snapshot holds the depth only.
+*
+******************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#ifdef QUEUE_METRICS
+#include "LatencyHistogram.hpp"
+#include <boost/utility.hpp>
+#endif
+
+/*****************************************************************************/
+/**
+* \brief Snapshot of the metrics of one queue.
+*
+******************************************************************************/
+struct QueueMetricsSnapshot
+{
+	/**
+	* Summary of a histogram, nanoseconds.
+	*/
+	struct Distribution
+	{
+		std::uint64_t count;	///< Nr of samples.
+		double mean;			///< Mean.
+		std::uint64_t p50;		///< Median.
+		std::uint64_t p99;		///< 99th percentile.
+		std::uint64_t max;		///< Max.
+	};
+
+	bool enabled;				///< Built with QUEUE_METRICS. Otherwise only depth is set.
+	std::uint64_t pushes;		///< Elements accepted, coalesced ones included.
+	std::uint64_t pops;			///< Elements popped by consumers.
+	std::size_t depth;			///< Elements queued.
+	std::size_t highWater;		///< Most elements ever queued.
+	Distribution queued;		///< Time from push to pop.
+	Distribution waited;		///< Time a waiting pop spent waiting, timeouts included.
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Print on one line, times in microseconds.
+	*
+	* \param out Stream to print on.
+	* \param name Line prefix.
+	*
+	******************************************************************************/
+	void print(std::ostream& out, const std::string& name) const
+	{
+		out << name << ": depth " << depth;
+		if (enabled)
+		{
+			out << ", high-water " << highWater << ", pushes " << pushes << ", pops " << pops
+				<< ", queued p50/p99/max " << queued.p50 / 1e3 << "/" << queued.p99 / 1e3 << "/" << queued.max / 1e3
+				<< " us, waited p50/p99/max " << waited.p50 / 1e3 << "/" << waited.p99 / 1e3 << "/" << waited.max / 1e3 << " us";
+		}
+		out << std::endl;
+	}
+};
+
+#ifdef QUEUE_METRICS
+
+/*****************************************************************************/
+/**
+* \brief Counters and histograms of one queue.
+*
+* Updated by the queue with relaxed atomics and read by a monitor thread
+* through snapshot() at any time.
+*
+******************************************************************************/
+class QueueMetrics : private boost::noncopyable
+{
+public:
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. All zero.
+	*
+	******************************************************************************/
+	QueueMetrics() :
+		pushes_(0),
+		pops_(0),
+		highWater_(0)
+	{
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the current time, steady clock nanoseconds.
+	*
+	******************************************************************************/
+	static std::int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Count an accepted element.
+	*
+	* \param depth Elements queued after the push.
+	*
+	******************************************************************************/
+	void pushed(std::size_t depth)
+	{
+		pushes_.fetch_add(1, std::memory_order_relaxed);
+		if (depth > highWater_.load(std::memory_order_relaxed))
+		{
+			highWater_.store(depth, std::memory_order_relaxed);
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Count a popped element.
+	*
+	* \param pushTime When it was pushed, see now().
+	*
+	******************************************************************************/
+	void popped(std::int64_t pushTime)
+	{
+		pops_.fetch_add(1, std::memory_order_relaxed);
+		queued_.record(now() - pushTime);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Record the time a waiting pop waited.
+	*
+	* \param start When the pop started, see now().
+	*
+	******************************************************************************/
+	void waited(std::int64_t start)
+	{
+		waited_.record(now() - start);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot.
+	*
+	* \param depth Elements queued.
+	*
+	******************************************************************************/
+	QueueMetricsSnapshot snapshot(std::size_t depth) const
+	{
+		QueueMetricsSnapshot s;
+		s.enabled = true;
+		s.pushes = pushes_.load(std::memory_order_relaxed);
+		s.pops = pops_.load(std::memory_order_relaxed);
+		s.depth = depth;
+		s.highWater = highWater_.load(std::memory_order_relaxed);
+		s.queued = summarize(queued_);
+		s.waited = summarize(waited_);
+		return s;
+	}
+
+private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the summary of a histogram.
+	*
+	******************************************************************************/
+	static QueueMetricsSnapshot::Distribution summarize(const LatencyHistogram& histogram)
+	{
+		QueueMetricsSnapshot::Distribution d;
+		d.count = histogram.count();
+		d.mean = histogram.mean();
+		d.p50 = histogram.percentile(50);
+		d.p99 = histogram.percentile(99);
+		d.max = histogram.max();
+		return d;
+	}
+
+	std::atomic<std::uint64_t> pushes_;		///< Elements accepted.
+	std::atomic<std::uint64_t> pops_;		///< Elements popped.
+	std::atomic<std::size_t> highWater_;	///< Most elements queued. Written under the queue lock.
+	LatencyHistogram queued_;				///< Push to pop.
+	LatencyHistogram waited_;				///< Time in waiting pops.
+};
+
+#endif
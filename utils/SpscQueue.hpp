@@ -0,0 +1,368 @@
+/*****************************************************************************/
+/**
+* \file	SpscQueue.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include "MessageQueue.hpp"
+#include "WaitStrategy.hpp"
+#include <boost/utility.hpp>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Lock-free single producer, single consumer ring buffer.
+*
+* For a path with exactly one pushing and one popping thread, e.g. a serial
+* reader and its consumer. The ring is allocated once; push and pop are a few
+* loads and one release store, with the head and tail on separate cache lines
+* and each side caching the other's index. A consumer waiting in waitPop()
+* polls according to its WaitStrategy, by default a brief spin, then parks on
+* a condition variable, and the producer only takes the mutex to wake it
+* when it is parked.
+*
+* A full ring makes push() wait for the consumer, like a bounded
+* ThreadSafeQueue with overflowBlock, or discard the pushed element to the
+* drop function if one is given.
+*
+******************************************************************************/
+template <typename T>
+class SpscQueue : public MessageQueue<T>, private boost::noncopyable
+{
+public:
+
+	/**
+	* Called for each discarded element, e.g. to delete it.
+	*/
+	typedef std::function<void(T&)> DropFunction;
+
+	/**
+	* Queue counters.
+	*/
+	struct Statistics
+	{
+		std::size_t size;			///< Elements queued.
+		std::size_t capacity;		///< Ring size.
+		std::uint64_t dropped;		///< Elements discarded when full.
+		std::uint64_t blocked;		///< Pushes that waited for a pop.
+		std::uint64_t parked;		///< Pops that parked the consumer.
+	};
+
+	/**
+	* Queue settings
+	*/
+	enum Settings
+	{
+		CACHE_LINE = 64,		///< Cache line size, the separation of the indices.
+		SPIN_COUNT = 64,		///< Empty polls before the consumer parks, by default.
+		FULL_SLEEP = 50,		///< Producer sleep in microseconds while the ring is full.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param capacity Min nr of elements, rounded up to a power of two.
+	* \param drop Called for a pushed element when full, instead of waiting.
+	*
+	******************************************************************************/
+	explicit SpscQueue(std::size_t capacity = 1024, DropFunction drop = DropFunction()) :
+		ring_(),
+		mask_(0),
+		drop_(drop),
+		wait_(WaitStrategy::spin(SPIN_COUNT)),
+		head_(0),
+		tailCache_(0),
+		tail_(0),
+		headCache_(0),
+		waiting_(false),
+		dropped_(0),
+		blocked_(0),
+		parked_(0)
+	{
+		std::size_t size = 2;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		ring_.reset(new T[size]);
+		mask_ = size - 1;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set how waitPop() waits for an element. Set before use.
+	*
+	* \param strategy Wait strategy. Default: spin(SPIN_COUNT).
+	*
+	******************************************************************************/
+	void setWaitStrategy(const WaitStrategy& strategy)
+	{
+		wait_ = strategy;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element. Producer thread only.
+	*
+	* \param value The element.
+	*
+	* \return false if full and the element went to the drop function.
+	*
+	******************************************************************************/
+	bool push(T value) override
+	{
+		if (!pushSlot(value))
+		{
+			return false;
+		}
+		wake();
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push several elements, waking the consumer once. Producer thread only.
+	*
+	* \param values The elements, moved out. Cleared.
+	*
+	* \return Nr of elements not discarded.
+	*
+	******************************************************************************/
+	std::size_t pushBulk(std::vector<T>& values) override
+	{
+		std::size_t pushed = 0;
+		for (T& value : values)
+		{
+			if (pushSlot(value))
+			{
+				++pushed;
+			}
+		}
+		values.clear();
+		if (pushed > 0)
+		{
+			wake();
+		}
+		return pushed;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element. Consumer thread only.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool tryPop(T& out) override
+	{
+		const std::size_t head = head_.load(std::memory_order_relaxed);
+		if (head == tailCache_)
+		{
+			tailCache_ = tail_.load(std::memory_order_acquire);
+			if (head == tailCache_)
+			{
+				return false;
+			}
+		}
+
+		out = std::move(ring_[head & mask_]);
+		head_.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Blocking pop of an element. Consumer thread only.
+	*
+	* \param[out] out Reference to popped element.
+	*
+	******************************************************************************/
+	void waitPop(T& out)
+	{
+		while (!waitPop(out, 1000))
+		{
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Tries to pop an element, waiting for one. Consumer thread only.
+	*
+	* \param[out] out Reference to popped element.
+	* \param[in] milliSeconds Pop timeout (in milliseconds).
+	*
+	* \return true if successful.
+	*
+	******************************************************************************/
+	bool waitPop(T& out, std::uint32_t milliSeconds) override
+	{
+		const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliSeconds);
+		if (wait_.poll([this, &out]() { return tryPop(out); }, deadline))
+		{
+			return true;
+		}
+		return wait_.parks() && park(deadline) && tryPop(out);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Check if the queue is empty.
+	*
+	* \return true if the queue is empty, false otherwhise.
+	*
+	******************************************************************************/
+	bool empty() const override
+	{
+		return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if a push to a full ring discards, i.e. a drop function was given.
+	*
+	******************************************************************************/
+	bool discards() const override
+	{
+		return static_cast<bool>(drop_);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the queue counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const
+	{
+		Statistics s;
+		s.size = tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+		s.capacity = mask_ + 1;
+		s.dropped = dropped_.load(std::memory_order_relaxed);
+		s.blocked = blocked_.load(std::memory_order_relaxed);
+		s.parked = parked_.load(std::memory_order_relaxed);
+		return s;
+	}
+
+private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Store an element, waiting for room or dropping it when full.
+	*
+	* \return false if the element went to the drop function.
+	*
+	******************************************************************************/
+	bool pushSlot(T& value)
+	{
+		const std::size_t tail = tail_.load(std::memory_order_relaxed);
+		if (tail - headCache_ > mask_)
+		{
+			headCache_ = head_.load(std::memory_order_acquire);
+			if (tail - headCache_ > mask_)
+			{
+				if (drop_)
+				{
+					dropped_.fetch_add(1, std::memory_order_relaxed);
+					drop_(value);
+					return false;
+				}
+
+				blocked_.fetch_add(1, std::memory_order_relaxed);
+				wake();		// elements stored before without a wake-up
+				while (tail - (headCache_ = head_.load(std::memory_order_acquire)) > mask_)
+				{
+					std::this_thread::sleep_for(std::chrono::microseconds(FULL_SLEEP));
+				}
+			}
+		}
+
+		ring_[tail & mask_] = std::move(value);
+		tail_.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wake the consumer if it is parked.
+	*
+	******************************************************************************/
+	void wake()
+	{
+		// pairs with the fence in park(): either the consumer sees the element or we see it waiting
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiting_.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> lock{ mutex_ };
+			condition_.notify_one();
+		}
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Sleep until the ring holds an element or the deadline passes.
+	*
+	* \return true if an element is available.
+	*
+	******************************************************************************/
+	bool park(std::chrono::steady_clock::time_point deadline)
+	{
+		const std::size_t head = head_.load(std::memory_order_relaxed);
+		std::unique_lock<std::mutex> lock{ mutex_ };
+		waiting_.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		parked_.fetch_add(1, std::memory_order_relaxed);
+		const bool ready = condition_.wait_until(lock, deadline, [this, head]() {
+			return tail_.load(std::memory_order_acquire) != head;
+		});
+		waiting_.store(false, std::memory_order_relaxed);
+		return ready;
+	}
+
+
+	std::unique_ptr<T[]> ring_;		///< Elements, a power of two.
+	std::size_t mask_;				///< Ring size minus one.
+	DropFunction drop_;				///< Called for a pushed element when full.
+	WaitStrategy wait_;				///< How the consumer waits.
+
+	alignas(CACHE_LINE) std::atomic<std::size_t> head_;	///< Next element to pop. Written by the consumer.
+	std::size_t tailCache_;								///< Consumer's copy of tail_.
+
+	alignas(CACHE_LINE) std::atomic<std::size_t> tail_;	///< Next free slot. Written by the producer.
+	std::size_t headCache_;								///< Producer's copy of head_.
+
+	alignas(CACHE_LINE) std::atomic<bool> waiting_;		///< True while the consumer is parked.
+	std::mutex mutex_;									///< Guards parking.
+	std::condition_variable condition_;					///< Parked consumer.
+	std::atomic<std::uint64_t> dropped_;				///< Elements discarded when full.
+	std::atomic<std::uint64_t> blocked_;				///< Pushes that waited for a pop.
+	std::atomic<std::uint64_t> parked_;					///< Pops that parked the consumer.
+};
@@ -12,46 +12,206 @@
 #ifndef THREADSAFEQUEUE_HPP
 #define THREADSAFEQUEUE_HPP
 
+#include "MessageQueue.hpp"
+#include "WaitStrategy.hpp"
+#include "QueueMetrics.hpp"
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
+#include <deque>
 #include <memory>
 #include <chrono>
 #include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 /******************************************************************************/
 /**
 *
 * \brief The ThreadSafeQueue class provides a wrapper around a basic queue to provide thread safety.
 *
+* The queue is unbounded unless given a capacity. A full queue then blocks the
+* producer, discards the oldest or the newest element, or coalesces: a pushed
+* element replaces the queued one with the same key, e.g. the previous reading
+* of a parameter, and only a new key discards the oldest element. Discarded
+* elements go to a drop function; a queue of pointers that may discard
+* must be given one, see setCapacity().
+*
+* Elements are moved in and out, so T may be move-only, e.g. a
+* std::unique_ptr, except for the copy constructor.
+*
 ******************************************************************************/
 template <typename T>
-class ThreadSafeQueue
+class ThreadSafeQueue : public MessageQueue<T>
 {
 public:
 
+	/**
+	* What a push does when the queue is full. All but overflowBlock discard,
+	* so for a pointer T they need a drop function.
+	*/
+	enum Overflow
+	{
+		overflowBlock,		///< Wait for a pop.
+		overflowDropOldest,	///< Discard the oldest element.
+		overflowDropNewest,	///< Discard the pushed element.
+		overflowCoalesce	///< Replace the element with the same key, else discard the oldest.
+	};
+
+	/**
+	* Returns the coalescing key of an element.
+	*/
+	typedef std::function<std::string(const T&)> KeyFunction;
+
+	/**
+	* Called for each discarded element, e.g. to delete it.
+	*/
+	typedef std::function<void(T&)> DropFunction;
+
+	/**
+	* Queue counters.
+	*/
+	struct Statistics
+	{
+		std::size_t size;			///< Elements queued.
+		std::size_t highWater;		///< Most elements ever queued.
+		std::uint64_t dropped;		///< Elements discarded when full.
+		std::uint64_t coalesced;	///< Elements replaced by a newer one with the same key.
+		std::uint64_t blocked;		///< Pushes that waited for a pop.
+	};
+
 
 	/*****************************************************************************/
 	/**
 	* \brief Default constructor
 	*
 	******************************************************************************/
-    ThreadSafeQueue(void)
+    ThreadSafeQueue(void) :
+        m_capacity(0),
+        m_overflow(overflowBlock),
+        m_wait(WaitStrategy::blocking()),
+        m_size(0),
+        m_popped(0),
+        m_highWater(0),
+        m_dropped(0),
+        m_coalesced(0),
+        m_blocked(0)
     {
     }
 
 
 	/*****************************************************************************/
 	/**
-	* \brief Copy constructor
+	* \brief Copy constructor. Copies the elements, not the bounds or counters.
 	*
 	* \param other Reference to other queue.
 	*
 	******************************************************************************/
-    ThreadSafeQueue(ThreadSafeQueue const &other)
+    ThreadSafeQueue(ThreadSafeQueue const &other) :
+        m_capacity(0),
+        m_overflow(overflowBlock),
+        m_wait(WaitStrategy::blocking()),
+        m_size(0),
+        m_popped(0),
+        m_highWater(0),
+        m_dropped(0),
+        m_coalesced(0),
+        m_blocked(0)
     {
-        std::lock_guard<std::mutex> lock{ m_mutex };
+        std::lock_guard<std::mutex> lock{ other.m_mutex };
         m_queue=other.m_queue;
+#ifdef QUEUE_METRICS
+        m_stamps=other.m_stamps;
+#endif
+        m_size=m_queue.size();
+        m_highWater=m_queue.size();
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Bound the queue. Set before use.
+	*
+	* \param capacity Max nr of elements, 0 for unbounded.
+	* \param overflow What a push does when the queue is full.
+	* \param drop Called for each discarded or replaced element, e.g. to delete it.
+	* \param key Coalescing key, required for overflowCoalesce.
+	*
+	* With overflowCoalesce, elements are coalesced also while there is room.
+	*
+	* \throws std::invalid_argument if pointers may be discarded without a drop function,
+	* since they would leak. Pass one that does nothing for pointers not owned.
+	*
+	******************************************************************************/
+    void setCapacity(std::size_t capacity, Overflow overflow = overflowBlock,
+        DropFunction drop = DropFunction(), KeyFunction key = KeyFunction())
+    {
+        const bool discards = overflow == overflowCoalesce || (overflow != overflowBlock && capacity > 0);
+        if (std::is_pointer<T>::value && discards && !drop)
+            throw std::invalid_argument("ThreadSafeQueue: discarded pointers need a drop function");
+
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        m_capacity = capacity;
+        m_overflow = (overflow == overflowCoalesce && !key) ? overflowDropOldest : overflow;
+        m_drop = drop;
+        m_key = key;
+        m_keys.clear();
+        m_space.notify_all();
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Set how the waiting pops wait for an element. Set before use.
+	*
+	* \param strategy Wait strategy. Default: blocking().
+	*
+	******************************************************************************/
+    void setWaitStrategy(const WaitStrategy& strategy)
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        m_wait = strategy;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the queue counters.
+	*
+	******************************************************************************/
+    Statistics statistics(void) const
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        Statistics s;
+        s.size = m_queue.size();
+        s.highWater = m_highWater;
+        s.dropped = m_dropped;
+        s.coalesced = m_coalesced;
+        s.blocked = m_blocked;
+        return s;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the instrumentation, see QueueMetrics.hpp.
+	* Lock-free, for a monitor thread.
+	*
+	******************************************************************************/
+    QueueMetricsSnapshot metrics(void) const
+    {
+#ifdef QUEUE_METRICS
+        return m_metrics.snapshot(m_size.load(std::memory_order_relaxed));
+#else
+        QueueMetricsSnapshot s = QueueMetricsSnapshot();
+        s.depth = m_size.load(std::memory_order_relaxed);
+        return s;
+#endif
     }
 
 
@@ -64,14 +224,14 @@ public:
 	* \return true if successful.
 	*
 	******************************************************************************/
-    bool tryPop(T& out)
+    bool tryPop(T& out) override
     {
         std::lock_guard<std::mutex> lock{ m_mutex };
         if (m_queue.empty())
             return false;
 
-        out = m_queue.front();
-        m_queue.pop();
+        out = std::move(m_queue.front());
+        popFront();
         return true;
     }
 
@@ -81,6 +241,7 @@ public:
 	* \brief Tries to pop an element from the queue.
 	*
 	* \return A shared_ptr to the element if successful, an empty pointer otherwhise.
+	* Allocates per pop; prefer tryPop(T&).
 	*
 	******************************************************************************/
     std::shared_ptr<T> tryPop()
@@ -89,8 +250,8 @@ public:
         if (m_queue.empty())
             return std::shared_ptr<T>();
 
-        std::shared_ptr<T> res(std::make_shared<T>(m_queue.front()));
-        m_queue.pop();
+        std::shared_ptr<T> res(std::make_shared<T>(std::move(m_queue.front())));
+        popFront();
         return res;
     }
 
@@ -104,10 +265,10 @@ public:
 	******************************************************************************/
     void waitPop(T& out)
     {
-        std::unique_lock<std::mutex> lock{ m_mutex };
-        m_condition.wait(lock, [this]() {return !m_queue.empty();});
-        out = m_queue.front();
-        m_queue.pop();
+        std::unique_lock<std::mutex> lock{ m_mutex, std::defer_lock };
+        waitNotEmpty(lock, nullptr);
+        out = std::move(m_queue.front());
+        popFront();
     }
 
 
@@ -115,15 +276,15 @@ public:
 	/**
 	* \brief Blocking pop of an element from the queue.
 	*
-	* \return A shared_ptr to the element.
+	* \return A shared_ptr to the element. Allocates per pop; prefer waitPop(T&).
 	*
 	******************************************************************************/
     std::shared_ptr<T> waitPop()
     {
-        std::unique_lock<std::mutex> lock{ m_mutex };
-        m_condition.wait(lock, [this]() {return !m_queue.empty();});
-        std::shared_ptr<T> res(std::make_shared<T>(m_queue.front()));
-        m_queue.pop();
+        std::unique_lock<std::mutex> lock{ m_mutex, std::defer_lock };
+        waitNotEmpty(lock, nullptr);
+        std::shared_ptr<T> res(std::make_shared<T>(std::move(m_queue.front())));
+        popFront();
         return res;
     }
 
@@ -138,14 +299,14 @@ public:
 	* \return true if successful.
 	*
 	******************************************************************************/
-    bool waitPop(T& out, std::uint32_t milliSeconds)
+    bool waitPop(T& out, std::uint32_t milliSeconds) override
     {
-        std::unique_lock<std::mutex> lock{ m_mutex };
-        m_condition.wait_for(lock, std::chrono::milliseconds(milliSeconds), [this]() {return !m_queue.empty();});
-        if (m_queue.empty())
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliSeconds);
+        std::unique_lock<std::mutex> lock{ m_mutex, std::defer_lock };
+        if (!waitNotEmpty(lock, &deadline))
             return false;
-        out = m_queue.front();
-        m_queue.pop();
+        out = std::move(m_queue.front());
+        popFront();
         return true;
     }
 
@@ -156,12 +317,129 @@ public:
 	*
 	* \param value The element.
 	*
+	* \return false if the element was discarded, overflowDropNewest only.
+	*
 	******************************************************************************/
-    void push(T value)
+    bool push(T value) override
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        m_queue.push(std::move(value));
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!pushLocked(lock, value))
+            return false;
         m_condition.notify_one();
+        return true;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Construct an element in place at the back of the queue.
+	*
+	* \param args Constructor arguments of the element.
+	*
+	* \return false if the element was discarded, see push().
+	*
+	******************************************************************************/
+    template <typename... Args>
+    bool emplace(Args&&... args)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_overflow == overflowCoalesce || isFull())
+        {
+            // the overflow policy needs the element
+            T value(std::forward<Args>(args)...);
+            if (!pushLocked(lock, value))
+                return false;
+        }
+        else
+        {
+            m_queue.emplace_back(std::forward<Args>(args)...);
+            pushedBack();
+        }
+        m_condition.notify_one();
+        return true;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push several elements under one lock.
+	*
+	* \param values The elements, moved out. Cleared.
+	*
+	* \return Nr of elements not discarded, see push().
+	*
+	******************************************************************************/
+    std::size_t pushBulk(std::vector<T>& values) override
+    {
+        const std::size_t pushed = pushBulk(values.begin(), values.end());
+        values.clear();
+        return pushed;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push a range of elements under one lock.
+	*
+	* \param first First element, moved from.
+	* \param last End of the range.
+	*
+	* \return Nr of elements not discarded, see push().
+	*
+	******************************************************************************/
+    template <typename Iterator>
+    std::size_t pushBulk(Iterator first, Iterator last)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        std::size_t pushed = 0;
+        for (; first != last; ++first)
+        {
+            if (pushLocked(lock, *first))
+                ++pushed;
+        }
+        if (pushed > 1)
+            m_condition.notify_all();
+        else if (pushed == 1)
+            m_condition.notify_one();
+        return pushed;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Pop the available elements up to a max under one lock.
+	*
+	* \param[out] out Container the elements are appended to with push_back().
+	* \param[in] max Max nr of elements to pop.
+	*
+	* \return Nr of popped elements.
+	*
+	******************************************************************************/
+    template <typename Container>
+    std::size_t drainTo(Container& out, std::size_t max)
+    {
+        std::lock_guard<std::mutex> lock{ m_mutex };
+        return drainLocked(out, max);
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait for an element, then pop all available up to a max under one lock.
+	*
+	* \param[out] out Popped elements are appended.
+	* \param[in] max Max nr of elements to pop.
+	* \param[in] milliSeconds Timeout (in milliseconds) waiting for the first.
+	*
+	* \return Nr of popped elements, 0 upon timeout.
+	*
+	******************************************************************************/
+    std::size_t waitPopBulk(std::vector<T>& out, std::size_t max, std::uint32_t milliSeconds) override
+    {
+        const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliSeconds);
+        std::unique_lock<std::mutex> lock{ m_mutex, std::defer_lock };
+        waitNotEmpty(lock, &deadline);
+        return drainLocked(out, max);
     }
 
 
@@ -172,13 +450,25 @@ public:
 	* \return true if the queue is empty, false otherwhise.
 	*
 	******************************************************************************/
-    bool empty(void) const
+    bool empty(void) const override
     {
         std::lock_guard<std::mutex> lock(m_mutex);
         return m_queue.empty();
     }
 
 
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the overflow policy may discard, see setCapacity().
+	*
+	******************************************************************************/
+    bool discards() const override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_overflow == overflowCoalesce || (m_capacity > 0 && m_overflow != overflowBlock);
+    }
+
+
 	/*****************************************************************************/
 	/**
 	* \brief Clear the queue.
@@ -187,18 +477,225 @@ public:
     void clear(void)
     {
         std::lock_guard<std::mutex> lock{ m_mutex };
-        while (!m_queue.empty())
-        {
-            m_queue.pop();
-        }
+        m_popped += m_queue.size();
+        m_queue.clear();
+        m_keys.clear();
+#ifdef QUEUE_METRICS
+        m_stamps.clear();
+#endif
+        m_size.store(0, std::memory_order_relaxed);
         m_condition.notify_all();
+        m_space.notify_all();
     }
 
 
 private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if a bounded queue is full. Call locked.
+	*
+	******************************************************************************/
+    bool isFull(void) const
+    {
+        return m_capacity > 0 && m_queue.size() >= m_capacity;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait for an element according to the wait strategy, then lock.
+	*
+	* \param lock Deferred lock of m_mutex. Locked upon return.
+	* \param deadline Time to give up, nullptr to wait forever.
+	*
+	* \return true if the queue holds an element.
+	*
+	******************************************************************************/
+    bool waitNotEmpty(std::unique_lock<std::mutex>& lock, const std::chrono::steady_clock::time_point *deadline)
+    {
+#ifdef QUEUE_METRICS
+        const std::int64_t start = QueueMetrics::now();
+#endif
+        // poll without the lock, the size is published by every change
+        m_wait.poll([this]() {return m_size.load(std::memory_order_relaxed) > 0;},
+            deadline ? *deadline : std::chrono::steady_clock::time_point::max());
+
+        lock.lock();
+        if (!deadline)
+            m_condition.wait(lock, [this]() {return !m_queue.empty();});
+        else if (m_wait.parks())
+            m_condition.wait_until(lock, *deadline, [this]() {return !m_queue.empty();});
+#ifdef QUEUE_METRICS
+        m_metrics.waited(start);
+#endif
+        return !m_queue.empty();
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Account for an element added at the back. Call locked.
+	*
+	******************************************************************************/
+    void pushedBack(void)
+    {
+        m_size.store(m_queue.size(), std::memory_order_relaxed);
+        if (m_queue.size() > m_highWater)
+            m_highWater = m_queue.size();
+#ifdef QUEUE_METRICS
+        m_stamps.push_back(QueueMetrics::now());
+        m_metrics.pushed(m_queue.size());
+#endif
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Remove the front element and wake a blocked producer. Call locked.
+	*
+	* \param consumed false if the element is discarded rather than popped.
+	*
+	******************************************************************************/
+    void popFront(bool consumed = true)
+    {
+#ifdef QUEUE_METRICS
+        if (consumed)
+            m_metrics.popped(m_stamps.front());
+        m_stamps.pop_front();
+#else
+        (void)consumed;
+#endif
+        m_queue.pop_front();
+        m_size.store(m_queue.size(), std::memory_order_relaxed);
+        ++m_popped;
+        if (m_capacity > 0)
+            m_space.notify_one();
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Push an element according to the overflow policy. Call locked.
+	*
+	* \param value The element, moved from unless discarded.
+	* \param lock The held lock, released while blocking for room.
+	*
+	* \return false if the pushed element was discarded.
+	*
+	******************************************************************************/
+    bool pushLocked(std::unique_lock<std::mutex>& lock, T& value)
+    {
+        if (m_overflow == overflowCoalesce)
+        {
+            const std::string key = m_key(value);
+            typename std::unordered_map<std::string, std::uint64_t>::iterator it = m_keys.find(key);
+            if (it != m_keys.end() && it->second >= m_popped)
+            {
+                T& queued = m_queue[it->second - m_popped];
+                if (m_drop)
+                    m_drop(queued);
+                queued = std::move(value);
+                ++m_coalesced;
+#ifdef QUEUE_METRICS
+                m_metrics.pushed(m_queue.size());
+#endif
+                return true;
+            }
+
+            // the position of the pushed element, also when the front is discarded for it
+            m_keys[key] = m_popped + m_queue.size();
+
+            // forget the keys of popped elements, at most one key is live per element
+            if (m_keys.size() > 2 * (m_queue.size() + 1))
+            {
+                for (it = m_keys.begin(); it != m_keys.end(); )
+                {
+                    if (it->second < m_popped)
+                        it = m_keys.erase(it);
+                    else
+                        ++it;
+                }
+            }
+        }
+
+        if (isFull())
+        {
+            switch (m_overflow)
+            {
+            case overflowBlock:
+                ++m_blocked;
+                m_condition.notify_all();	// consumers of elements pushed under this lock
+                m_space.wait(lock, [this]() {return !isFull();});
+                break;
+            case overflowDropNewest:
+                ++m_dropped;
+                if (m_drop)
+                    m_drop(value);
+                return false;
+            case overflowDropOldest:
+            case overflowCoalesce:
+                ++m_dropped;
+                if (m_drop)
+                    m_drop(m_queue.front());
+                popFront(false);
+                break;
+            }
+        }
+
+        m_queue.push_back(std::move(value));
+        pushedBack();
+        return true;
+    }
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Move up to max elements to the back of a container. Call locked.
+	*
+	******************************************************************************/
+    template <typename Container>
+    std::size_t drainLocked(Container& out, std::size_t max)
+    {
+        std::size_t popped = 0;
+        while (popped < max && !m_queue.empty())
+        {
+            out.push_back(std::move(m_queue.front()));
+            m_queue.pop_front();
+#ifdef QUEUE_METRICS
+            m_metrics.popped(m_stamps.front());
+            m_stamps.pop_front();
+#endif
+            ++popped;
+        }
+        m_popped += popped;
+        m_size.store(m_queue.size(), std::memory_order_relaxed);
+        if (m_capacity > 0 && popped > 0)
+            m_space.notify_all();
+        return popped;
+    }
+
+
     mutable std::mutex m_mutex;		///< Mutex used for sychronization.
-    std::queue<T> m_queue;			///< Queue of elements.
+    std::deque<T> m_queue;			///< Queue of elements.
     std::condition_variable m_condition;	///< Condition variable used for sychronization.
+    std::condition_variable m_space;	///< Signalled when a bounded queue gets room.
+    std::size_t m_capacity;			///< Max nr of elements, 0 for unbounded.
+    Overflow m_overflow;			///< What a push does when full.
+    DropFunction m_drop;			///< Called for each discarded element.
+    KeyFunction m_key;				///< Coalescing key.
+    std::unordered_map<std::string, std::uint64_t> m_keys;	///< Position of the latest element per key. Pruned once mostly popped.
+    WaitStrategy m_wait;			///< How the waiting pops wait.
+    std::atomic<std::size_t> m_size;	///< Nr of elements, polled without the lock.
+    std::uint64_t m_popped;			///< Elements ever removed, the position of the front.
+    std::size_t m_highWater;		///< Most elements ever queued.
+    std::uint64_t m_dropped;		///< Elements discarded when full.
+    std::uint64_t m_coalesced;		///< Elements replaced by a newer one.
+    std::uint64_t m_blocked;		///< Pushes that waited for a pop.
+#ifdef QUEUE_METRICS
+    std::deque<std::int64_t> m_stamps;	///< Push time of each element, in step with m_queue.
+    QueueMetrics m_metrics;			///< Counters and histograms.
+#endif
 };
 
 #endif
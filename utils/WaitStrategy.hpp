@@ -0,0 +1,221 @@
+/*****************************************************************************/
+/**
+* \file	WaitStrategy.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+/*****************************************************************************/
+/**
+* \brief Spin hint to the CPU inside a polling loop.
+*
+* Lets a hyper-threaded sibling run and saves power while polling, without
+* giving up the time slice.
+*
+******************************************************************************/
+inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	asm volatile("yield");
+#endif
+}
+
+/*****************************************************************************/
+/**
+* \brief How a queue consumer waits for an element, chosen per queue.
+*
+* Parking on a condition variable costs a futex wake-up and a reschedule,
+* tens of microseconds, for the first element after a quiet period. Polling
+* first catches an element that arrives shortly after, at the cost of CPU:
+*
+*   waitBlocking        park at once.
+*   waitSpin            poll spins times with a pause hint, then park.
+*   waitSpinYieldPark   also poll yields times giving up the CPU, then park.
+*   waitBusyPoll        poll with a pause hint until the timeout, never park.
+*                       For a consumer pinned to a core of its own.
+*
+******************************************************************************/
+struct WaitStrategy
+{
+	/**
+	* Strategies
+	*/
+	enum Kind
+	{
+		waitBlocking,		///< Park at once.
+		waitSpin,			///< Spin, then park.
+		waitSpinYieldPark,	///< Spin, yield, then park.
+		waitBusyPoll		///< Spin until the timeout.
+	};
+
+	Kind kind;				///< Strategy.
+	std::uint32_t spins;	///< Polls with a pause hint before yielding or parking.
+	std::uint32_t yields;	///< Polls with a yield before parking.
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Parks at once, see blocking().
+	*
+	******************************************************************************/
+	WaitStrategy() :
+		kind(waitBlocking),
+		spins(0),
+		yields(0)
+	{
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param kind Strategy.
+	* \param spins Polls with a pause hint.
+	* \param yields Polls with a yield.
+	*
+	******************************************************************************/
+	WaitStrategy(Kind kind, std::uint32_t spins, std::uint32_t yields) :
+		kind(kind),
+		spins(spins),
+		yields(yields)
+	{
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the strategy that parks at once.
+	*
+	******************************************************************************/
+	static WaitStrategy blocking()
+	{
+		return WaitStrategy(waitBlocking, 0, 0);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the strategy that spins, then parks.
+	*
+	******************************************************************************/
+	static WaitStrategy spin(std::uint32_t spins = 1000)
+	{
+		return WaitStrategy(waitSpin, spins, 0);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the strategy that spins, yields, then parks.
+	*
+	******************************************************************************/
+	static WaitStrategy spinYieldPark(std::uint32_t spins = 100, std::uint32_t yields = 10)
+	{
+		return WaitStrategy(waitSpinYieldPark, spins, yields);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the strategy that never parks.
+	*
+	******************************************************************************/
+	static WaitStrategy busyPoll()
+	{
+		return WaitStrategy(waitBusyPoll, 0, 0);
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the name of the strategy.
+	*
+	******************************************************************************/
+	const char *name() const
+	{
+		switch (kind)
+		{
+		case waitBlocking:
+			return "blocking";
+		case waitSpin:
+			return "spin";
+		case waitSpinYieldPark:
+			return "spin-yield-park";
+		case waitBusyPoll:
+			return "busy-poll";
+		}
+		return "";
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Poll before parking.
+	*
+	* \param ready Returns true when the wait is over, e.g. after a successful pop.
+	* \param deadline Time to give up, busy-poll only.
+	*
+	* \return true if ready. false means park, or for busy-poll, time out.
+	*
+	******************************************************************************/
+	template <typename Ready>
+	bool poll(Ready ready, std::chrono::steady_clock::time_point deadline) const
+	{
+		if (kind == waitBusyPoll)
+		{
+			for (std::uint32_t i = 1; ; ++i)
+			{
+				if (ready())
+				{
+					return true;
+				}
+				// the clock is read rarely, it costs more than a poll
+				if (i % 64 == 0 && std::chrono::steady_clock::now() >= deadline)
+				{
+					return false;
+				}
+				cpuRelax();
+			}
+		}
+
+		for (std::uint32_t i = 0; i < spins; ++i)
+		{
+			if (ready())
+			{
+				return true;
+			}
+			cpuRelax();
+		}
+		for (std::uint32_t i = 0; i < yields && kind == waitSpinYieldPark; ++i)
+		{
+			if (ready())
+			{
+				return true;
+			}
+			std::this_thread::yield();
+		}
+		return false;
+	}
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if the strategy parks after polling.
+	*
+	******************************************************************************/
+	bool parks() const
+	{
+		return kind != waitBusyPoll;
+	}
+};
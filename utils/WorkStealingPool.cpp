@@ -0,0 +1,352 @@
+/*****************************************************************************/
+/**
+* \file	WorkStealingPool.cpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+
+#include "WorkStealingPool.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+
+
+// the pool and worker index of the calling thread
+static thread_local const WorkStealingPool *currentPool = nullptr;
+static thread_local int currentIndex = -1;
+
+/**
+* xorshift32, the victim choice needs no better randomness.
+*/
+static std::uint32_t nextRandom(std::uint32_t& seed)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+WorkStealingPool::WorkStealingPool(std::size_t workers, int firstCpu) :
+	workers_(),
+	next_(0),
+	pending_(0),
+	idle_(0),
+	submitted_(0),
+	submitting_(0),
+	stopping_(false)
+{
+	const std::size_t cpus = std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+	const std::size_t count = workers > 0 ? workers : cpus;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::unique_ptr<Worker> worker(new Worker);
+		worker->size = 0;
+		worker->executed = 0;
+		worker->stolen = 0;
+		worker->failed = 0;
+		worker->parked = 0;
+		workers_.push_back(std::move(worker));
+	}
+
+	// all deques exist before the first worker steals
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const int cpu = firstCpu >= 0 ? static_cast<int>((firstCpu + i) % cpus) : -1;
+		workers_[i]->thread = std::thread(&WorkStealingPool::run, this, i, cpu);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	stop();
+}
+
+bool WorkStealingPool::submit(Task task)
+{
+	return push(std::move(task), false);
+}
+
+bool WorkStealingPool::yield(Task task)
+{
+	return push(std::move(task), true);
+}
+
+bool WorkStealingPool::push(Task task, bool front)
+{
+	const int worker = currentWorker();
+	if (worker < 0)
+	{
+		// a worker submits while the pool drains, outsiders are refused
+		++submitting_;
+		if (stopping_)
+		{
+			--submitting_;
+			std::lock_guard<std::mutex> lock{ sleepMutex_ };
+			wake_.notify_all();
+			return false;
+		}
+	}
+
+	const std::size_t index = worker >= 0 ? static_cast<std::size_t>(worker) : next_++ % workers_.size();
+	Worker& w = *workers_[index];
+	{
+		std::lock_guard<std::mutex> lock{ w.mutex };
+		Entry entry = { std::move(task), index };
+		if (front && worker >= 0)
+		{
+			w.tasks.push_front(std::move(entry));
+		}
+		else
+		{
+			w.tasks.push_back(std::move(entry));
+		}
+		w.size.store(w.tasks.size(), std::memory_order_relaxed);
+	}
+	++submitted_;
+	++pending_;
+
+	if (worker < 0)
+	{
+		--submitting_;
+	}
+	if (stopping_)
+	{
+		// parked workers may also be waiting for submitting_ to drop
+		std::lock_guard<std::mutex> lock{ sleepMutex_ };
+		wake_.notify_all();
+	}
+	else if (idle_ > 0)
+	{
+		std::lock_guard<std::mutex> lock{ sleepMutex_ };
+		wake_.notify_one();
+	}
+	return true;
+}
+
+void WorkStealingPool::stop()
+{
+	std::lock_guard<std::mutex> stopLock{ stopMutex_ };
+	{
+		std::lock_guard<std::mutex> lock{ sleepMutex_ };
+		stopping_ = true;
+		wake_.notify_all();
+	}
+	for (std::unique_ptr<Worker>& worker : workers_)
+	{
+		if (worker->thread.joinable())
+		{
+			worker->thread.join();
+		}
+	}
+}
+
+std::size_t WorkStealingPool::workers() const
+{
+	return workers_.size();
+}
+
+WorkStealingPool::Statistics WorkStealingPool::statistics() const
+{
+	Statistics s = Statistics();
+	s.submitted = submitted_;
+	for (const std::unique_ptr<Worker>& worker : workers_)
+	{
+		s.executed += worker->executed;
+		s.stolen += worker->stolen;
+		s.failed += worker->failed;
+		s.parked += worker->parked;
+	}
+	return s;
+}
+
+int WorkStealingPool::currentWorker() const
+{
+	return currentPool == this ? currentIndex : -1;
+}
+
+void WorkStealingPool::run(std::size_t index, int cpu)
+{
+	currentPool = this;
+	currentIndex = static_cast<int>(index);
+	if (cpu >= 0 && cpu < CPU_SETSIZE)
+	{
+		// best effort, an unpinned worker still works
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	Worker& worker = *workers_[index];
+	std::uint32_t seed = static_cast<std::uint32_t>(index) * 2654435761u + 1;
+	Entry entry;
+	for (;;)
+	{
+		if (take(index, seed, entry))
+		{
+			--pending_;
+			try
+			{
+				entry.task();
+			}
+			catch (...)
+			{
+				++worker.failed;
+			}
+			entry.task = Task();
+			++worker.executed;
+			if (entry.owner != index)
+			{
+				++worker.stolen;
+			}
+			continue;
+		}
+		if (stopping_ && submitting_ == 0 && pending_ == 0)
+		{
+			break;
+		}
+		park(worker);
+	}
+
+	currentPool = nullptr;
+	currentIndex = -1;
+}
+
+bool WorkStealingPool::take(std::size_t index, std::uint32_t& seed, Entry& entry)
+{
+	Worker& own = *workers_[index];
+	if (own.size.load(std::memory_order_relaxed) > 0)
+	{
+		std::lock_guard<std::mutex> lock{ own.mutex };
+		if (!own.tasks.empty())
+		{
+			entry = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			own.size.store(own.tasks.size(), std::memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// sweep the others from a random victim on
+	const std::size_t count = workers_.size();
+	const std::size_t first = nextRandom(seed) % count;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const std::size_t victim = (first + i) % count;
+		Worker& other = *workers_[victim];
+		if (victim == index || other.size.load(std::memory_order_relaxed) == 0)
+		{
+			continue;
+		}
+		std::lock_guard<std::mutex> lock{ other.mutex };
+		if (!other.tasks.empty())
+		{
+			entry = std::move(other.tasks.front());
+			other.tasks.pop_front();
+			other.size.store(other.tasks.size(), std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::park(Worker& worker)
+{
+	++worker.parked;
+	++idle_;
+	{
+		std::unique_lock<std::mutex> lock{ sleepMutex_ };
+		wake_.wait(lock, [this]() { return pending_ > 0 || (stopping_ && submitting_ == 0); });
+	}
+	--idle_;
+}
+
+
+Strand::Strand(WorkStealingPool& pool) :
+	pool_(pool),
+	mutex_(),
+	tasks_(),
+	scheduled_(false)
+{
+}
+
+bool Strand::post(WorkStealingPool::Task task)
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		tasks_.push_back(std::move(task));
+		if (scheduled_)
+		{
+			return true;
+		}
+		scheduled_ = true;
+	}
+
+	if (!pool_.submit([this]() { run(); }))
+	{
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		tasks_.clear();
+		scheduled_ = false;
+		return false;
+	}
+	return true;
+}
+
+bool Strand::idle()
+{
+	std::lock_guard<std::mutex> lock{ mutex_ };
+	return !scheduled_ && tasks_.empty();
+}
+
+void Strand::run()
+{
+	for (std::size_t i = 0; i < BATCH; ++i)
+	{
+		WorkStealingPool::Task task;
+		{
+			std::lock_guard<std::mutex> lock{ mutex_ };
+			if (tasks_.empty())
+			{
+				scheduled_ = false;
+				return;
+			}
+			task = std::move(tasks_.front());
+			tasks_.pop_front();
+		}
+
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			// the pool counts the failure, the later tasks still run
+			resume();
+			throw;
+		}
+	}
+	resume();
+}
+
+void Strand::resume()
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		if (tasks_.empty())
+		{
+			scheduled_ = false;
+			return;
+		}
+	}
+
+	// behind the tasks waiting for this worker, the other ports get their turn
+	if (!pool_.yield([this]() { run(); }))
+	{
+		std::lock_guard<std::mutex> lock{ mutex_ };
+		tasks_.clear();
+		scheduled_ = false;
+	}
+}
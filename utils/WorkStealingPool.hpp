@@ -0,0 +1,289 @@
+/*****************************************************************************/
+/**
+* \file	WorkStealingPool.hpp
+*
+* \author	Per Johansson
+*
+* Copyright &copy; Maquet Critical Care AB, Sweden
+*
+******************************************************************************/
+#pragma once
+
+#include <boost/utility.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*****************************************************************************/
+/**
+* \brief Thread pool with a task deque per worker and work stealing.
+*
+* A task submitted from a worker goes to the back of that worker's deque,
+* one submitted from any other thread to the next worker in turn. A worker
+* runs its own tasks newest first, while the data is still in its cache.
+* An idle worker steals the oldest task of a randomly chosen victim and
+* parks only when no deque holds a task. A task yielded from a worker goes
+* to the front of its deque instead, behind everything already queued.
+*
+* Tasks run in any order and in parallel. Tasks that must run in order,
+* e.g. the messages of one port, are posted to a Strand instead.
+*
+******************************************************************************/
+class WorkStealingPool : private boost::noncopyable
+{
+public:
+
+	typedef std::function<void()> Task;
+
+	/**
+	* Pool counters.
+	*/
+	struct Statistics
+	{
+		std::uint64_t submitted;	///< Tasks accepted.
+		std::uint64_t executed;		///< Tasks run.
+		std::uint64_t stolen;		///< Tasks run by another worker than the one they were given to.
+		std::uint64_t failed;		///< Tasks that threw.
+		std::uint64_t parked;		///< Times a worker found no task and parked.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor. Starts the workers.
+	*
+	* \param workers Nr of worker threads, 0 for one per CPU.
+	* \param firstCpu Pin worker i to CPU firstCpu + i, modulo the nr of CPUs.
+	* Default: -1, no pinning.
+	*
+	******************************************************************************/
+	explicit WorkStealingPool(std::size_t workers = 0, int firstCpu = -1);
+
+
+	/****************************************************************************/
+	/**
+	* Destructor. Stops, see stop().
+	*
+	*****************************************************************************/
+	~WorkStealingPool();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue a task.
+	*
+	* \param task The task. An exception it throws is counted and dropped.
+	*
+	* \return false if the pool is stopped.
+	*
+	******************************************************************************/
+	bool submit(Task task);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue a task behind every task queued to the calling worker.
+	*
+	* From a worker the task goes to the front of its deque, where the worker
+	* takes it last and other workers steal it first. From any other thread
+	* like submit().
+	*
+	* \param task The task. An exception it throws is counted and dropped.
+	*
+	* \return false if the pool is stopped.
+	*
+	******************************************************************************/
+	bool yield(Task task);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Run the queued tasks, including those they submit, then join the
+	* workers. Later submits fail.
+	*
+	******************************************************************************/
+	void stop();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the nr of workers.
+	*
+	******************************************************************************/
+	std::size_t workers() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns a snapshot of the pool counters.
+	*
+	******************************************************************************/
+	Statistics statistics() const;
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns the worker thread of the calling thread, -1 if none of this pool.
+	*
+	******************************************************************************/
+	int currentWorker() const;
+
+private:
+
+	/**
+	* A queued task and the worker it was given to.
+	*/
+	struct Entry
+	{
+		Task task;				///< The task.
+		std::size_t owner;		///< Worker whose deque it was pushed to.
+	};
+
+	/**
+	* Deque and counters of one worker.
+	*/
+	struct Worker
+	{
+		std::mutex mutex;						///< Guards tasks.
+		std::deque<Entry> tasks;				///< Own tasks at the back, stolen from the front.
+		std::atomic<std::size_t> size;			///< Nr of tasks, read without locking.
+		std::atomic<std::uint64_t> executed;	///< Tasks run.
+		std::atomic<std::uint64_t> stolen;		///< Tasks stolen from others.
+		std::atomic<std::uint64_t> failed;		///< Tasks that threw.
+		std::atomic<std::uint64_t> parked;		///< Parks.
+		std::thread thread;						///< Runs run().
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue a task, see submit() and yield().
+	*
+	* \param front Push to the front of the deque of the calling worker.
+	*
+	******************************************************************************/
+	bool push(Task task, bool front);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Worker thread.
+	*
+	* \param index Worker index.
+	* \param cpu CPU to pin to, -1 for none.
+	*
+	******************************************************************************/
+	void run(std::size_t index, int cpu);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Take the newest task of the own deque, else steal the oldest of another.
+	*
+	******************************************************************************/
+	bool take(std::size_t index, std::uint32_t& seed, Entry& entry);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Wait until a task is pending or the pool stops.
+	*
+	******************************************************************************/
+	void park(Worker& worker);
+
+
+	std::vector<std::unique_ptr<Worker>> workers_;		///< The workers.
+	std::atomic<std::size_t> next_;						///< Worker of the next task from outside the pool.
+	std::atomic<std::size_t> pending_;					///< Queued tasks, all deques.
+	std::atomic<std::size_t> idle_;						///< Parked or parking workers.
+	std::atomic<std::uint64_t> submitted_;				///< Tasks accepted.
+	std::atomic<std::size_t> submitting_;				///< Submits from outside the pool in progress.
+	std::atomic<bool> stopping_;						///< Set by stop().
+	std::mutex sleepMutex_;								///< Guards parking.
+	std::condition_variable wake_;						///< Signalled on submit and stop.
+	std::mutex stopMutex_;								///< Serializes stop().
+};
+
+
+/*****************************************************************************/
+/**
+* \brief Runs its tasks one at a time in the order posted, on a WorkStealingPool.
+*
+* Use one strand per port, or per port and stage, so the messages of a port
+* keep their order while other ports and stages run in parallel. The strand
+* is a task of the pool while it has work, any worker may run it, and it
+* yields the worker after BATCH tasks, queued behind the tasks already
+* waiting for it, so one busy port cannot hold it.
+* A strand must outlive its tasks, see idle().
+*
+******************************************************************************/
+class Strand : private boost::noncopyable
+{
+public:
+
+	/**
+	* Strand settings
+	*/
+	enum Settings
+	{
+		BATCH = 64,		///< Max tasks run before yielding the worker.
+	};
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Constructor.
+	*
+	* \param pool Pool that runs the tasks.
+	*
+	******************************************************************************/
+	explicit Strand(WorkStealingPool& pool);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Queue a task behind the previously posted ones.
+	*
+	* \return false if the pool is stopped. The queued tasks are then dropped.
+	*
+	******************************************************************************/
+	bool post(WorkStealingPool::Task task);
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Returns true if no task is queued or running.
+	*
+	******************************************************************************/
+	bool idle();
+
+private:
+
+	/*****************************************************************************/
+	/**
+	* \brief Pool task. Runs up to BATCH tasks, then yields if more are queued.
+	*
+	******************************************************************************/
+	void run();
+
+
+	/*****************************************************************************/
+	/**
+	* \brief Yield the worker if tasks are queued, else mark the strand idle.
+	*
+	******************************************************************************/
+	void resume();
+
+
+	WorkStealingPool& pool_;					///< Runs the strand.
+	std::mutex mutex_;							///< Guards tasks_ and scheduled_.
+	std::deque<WorkStealingPool::Task> tasks_;	///< Posted, not yet run.
+	bool scheduled_;							///< Submitted to the pool or running.
+};